@@ -0,0 +1,351 @@
+﻿#include "batchprocessor.h"
+#include "boundedqueue.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutex>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+#include <atomic>
+#include <cstdio>
+#include <optional>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+struct WorkItem
+{
+    QString path;
+    QString target;     // 输出文件
+    QImage image;
+};
+
+// 一个阶段的统计: 累计耗时(各线程之和)
+struct StageTimer
+{
+    std::atomic<qint64> nanoseconds{0};
+
+    template <typename Function>
+    auto measure(Function function)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        auto result = function();
+        nanoseconds += timer.nsecsElapsed();
+        return result;
+    }
+
+    double milliseconds() const { return nanoseconds.load() / 1e6; }
+};
+
+// 启动 count 个线程执行 function, 全部结束后调用 finished
+QList<QThread *> startWorkers(int count, const std::function<void()> &function,
+                              const std::function<void()> &finished)
+{
+    auto remaining = std::make_shared<std::atomic<int>>(count);
+    QList<QThread *> threads;
+    for (int i = 0; i < count; ++i) {
+        QThread *thread = QThread::create([function, finished, remaining]() {
+            function();
+            if (--*remaining == 0) {
+                finished();
+            }
+        });
+        thread->start();
+        threads.append(thread);
+    }
+    return threads;
+}
+
+// Windows 下 GUI 程序默认没有控制台, 批处理时挂到启动它的终端上
+void attachConsole()
+{
+#ifdef Q_OS_WIN
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+#endif
+}
+
+QStringList collectInputs(const QStringList &paths)
+{
+    QStringList nameFilters;
+    for (const QByteArray &format : QImageReader::supportedImageFormats()) {
+        nameFilters << "*." + QString::fromLatin1(format);
+    }
+
+    QStringList files;
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (info.isDir()) {
+            const QDir dir(path);
+            for (const QString &name : dir.entryList(nameFilters, QDir::Files, QDir::Name)) {
+                files << dir.filePath(name);
+            }
+        } else if (info.isFile()) {
+            files << path;
+        }
+    }
+    return files;
+}
+
+// 各输入对应的输出文件: 输出目录下的 "文件名.格式"
+// 不同目录中的同名文件或只有扩展名不同的文件会得到相同的名字, 重复的依次加上 "_2"、"_3" 等后缀
+QStringList outputNames(const QStringList &inputs, const QString &outputDir, const QByteArray &format,
+                        QStringList *renamed)
+{
+    const QDir dir(outputDir);
+    QSet<QString> used;
+    QStringList targets;
+    for (const QString &path : inputs) {
+        const QFileInfo info(path);
+        const QString suffix = '.' + QString::fromLatin1(format.isEmpty() ? info.suffix().toLatin1().toLower() : format);
+        const QString plain = info.completeBaseName() + suffix;
+        QString name = plain;
+        // 按不区分大小写比较, 在 Windows 和 macOS 上同样不会覆盖
+        for (int n = 2; used.contains(name.toLower()); ++n) {
+            name = QString("%1_%2%3").arg(info.completeBaseName()).arg(n).arg(suffix);
+        }
+        if (renamed && name != plain) *renamed << path + " -> " + name;
+        used.insert(name.toLower());
+        targets << dir.filePath(name);
+    }
+    return targets;
+}
+
+} // namespace
+
+bool BatchProcessor::isBatchMode(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--batch") == 0) return true;
+    }
+    return false;
+}
+
+bool BatchProcessor::parseOperations(const QString &text, QVector<ImageOperation> &operations, QString *error)
+{
+    const QStringList items = text.split(',', Qt::SkipEmptyParts);
+    for (const QString &item : items) {
+        const QString name = item.section('=', 0, 0).trimmed().toLower();
+        const QString value = item.section('=', 1).trimmed();
+        bool ok = true;
+
+        if (name == "grayscale" || name == "gray") {
+            operations.append(ImageOperation::grayscale());
+        } else if (name == "binarize" || name == "threshold") {
+            operations.append(ImageOperation::binarize(value.isEmpty() ? 128 : value.toInt(&ok)));
+        } else if (name == "mean" || name == "meanfilter") {
+            operations.append(ImageOperation::meanFilter(value.isEmpty() ? 1 : value.toInt(&ok)));
+        } else if (name == "gamma") {
+            operations.append(ImageOperation::gammaTransform(value.toFloat(&ok)));
+            ok = ok && operations.last().gamma > 0.0f;
+        } else if (name == "edge" || name == "sobel") {
+            operations.append(ImageOperation::edgeDetection(value.isEmpty() ? 30 : value.toInt(&ok)));
+        } else if (name == "canny") {
+            // canny=低阈值:高阈值
+            int low = 40, high = 100;
+            if (!value.isEmpty()) {
+                const QStringList parts = value.split(':');
+                bool lowOk = false, highOk = false;
+                low = parts.value(0).toInt(&lowOk);
+                high = parts.value(1).toInt(&highOk);
+                ok = parts.size() == 2 && lowOk && highOk && low <= high;
+            }
+            operations.append(ImageOperation::canny(low, high));
+        } else if (name == "levels") {
+            // levels=黑场:白场[:伽马]
+            const QStringList parts = value.split(':');
+            ok = parts.size() == 2 || parts.size() == 3;
+            bool blackOk = false, whiteOk = false, gammaOk = true;
+            const int black = parts.value(0).toInt(&blackOk);
+            const int white = parts.value(1).toInt(&whiteOk);
+            const float gamma = parts.size() == 3 ? parts.at(2).toFloat(&gammaOk) : 1.0f;
+            ok = ok && blackOk && whiteOk && gammaOk && gamma > 0.0f;
+            operations.append(ImageOperation::levels(black, white, gamma));
+        } else {
+            if (error) *error = QString("未知操作: %1").arg(name);
+            return false;
+        }
+
+        if (!ok) {
+            if (error) *error = QString("参数无效: %1").arg(item);
+            return false;
+        }
+    }
+    return true;
+}
+
+int BatchProcessor::exec(int argc, char *argv[])
+{
+    attachConsole();
+
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("批量处理图像, 不启动界面");
+    parser.addHelpOption();
+    parser.addOption({ "batch", "批处理模式" });
+    parser.addOption({ "op", "操作列表, 按顺序执行: grayscale, binarize=T, mean=R, gamma=G, edge=T, canny=L:H, levels=B:W[:G]", "ops" });
+    parser.addOption({ "in", "输入目录或文件, 可重复", "path" });
+    parser.addOption({ "out", "输出目录", "dir" });
+    parser.addOption({ { "j", "jobs" }, "并行处理的图像数, 默认为 CPU 核数", "n" });
+    parser.addOption({ "format", "输出格式(png, jpg, ...), 默认与输入相同", "format" });
+    parser.addOption({ "quality", "编码质量 0-100", "q" });
+    parser.process(app);
+
+    Options options;
+    options.inputs = collectInputs(parser.values("in") + parser.positionalArguments());
+    options.outputDir = parser.value("out");
+    options.format = parser.value("format").toLatin1().toLower();
+    options.quality = parser.isSet("quality") ? parser.value("quality").toInt() : -1;
+    options.jobs = parser.isSet("j") ? parser.value("j").toInt() : QThread::idealThreadCount();
+
+    QString error;
+    if (!parseOperations(parser.value("op"), options.operations, &error)) {
+        err << error << Qt::endl;
+        return 2;
+    }
+    if (options.operations.isEmpty()) {
+        err << "需要用 --op 指定至少一个操作" << Qt::endl;
+        parser.showHelp(2);
+    }
+    if (options.inputs.isEmpty() || options.outputDir.isEmpty() || options.jobs < 1) {
+        err << "需要 --in、--out, 且 -j 至少为 1" << Qt::endl;
+        parser.showHelp(2);
+    }
+    if (!QDir().mkpath(options.outputDir)) {
+        err << "无法创建输出目录 " << options.outputDir << Qt::endl;
+        return 2;
+    }
+
+    return BatchProcessor(options).run() == 0 ? 0 : 1;
+}
+
+BatchProcessor::BatchProcessor(const Options &batchOptions)
+    : options(batchOptions)
+{
+}
+
+int BatchProcessor::run()
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    // 并行度放在图像之间, 每张图像单线程处理, 避免线程过量
+    TileScheduler::setThreadCount(1);
+
+    const int jobs = options.jobs;
+    const int ioThreads = qMax(1, jobs / 2);
+    // 队列容量决定内存上限: 最多约 3 * jobs + 2 * ioThreads 张图像同时在内存中
+    BoundedQueue<WorkItem> decoded(jobs);
+    BoundedQueue<WorkItem> processed(jobs);
+
+    std::atomic<int> nextInput{0};
+    std::atomic<int> failed{0};
+    std::atomic<int> written{0};
+    std::atomic<qint64> pixels{0};
+    StageTimer decodeTimer, processTimer, encodeTimer;
+    QMutex logMutex;
+
+    auto fail = [&](const QString &path, const QString &reason) {
+        ++failed;
+        QMutexLocker locker(&logMutex);
+        err << path << ": " << reason << Qt::endl;
+    };
+
+    QStringList renamed;
+    const QStringList targets = outputNames(options.inputs, options.outputDir, options.format, &renamed);
+    for (const QString &line : std::as_const(renamed)) {
+        err << "输出文件重名, 改为: " << line << Qt::endl;
+    }
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    QList<QThread *> threads;
+    threads += startWorkers(ioThreads, [&]() {
+        for (int index; (index = nextInput++) < options.inputs.size();) {
+            WorkItem item;
+            item.path = options.inputs.at(index);
+            item.target = targets.at(index);
+            item.image = decodeTimer.measure([&]() {
+                TRACE_SCOPE("batch", "decode");
+                QImageReader reader(item.path);
+                reader.setAutoTransform(true);
+                return ImageProcessor::toWorkingFormat(reader.read());
+            });
+            if (item.image.isNull()) {
+                fail(item.path, "无法解码");
+                continue;
+            }
+            pixels += qint64(item.image.width()) * item.image.height();
+            decoded.push(std::move(item));
+        }
+    }, [&]() { decoded.close(); });
+
+    threads += startWorkers(jobs, [&]() {
+        while (std::optional<WorkItem> item = decoded.pop()) {
+            item->image = processTimer.measure([&]() {
+                TRACE_SCOPE("batch", "process");
+                return ImageProcessor::applyChain(item->image, options.operations);
+            });
+            if (item->image.isNull()) {
+                fail(item->path, "处理失败");
+                continue;
+            }
+            processed.push(std::move(*item));
+        }
+    }, [&]() { processed.close(); });
+
+    threads += startWorkers(ioThreads, [&]() {
+        while (std::optional<WorkItem> item = processed.pop()) {
+            const QString &target = item->target;
+            const QByteArray format = QFileInfo(target).suffix().toLatin1();
+            const bool ok = encodeTimer.measure([&]() {
+                TRACE_SCOPE("batch", "encode");
+                QImageWriter writer(target, format);
+                writer.setQuality(options.quality);
+                return writer.write(item->image);
+            });
+            if (ok) {
+                ++written;
+            } else {
+                fail(item->path, "无法写入 " + target);
+            }
+        }
+    }, []() {});
+
+    for (QThread *thread : std::as_const(threads)) {
+        thread->wait();
+        delete thread;
+    }
+
+    // 吞吐量汇总
+    const double seconds = qMax(1e-9, wallClock.nsecsElapsed() / 1e9);
+    const double megapixels = pixels.load() / 1e6;
+    out << QString("处理完成: %1 张成功, %2 张失败, 共 %3 张")
+               .arg(written.load()).arg(failed.load()).arg(options.inputs.size()) << Qt::endl;
+    out << QString("耗时 %1 s, %2 张/s, %3 MP/s (线程: 解码 %4, 处理 %5, 编码 %6)")
+               .arg(seconds, 0, 'f', 2)
+               .arg(written.load() / seconds, 0, 'f', 1)
+               .arg(megapixels / seconds, 0, 'f', 1)
+               .arg(ioThreads).arg(jobs).arg(ioThreads) << Qt::endl;
+    out << QString("各阶段累计耗时: 解码 %1 ms, 处理 %2 ms, 编码 %3 ms")
+               .arg(decodeTimer.milliseconds(), 0, 'f', 0)
+               .arg(processTimer.milliseconds(), 0, 'f', 0)
+               .arg(encodeTimer.milliseconds(), 0, 'f', 0) << Qt::endl;
+    return failed.load();
+}
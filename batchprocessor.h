@@ -0,0 +1,42 @@
+﻿#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "imageprocessor.h"
+
+// 无界面批处理模式:
+//   qt_last_game --batch --op grayscale,gamma=0.8 --in <目录或文件> --out <目录> -j 16
+// 不创建 QApplication / WebEngine, 只使用 QCoreApplication
+// 解码、处理、编码三个阶段各自并行, 阶段之间为有界队列, 同时在内存中的图像数量有上限
+class BatchProcessor
+{
+public:
+    struct Options
+    {
+        QStringList inputs;             // 输入文件
+        QString outputDir;              // 输出为 "文件名.格式", 重名时加序号, 不会互相覆盖
+        QVector<ImageOperation> operations;
+        int jobs = 1;                   // 处理线程数
+        QByteArray format;              // 输出格式, 为空时与输入相同
+        int quality = -1;               // 编码质量, -1 为默认
+    };
+
+    // 命令行中是否请求了批处理模式
+    static bool isBatchMode(int argc, char *argv[]);
+    // 批处理入口, 返回进程退出码
+    static int exec(int argc, char *argv[]);
+
+    // 解析操作列表, 如 "grayscale,gamma=0.8,binarize=128"
+    static bool parseOperations(const QString &text, QVector<ImageOperation> &operations, QString *error);
+
+    explicit BatchProcessor(const Options &options);
+    // 执行批处理, 返回失败的文件数
+    int run();
+
+private:
+    Options options;
+};
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,15 @@
+# 处理内核与交互往返的基准测试, 结果以 JSON 输出
+#   qmake benchmarks.pro && make
+#   ./benchmarks --output results.json
+QT       += core gui
+QT       -= widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = benchmarks
+
+include(../imageengine.pri)
+
+SOURCES += \
+    main.cpp
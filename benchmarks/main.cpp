@@ -0,0 +1,371 @@
+﻿#include "imagekernels.h"
+#include "imageprocessor.h"
+#include "tilescheduler.h"
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// 处理内核与交互往返的基准测试
+// 每个操作在 1/12/48 MP 图像上分别以单线程和多线程运行, 结果输出为 JSON,
+// 用于在版本之间比较性能回退
+
+namespace {
+
+// 结果格式版本, 字段含义变化时递增
+const int SchemaVersion = 1;
+
+// 交互往返使用的画布显示尺寸(代理图最大尺寸)
+const QSize CanvasSize(1600, 1000);
+
+struct Options {
+    QVector<double> megapixels;
+    QVector<int> threads;
+    QStringList operations;
+    qint64 minTimeMs = 500;
+    int minIterations = 3;
+    int maxIterations = 50;
+};
+
+struct Timing {
+    int iterations = 0;
+    double medianMs = 0;
+    double minMs = 0;
+    double meanMs = 0;
+};
+
+// 预热一次后重复执行, 直到累计耗时与次数都达到下限
+Timing measure(const Options &options, const std::function<void()> &function)
+{
+    function();
+
+    QVector<double> samples;
+    QElapsedTimer total;
+    total.start();
+    while (samples.size() < options.maxIterations &&
+           (samples.size() < options.minIterations || total.elapsed() < options.minTimeMs)) {
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        samples.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    Timing timing;
+    timing.iterations = samples.size();
+    timing.medianMs = samples.at(samples.size() / 2);
+    timing.minMs = samples.first();
+    double sum = 0;
+    for (double sample : std::as_const(samples)) {
+        sum += sample;
+    }
+    timing.meanMs = sum / samples.size();
+    return timing;
+}
+
+QJsonObject timingToJson(const Timing &timing, const QSize &size)
+{
+    const double megapixels = double(size.width()) * size.height() / 1e6;
+    QJsonObject json;
+    json["width"] = size.width();
+    json["height"] = size.height();
+    json["megapixels"] = megapixels;
+    json["iterations"] = timing.iterations;
+    json["medianMs"] = timing.medianMs;
+    json["minMs"] = timing.minMs;
+    json["meanMs"] = timing.meanMs;
+    json["megapixelsPerSecond"] = timing.medianMs > 0 ? megapixels * 1000.0 / timing.medianMs : 0.0;
+    return json;
+}
+
+// 4:3 比例的测试图像, 内容为带噪声的渐变, 避免 PNG 编码和阈值分支过于理想
+QImage makeTestImage(double megapixels)
+{
+    const int width = qMax(16, qRound(std::sqrt(megapixels * 1e6 * 4.0 / 3.0)));
+    const int height = qMax(16, qRound(megapixels * 1e6 / width));
+
+    QImage image(width, height, ImageProcessor::WorkingFormat);
+    quint32 seed = 0x9e3779b9u;
+    for (int y = 0; y < height; ++y) {
+        uchar *line = image.scanLine(y);
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            const int noise = int(seed >> 27) - 16;
+            line[x * 4 + 0] = uchar(qBound(0, x * 255 / width + noise, 255));
+            line[x * 4 + 1] = uchar(qBound(0, y * 255 / height + noise, 255));
+            line[x * 4 + 2] = uchar(qBound(0, (x + y) * 255 / (width + height) - noise, 255));
+            line[x * 4 + 3] = 255;
+        }
+    }
+    return image;
+}
+
+// 沿对角线的一笔马赛克, 与页面画笔的默认参数接近
+QVector<MosaicDab> diagonalStroke(const QSize &size)
+{
+    const qreal aspect = qreal(size.height()) / size.width();
+    QVector<MosaicDab> dabs;
+    const int count = 64;
+    for (int i = 0; i < count; ++i) {
+        const qreal t = qreal(i) / (count - 1);
+        MosaicDab dab;
+        dab.center = QPointF(0.1 + 0.8 * t, aspect * (0.1 + 0.8 * t));
+        dab.radius = 0.03;
+        dab.blockSize = 0.01;
+        dabs.append(dab);
+    }
+    return dabs;
+}
+
+ImageOperation benchmarkOperation(const QString &name, const QSize &size)
+{
+    if (name == "grayscale") return ImageOperation::grayscale();
+    if (name == "binarize") return ImageOperation::binarize(128);
+    if (name == "mean3") return ImageOperation::meanFilter(1);
+    if (name == "mean15") return ImageOperation::meanFilter(7);
+    if (name == "gamma") return ImageOperation::gammaTransform(2.2f);
+    if (name == "sobel") return ImageOperation::edgeDetection(100);
+    // canny 每次完整计算; canny-preview 经 applyPreview, 重复执行时梯度来自缓存, 测得的是拖动阈值滑块时的耗时
+    if (name == "canny" || name == "canny-preview") return ImageOperation::canny(40, 100);
+    if (name == "mosaic") return ImageOperation::mosaic(diagonalStroke(size));
+    return ImageOperation();
+}
+
+const QStringList AllOperations = {
+    "grayscale", "binarize", "mean3", "mean15", "gamma", "sobel", "canny", "canny-preview", "mosaic"
+};
+
+// 旧的交互往返: 整图 PNG 编码 + Base64 送入页面, 页面导出的 Base64 PNG 再解码回 QImage
+// (原 displayImageInCanvas / updateImageWithBase64 的流程)
+qint64 legacyRoundTrip(const QImage &image, const ImageOperation &operation)
+{
+    const QImage result = ImageProcessor::apply(image, operation);
+
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    result.save(&buffer, "PNG");
+    const QByteArray base64 = encoded.toBase64();
+    const QString dataUrl = QString("data:image/png;base64,") + QString::fromLatin1(base64);
+
+    const QByteArray received = QByteArray::fromBase64(dataUrl.mid(dataUrl.indexOf(',') + 1).toLatin1());
+    QImage decoded;
+    decoded.loadFromData(received, "PNG");
+    return dataUrl.size();
+}
+
+// 当前的交互往返: 在代理图上计算预览, 以原始 RGBA 帧发布, 页面通过 qtframe:// 读取
+// 结果一直留在 C++ 端, 不需要回传
+qint64 frameRoundTrip(const QImage &proxy, const ImageOperation &operation)
+{
+    const QImage frame = ImageProcessor::toWorkingFormat(ImageProcessor::apply(proxy, operation));
+
+    QBuffer device;
+    device.setData(QByteArray::fromRawData(reinterpret_cast<const char *>(frame.constBits()),
+                                           frame.sizeInBytes()));
+    device.open(QIODevice::ReadOnly);
+    QByteArray received(frame.sizeInBytes(), Qt::Uninitialized);
+    qint64 offset = 0;
+    while (offset < received.size()) {
+        const qint64 chunk = device.read(received.data() + offset, qMin<qint64>(64 * 1024, received.size() - offset));
+        if (chunk <= 0) break;
+        offset += chunk;
+    }
+    return offset;
+}
+
+template <typename T>
+QVector<T> parseList(const QString &text, bool *ok)
+{
+    QVector<T> values;
+    *ok = true;
+    for (const QString &part : text.split(',', Qt::SkipEmptyParts)) {
+        bool valid = false;
+        const double value = part.trimmed().toDouble(&valid);
+        if (!valid || value <= 0) {
+            *ok = false;
+            return {};
+        }
+        values.append(T(value));
+    }
+    *ok = *ok && !values.isEmpty();
+    return values;
+}
+
+QJsonObject environmentInfo()
+{
+    QJsonObject json;
+    json["schema"] = SchemaVersion;
+    json["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    json["qtVersion"] = QString::fromLatin1(qVersion());
+    json["buildAbi"] = QSysInfo::buildAbi();
+    json["cpuArchitecture"] = QSysInfo::currentCpuArchitecture();
+    json["os"] = QSysInfo::prettyProductName();
+    json["logicalCores"] = QThread::idealThreadCount();
+    json["simd"] = QString::fromLatin1(ImageKernels::simdLevelName(ImageKernels::activeSimdLevel()));
+#ifdef QT_DEBUG
+    json["buildType"] = "debug";
+#else
+    json["buildType"] = "release";
+#endif
+    return json;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("benchmarks");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("图像处理内核与交互往返基准测试, 结果以 JSON 输出");
+    parser.addHelpOption();
+    QCommandLineOption outputOption({"o", "output"}, "结果写入文件, 默认输出到标准输出", "file");
+    QCommandLineOption sizesOption("sizes", "图像尺寸(百万像素), 逗号分隔", "list", "1,12,48");
+    QCommandLineOption threadsOption("threads", "线程数, 逗号分隔, 默认为 1 和逻辑核数", "list");
+    QCommandLineOption opsOption("ops", "要测试的操作, 逗号分隔: " + AllOperations.join(','), "list",
+                                 AllOperations.join(','));
+    QCommandLineOption minTimeOption("min-time", "每项测试的最短累计时间(毫秒)", "ms", "500");
+    QCommandLineOption simdOption("simd", "指定指令集: scalar|sse2|avx2", "level");
+    QCommandLineOption noRoundTripOption("no-roundtrip", "跳过交互往返测试");
+    parser.addOptions({outputOption, sizesOption, threadsOption, opsOption, minTimeOption,
+                       simdOption, noRoundTripOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    Options options;
+    bool ok = false;
+    options.megapixels = parseList<double>(parser.value(sizesOption), &ok);
+    if (!ok) {
+        err << "无效的尺寸列表: " << parser.value(sizesOption) << Qt::endl;
+        return 1;
+    }
+    const int defaultThreads = TileScheduler::threadCount();
+    options.threads = parser.isSet(threadsOption) ? parseList<int>(parser.value(threadsOption), &ok)
+                                                  : QVector<int>{1, defaultThreads};
+    if (!ok) {
+        err << "无效的线程数列表: " << parser.value(threadsOption) << Qt::endl;
+        return 1;
+    }
+    options.threads.erase(std::unique(options.threads.begin(), options.threads.end()), options.threads.end());
+    options.operations = parser.value(opsOption).split(',', Qt::SkipEmptyParts);
+    for (const QString &name : std::as_const(options.operations)) {
+        if (!AllOperations.contains(name)) {
+            err << "未知操作: " << name << Qt::endl;
+            return 1;
+        }
+    }
+    options.minTimeMs = qMax(0, parser.value(minTimeOption).toInt());
+
+    if (parser.isSet(simdOption)) {
+        const QString level = parser.value(simdOption).toLower();
+        if (level == "scalar") {
+            ImageKernels::setSimdLevel(ImageKernels::SimdLevel::Scalar);
+        } else if (level == "sse2") {
+            ImageKernels::setSimdLevel(ImageKernels::SimdLevel::SSE2);
+        } else if (level == "avx2") {
+            ImageKernels::setSimdLevel(ImageKernels::SimdLevel::AVX2);
+        } else {
+            err << "未知指令集: " << level << Qt::endl;
+            return 1;
+        }
+    }
+
+    QJsonArray kernelResults;
+    QJsonArray roundTripResults;
+
+    for (double megapixels : std::as_const(options.megapixels)) {
+        const QImage image = makeTestImage(megapixels);
+        err << QString("%1x%2 (%3 MP)").arg(image.width()).arg(image.height()).arg(megapixels) << Qt::endl;
+
+        for (const QString &name : std::as_const(options.operations)) {
+            const ImageOperation operation = benchmarkOperation(name, image.size());
+            const bool preview = name.endsWith("-preview");
+            for (int threads : std::as_const(options.threads)) {
+                TileScheduler::setThreadCount(threads);
+                const Timing timing = measure(options, [&]() {
+                    if (preview) {
+                        ImageProcessor::applyPreview(image, operation);
+                    } else {
+                        ImageProcessor::apply(image, operation);
+                    }
+                });
+
+                QJsonObject json = timingToJson(timing, image.size());
+                json["operation"] = name;
+                json["threads"] = threads;
+                kernelResults.append(json);
+                err << QString("  %1 x%2: %3 ms").arg(name, -10).arg(threads).arg(timing.medianMs, 0, 'f', 2)
+                    << Qt::endl;
+            }
+        }
+
+        if (parser.isSet(noRoundTripOption)) continue;
+
+        // 往返测试使用默认线程数, 与界面中的实际情况一致
+        TileScheduler::setThreadCount(defaultThreads);
+        const ImageOperation operation = ImageOperation::grayscale();
+        QImage proxy = image;
+        if (image.width() > CanvasSize.width() || image.height() > CanvasSize.height()) {
+            proxy = ImageProcessor::toWorkingFormat(
+                image.scaled(CanvasSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        }
+
+        qint64 legacyBytes = 0;
+        const Timing legacy = measure(options, [&]() {
+            legacyBytes = legacyRoundTrip(image, operation);
+        });
+        QJsonObject legacyJson = timingToJson(legacy, image.size());
+        legacyJson["path"] = "png-base64";
+        legacyJson["transferBytes"] = legacyBytes;
+        roundTripResults.append(legacyJson);
+
+        qint64 frameBytes = 0;
+        const Timing frame = measure(options, [&]() {
+            frameBytes = frameRoundTrip(proxy, operation);
+        });
+        QJsonObject frameJson = timingToJson(frame, image.size());
+        frameJson["path"] = "raw-frame";
+        frameJson["proxyWidth"] = proxy.width();
+        frameJson["proxyHeight"] = proxy.height();
+        frameJson["transferBytes"] = frameBytes;
+        roundTripResults.append(frameJson);
+
+        err << QString("  往返 png-base64: %1 ms, raw-frame: %2 ms")
+                   .arg(legacy.medianMs, 0, 'f', 2).arg(frame.medianMs, 0, 'f', 2)
+            << Qt::endl;
+    }
+
+    TileScheduler::setThreadCount(defaultThreads);
+
+    QJsonObject root;
+    root["environment"] = environmentInfo();
+    root["kernels"] = kernelResults;
+    root["roundTrip"] = roundTripResults;
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "无法写入结果文件: " << file.fileName() << Qt::endl;
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
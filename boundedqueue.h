@@ -0,0 +1,95 @@
+﻿#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+#include <optional>
+
+// 有界阻塞队列: 队列满时生产者等待, 所有生产者结束后调用 close
+// 关闭后 push 立即返回 false, 用于取消时释放阻塞中的生产者
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity)
+        : capacity(qMax(1, capacity))
+    {
+    }
+
+    bool push(T item)
+    {
+        QMutexLocker locker(&mutex);
+        while (items.size() >= capacity && !closed) {
+            notFull.wait(&mutex);
+        }
+        if (closed) return false;
+        items.enqueue(std::move(item));
+        notEmpty.wakeOne();
+        return true;
+    }
+
+    // 队列已关闭且为空时返回空值
+    std::optional<T> pop()
+    {
+        QMutexLocker locker(&mutex);
+        while (items.isEmpty() && !closed) {
+            notEmpty.wait(&mutex);
+        }
+        if (items.isEmpty()) return std::nullopt;
+        T item = items.dequeue();
+        notFull.wakeOne();
+        return item;
+    }
+
+    // 不等待, 队列为空时返回空值
+    std::optional<T> tryPop()
+    {
+        QMutexLocker locker(&mutex);
+        if (items.isEmpty()) return std::nullopt;
+        T item = items.dequeue();
+        notFull.wakeOne();
+        return item;
+    }
+
+    void close()
+    {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    // 丢弃剩余元素并关闭
+    void abort()
+    {
+        QMutexLocker locker(&mutex);
+        items.clear();
+        closed = true;
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    int size() const
+    {
+        QMutexLocker locker(&mutex);
+        return items.size();
+    }
+
+    // 已关闭且所有元素都已取出
+    bool isDrained() const
+    {
+        QMutexLocker locker(&mutex);
+        return closed && items.isEmpty();
+    }
+
+private:
+    const int capacity;
+    QQueue<T> items;
+    bool closed = false;
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+};
+
+#endif // BOUNDEDQUEUE_H
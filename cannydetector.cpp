@@ -0,0 +1,256 @@
+﻿#include "cannydetector.h"
+#include "imagekernels.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+#include <QRect>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// 滞后连接的分块尺寸, 分块越大跨边界传递的轮次越少
+const int HysteresisTile = 256;
+
+// 5x5 高斯平滑, 越界取最近的边界像素
+// 先求纵向和, 左右各扩展 2 列并按边界复制, 横向求和时不再需要判断边界
+void gaussianTile(const ImageKernels::KernelTable &k, const uchar *gray, qsizetype grayStride,
+                  int width, int height, uchar *dst, const QRect &tile)
+{
+    const int first = qMax(0, tile.left() - 2);
+    const int last = qMin(width - 1, tile.right() + 2);
+    std::vector<quint16> padded(tile.width() + 4);
+    // padded[i] 对应第 tile.left() - 2 + i 列
+    quint16 *column = padded.data() + (first - (tile.left() - 2));
+    quint16 *paddedEnd = padded.data() + padded.size();
+    const int count = last - first + 1;
+
+    for (int y = tile.top(); y <= tile.bottom(); ++y) {
+        const uchar *rows[5];
+        for (int i = 0; i < 5; ++i) {
+            rows[i] = gray + qBound(0, y - 2 + i, height - 1) * grayStride + first;
+        }
+        k.gaussianColumn(rows, column, count);
+        std::fill(padded.data(), column, column[0]);
+        std::fill(column + count, paddedEnd, column[count - 1]);
+        k.gaussianRow(padded.data(), dst + qsizetype(y) * width + tile.left(), tile.width());
+    }
+}
+
+// 从栈中的强边缘开始, 在分块内部把相连的弱边缘标为强边缘
+void traceInTile(uchar *edges, int width, const QRect &tile, std::vector<qsizetype> &stack)
+{
+    while (!stack.empty()) {
+        const qsizetype index = stack.back();
+        stack.pop_back();
+        const int x = int(index % width);
+        const int y = int(index / width);
+        for (int dy = -1; dy <= 1; ++dy) {
+            const int ny = y + dy;
+            if (ny < tile.top() || ny > tile.bottom()) continue;
+            for (int dx = -1; dx <= 1; ++dx) {
+                const int nx = x + dx;
+                if (nx < tile.left() || nx > tile.right()) continue;
+                const qsizetype neighbor = qsizetype(ny) * width + nx;
+                if (edges[neighbor] == CannyDetector::WeakEdge) {
+                    edges[neighbor] = CannyDetector::StrongEdge;
+                    stack.push_back(neighbor);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const CannyDetector::Gradient> CannyDetector::computeGradient(
+    const uchar *gray, qsizetype grayStride, int width, int height, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "canny.gradient");
+    auto gradient = std::make_shared<Gradient>();
+    gradient->width = width;
+    gradient->height = height;
+    const qsizetype size = qsizetype(width) * height;
+    gradient->magnitude.reset(new quint32[size]);
+    gradient->direction.reset(new uchar[size]);
+    quint32 *magnitude = gradient->magnitude.get();
+    uchar *direction = gradient->direction.get();
+    if (width < 3 || height < 3) {
+        std::fill(magnitude, magnitude + size, 0u);
+        return gradient;
+    }
+
+    // 边界像素的幅值为 0, 非极大值抑制时作为邻居读取
+    std::fill(magnitude, magnitude + width, 0u);
+    std::fill(magnitude + size - width, magnitude + size, 0u);
+    for (int y = 1; y < height - 1; ++y) {
+        magnitude[qsizetype(y) * width] = 0;
+        magnitude[qsizetype(y) * width + width - 1] = 0;
+    }
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    std::unique_ptr<uchar[]> blurred(new uchar[size]);
+    const uchar *smooth = blurred.get();
+    const QRect area(0, 0, width, height);
+    if (!TileScheduler::run(area, 2, [&](const QRect &tile) {
+            gaussianTile(k, gray, grayStride, width, height, blurred.get(), tile);
+        }, cancel)) {
+        return nullptr;
+    }
+
+    if (!TileScheduler::run(QRect(1, 1, width - 2, height - 2), 6, [&](const QRect &tile) {
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                const uchar *row = smooth + qsizetype(y) * width;
+                const qsizetype offset = qsizetype(y) * width;
+                k.gradient(row - width, row, row + width, magnitude + offset, direction + offset,
+                           tile.left(), tile.right() + 1);
+            }
+        }, cancel)) {
+        return nullptr;
+    }
+    return gradient;
+}
+
+bool CannyDetector::detect(const Gradient &gradient, int lowThreshold, int highThreshold, uchar *edges,
+                           const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "canny.detect");
+    const int width = gradient.width;
+    const int height = gradient.height;
+    if (width < 3 || height < 3) {
+        std::memset(edges, NoEdge, size_t(width) * height);
+        return true;
+    }
+
+    // 边界像素不是边缘, 内部由下面的分块逐行写满
+    std::memset(edges, NoEdge, size_t(width));
+    std::memset(edges + qsizetype(height - 1) * width, NoEdge, size_t(width));
+    for (int y = 1; y < height - 1; ++y) {
+        edges[qsizetype(y) * width] = NoEdge;
+        edges[qsizetype(y) * width + width - 1] = NoEdge;
+    }
+
+    // 与 Sobel 相同, 比较幅值的平方; 低阈值不超过高阈值
+    // 幅值不超过 sqrt(2) * 1020, 阈值超过 2048 与 2048 等价
+    const int high = qBound(0, highThreshold, 2048);
+    const int low = qBound(0, lowThreshold, high);
+    const quint32 lowLimit = quint32(low * low);
+    const quint32 highLimit = quint32(high * high);
+
+    // 非极大值抑制与双阈值: 沿梯度方向大于一侧且不小于另一侧的像素才可能是边缘,
+    // 避免等值的平台上出现两像素宽的边缘
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    const quint32 *magnitude = gradient.magnitude.get();
+    const uchar *direction = gradient.direction.get();
+    if (!TileScheduler::run(QRect(1, 1, width - 2, height - 2), 6, [&](const QRect &tile) {
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                const qsizetype offset = qsizetype(y) * width;
+                const quint32 *row = magnitude + offset;
+                k.suppress(row - width, row, row + width, direction + offset, edges + offset,
+                           tile.left(), tile.right() + 1, lowLimit, highLimit);
+            }
+        }, cancel)) {
+        return false;
+    }
+
+    // 滞后连接, 第一步: 每个分块从自己的强边缘出发追踪, 只写本分块
+    const QRect area(0, 0, width, height);
+    const QSize tileSize(HysteresisTile, HysteresisTile);
+    const int columns = (width + HysteresisTile - 1) / HysteresisTile;
+    const int rows = (height + HysteresisTile - 1) / HysteresisTile;
+    auto tileIndex = [&](const QRect &tile) {
+        return (tile.top() / HysteresisTile) * columns + tile.left() / HysteresisTile;
+    };
+
+    std::vector<char> changed(size_t(columns) * rows, 0);
+    if (!TileScheduler::run(area, tileSize, [&](const QRect &tile) {
+            std::vector<qsizetype> stack;
+            bool hasStrong = false;
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                uchar *p = edges + qsizetype(y) * width + tile.left();
+                uchar *const end = p + tile.width();
+                // 强边缘通常很稀疏, 用 memchr 跳过其余像素
+                while ((p = static_cast<uchar *>(std::memchr(p, StrongEdge, size_t(end - p))))) {
+                    hasStrong = true;
+                    stack.push_back(p - edges);
+                    traceInTile(edges, width, tile, stack);
+                    ++p;
+                }
+            }
+            // 含有强边缘的分块都可能与相邻分块相连
+            changed[tileIndex(tile)] = hasStrong;
+        }, cancel)) {
+        return false;
+    }
+
+    // 第二步, 按轮次跨分块传递: 先只读地收集边界上与相邻分块强边缘相连的弱边缘,
+    // 再由各分块自己标记并继续追踪; 两个阶段分开执行, 分块之间没有并发写
+    std::vector<std::vector<qsizetype>> seeds(size_t(columns) * rows);
+    std::vector<char> nextChanged(changed.size(), 0);
+    for (;;) {
+        if (!TileScheduler::run(area, tileSize, [&](const QRect &tile) {
+                std::vector<qsizetype> &tileSeeds = seeds[tileIndex(tile)];
+                tileSeeds.clear();
+
+                // 只有相邻分块在上一轮有变化时才需要检查
+                const int column = tile.left() / HysteresisTile;
+                const int row = tile.top() / HysteresisTile;
+                bool neighborChanged = false;
+                for (int r = qMax(0, row - 1); r <= qMin(rows - 1, row + 1); ++r) {
+                    for (int c = qMax(0, column - 1); c <= qMin(columns - 1, column + 1); ++c) {
+                        if ((r != row || c != column) && changed[size_t(r) * columns + c]) {
+                            neighborChanged = true;
+                        }
+                    }
+                }
+                if (!neighborChanged) return;
+
+                auto check = [&](int x, int y) {
+                    const qsizetype index = qsizetype(y) * width + x;
+                    if (edges[index] != WeakEdge) return;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        const int ny = y + dy;
+                        if (ny < 0 || ny >= height) continue;
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            const int nx = x + dx;
+                            if (nx < 0 || nx >= width || tile.contains(nx, ny)) continue;
+                            if (edges[qsizetype(ny) * width + nx] == StrongEdge) {
+                                tileSeeds.push_back(index);
+                                return;
+                            }
+                        }
+                    }
+                };
+                for (int x = tile.left(); x <= tile.right(); ++x) {
+                    check(x, tile.top());
+                    if (tile.bottom() != tile.top()) check(x, tile.bottom());
+                }
+                for (int y = tile.top() + 1; y < tile.bottom(); ++y) {
+                    check(tile.left(), y);
+                    if (tile.right() != tile.left()) check(tile.right(), y);
+                }
+            }, cancel)) {
+            return false;
+        }
+
+        bool anySeed = false;
+        for (const std::vector<qsizetype> &tileSeeds : seeds) {
+            anySeed = anySeed || !tileSeeds.empty();
+        }
+        if (!anySeed) break;
+
+        if (!TileScheduler::run(area, tileSize, [&](const QRect &tile) {
+                const int index = tileIndex(tile);
+                std::vector<qsizetype> &stack = seeds[index];
+                for (qsizetype seed : stack) {
+                    edges[seed] = StrongEdge;
+                }
+                nextChanged[index] = !stack.empty();
+                traceInTile(edges, width, tile, stack);
+            }, cancel)) {
+            return false;
+        }
+        changed.swap(nextChanged);
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+﻿#ifndef CANNYDETECTOR_H
+#define CANNYDETECTOR_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+
+// Canny 边缘检测: 5x5 高斯平滑, Sobel 梯度与方向, 非极大值抑制, 双阈值滞后连接
+// 梯度与阈值无关, 单独计算后可在只改变阈值时复用
+// 各阶段都在 TileScheduler 上分块并行; 滞后连接先在每个分块内部追踪,
+// 再按轮次把跨越分块边界的连接传给相邻分块, 直到没有新的强边缘
+class CannyDetector
+{
+public:
+    // 检测结果中每个像素的类别
+    enum EdgeClass : uchar {
+        NoEdge = 0,
+        WeakEdge = 1,       // 未连接到强边缘的弱边缘, 不是边缘
+        StrongEdge = 255
+    };
+
+    struct Gradient
+    {
+        int width = 0;
+        int height = 0;
+        // 各 width * height 项; 不做初始化, 首次写入分散在各线程上
+        std::unique_ptr<quint32[]> magnitude;   // gx * gx + gy * gy, 边界像素为 0
+        std::unique_ptr<uchar[]> direction;     // 0: 水平, 1: 左上-右下, 2: 竖直, 3: 右上-左下; 边界像素未定义
+    };
+
+    // 在灰度平面上计算梯度, 被取消时返回空指针
+    static std::shared_ptr<const Gradient> computeGradient(const uchar *gray, qsizetype grayStride,
+                                                           int width, int height,
+                                                           const std::atomic<bool> *cancel = nullptr);
+
+    // 阈值与 Sobel 边缘检测相同, 比较的是梯度幅值 sqrt(gx * gx + gy * gy)
+    // 幅值大于高阈值的局部极大值为强边缘, 大于低阈值且与强边缘相连的为弱边缘
+    // edges 为 width * height 字节, 返回 false 表示被取消
+    static bool detect(const Gradient &gradient, int lowThreshold, int highThreshold, uchar *edges,
+                       const std::atomic<bool> *cancel = nullptr);
+};
+
+#endif // CANNYDETECTOR_H
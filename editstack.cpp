@@ -0,0 +1,232 @@
+﻿#include "editstack.h"
+
+EditStack::EditStack()
+{
+}
+
+void EditStack::reset(const QImage &image, qreal factor)
+{
+    base = ImageProcessor::toWorkingFormat(image);
+    baseHistogram = Histogram();
+    scale = factor;
+    entries.clear();
+    position = 0;
+    pinnedNode = -1;
+    ++version;
+}
+
+void EditStack::setBase(const QImage &image, qreal factor)
+{
+    base = ImageProcessor::toWorkingFormat(image);
+    baseHistogram = Histogram();
+    scale = factor;
+    invalidateFrom(1);
+    ++version;
+}
+
+void EditStack::clear()
+{
+    reset(QImage());
+}
+
+void EditStack::push(const ImageOperation &operation)
+{
+    if (!operation.isValid()) return;
+
+    entries.resize(position);
+    if (pinnedNode > position) {
+        pinnedNode = -1;
+    }
+    Entry entry;
+    entry.operation = operation;
+    entries.append(entry);
+    ++position;
+    // 新节点在需要时计算(通常由预览在后台重放), 前一个节点的缓存保证了撤销无需重算
+    ++version;
+}
+
+void EditStack::replace(int index, const ImageOperation &operation)
+{
+    if (index < 0 || index >= entries.size() || !operation.isValid()) return;
+
+    entries[index].operation = operation;
+    invalidateFrom(index + 1);
+    ++version;
+}
+
+bool EditStack::undo()
+{
+    if (!canUndo()) return false;
+    --position;
+    return true;
+}
+
+bool EditStack::redo()
+{
+    if (!canRedo()) return false;
+    ++position;
+    return true;
+}
+
+void EditStack::rewind()
+{
+    position = 0;
+}
+
+QVector<ImageOperation> EditStack::appliedOperations() const
+{
+    QVector<ImageOperation> operations;
+    operations.reserve(position);
+    for (int i = 0; i < position; ++i) {
+        operations.append(entries.at(i).operation);
+    }
+    return operations;
+}
+
+QImage EditStack::result() const
+{
+    return resultAt(position);
+}
+
+Histogram EditStack::histogram() const
+{
+    return position > 0 ? entries.at(position - 1).histogram : baseHistogram;
+}
+
+void EditStack::setHistogram(const Histogram &histogram)
+{
+    if (position > 0) {
+        entries[position - 1].histogram = histogram;
+    } else {
+        baseHistogram = histogram;
+    }
+}
+
+bool EditStack::histogramBase(QImage *previous, Histogram *previousHistogram, QRect *rect) const
+{
+    if (position <= 0 || base.isNull()) return false;
+
+    const int node = position - 1;
+    const QImage image = node > 0 ? entries.at(node - 1).cached : base;
+    const Histogram histogram = node > 0 ? entries.at(node - 1).histogram : baseHistogram;
+    if (image.isNull() || histogram.isEmpty()) return false;
+
+    // 全图操作重新统计与增量统计的开销相同
+    const QRect damage = ImageProcessor::damagedRect(entries.at(node).operation.scaled(scale), base.size());
+    if (damage == base.rect()) return false;
+
+    *previous = image;
+    *previousHistogram = histogram;
+    *rect = damage;
+    return true;
+}
+
+bool EditStack::isCached(int node) const
+{
+    if (node <= 0) return !base.isNull();
+    return node <= entries.size() && !entries.at(node - 1).cached.isNull();
+}
+
+EditStack::Replay EditStack::replayTo(int node) const
+{
+    Replay replay;
+    replay.node = qBound(0, node, int(entries.size()));
+    replay.version = version;
+    if (base.isNull()) return replay;
+
+    int start = replay.node;
+    while (start > 0 && entries.at(start - 1).cached.isNull()) {
+        --start;
+    }
+    replay.baseNode = start;
+    replay.base = start > 0 ? entries.at(start - 1).cached : base;
+    for (int i = start; i < replay.node; ++i) {
+        replay.chain.append(entries.at(i).operation.scaled(scale));
+    }
+    if (pinnedNode > start && pinnedNode < replay.node) {
+        replay.keepNode = pinnedNode;
+    }
+    return replay;
+}
+
+QImage EditStack::Replay::run(QImage *kept, const std::atomic<bool> *cancel) const
+{
+    if (keepNode < 0) return ImageProcessor::applyChain(base, chain, cancel);
+
+    // 分两段执行, 中间结果即修改中的步骤之前的节点
+    const int split = keepNode - baseNode;
+    const QImage middle = ImageProcessor::applyChain(base, chain.mid(0, split), cancel);
+    if (middle.isNull()) return QImage();
+    if (kept) {
+        *kept = middle;
+    }
+    return ImageProcessor::applyChain(middle, chain.mid(split), cancel);
+}
+
+void EditStack::store(const Replay &replay, const QImage &result, const QImage &kept)
+{
+    if (replay.version != version || replay.node > entries.size()) return;
+    if (replay.keepNode > 0 && !kept.isNull()) {
+        entries[replay.keepNode - 1].cached = kept;
+    }
+    if (replay.node > 0 && !result.isNull()) {
+        entries[replay.node - 1].cached = result;
+    }
+    evict();
+}
+
+void EditStack::setEditingStep(int index)
+{
+    pinnedNode = index >= 0 && index < entries.size() ? index : -1;
+    evict();
+}
+
+QImage EditStack::resultAt(int node) const
+{
+    if (node <= 0 || base.isNull()) return base;
+
+    // 找到最近的已缓存节点
+    int start = node;
+    while (start > 0 && entries.at(start - 1).cached.isNull()) {
+        --start;
+    }
+    if (start == node) return entries.at(node - 1).cached;
+
+    QImage image = start > 0 ? entries.at(start - 1).cached : base;
+    QVector<ImageOperation> chain;
+    for (int i = start; i < node; ++i) {
+        chain.append(entries.at(i).operation.scaled(scale));
+    }
+    image = ImageProcessor::applyChain(image, chain);
+    entries[node - 1].cached = image;
+    evict();
+    return image;
+}
+
+void EditStack::invalidateFrom(int node)
+{
+    for (int i = qMax(1, node); i <= entries.size(); ++i) {
+        entries[i - 1].cached = QImage();
+        entries[i - 1].histogram = Histogram();
+    }
+}
+
+void EditStack::evict() const
+{
+    for (;;) {
+        int cachedCount = 0;
+        int farthest = -1;
+        int farthestDistance = -1;
+        for (int i = 1; i <= entries.size(); ++i) {
+            if (entries.at(i - 1).cached.isNull() || i == pinnedNode) continue;
+            ++cachedCount;
+            const int distance = qAbs(i - position);
+            if (distance > farthestDistance) {
+                farthestDistance = distance;
+                farthest = i;
+            }
+        }
+        if (cachedCount <= MaxCachedNodes) return;
+        entries[farthest - 1].cached = QImage();
+    }
+}
@@ -0,0 +1,103 @@
+﻿#ifndef EDITSTACK_H
+#define EDITSTACK_H
+
+#include <QImage>
+#include <QVector>
+#include "histogram.h"
+#include "imageprocessor.h"
+
+// 非破坏性编辑栈: 按顺序记录操作及参数, 并缓存部分节点的中间结果
+// 节点 i 的结果为底图依次执行前 i 个操作; 节点 0 即底图本身, 始终保留
+// 撤销/重做只移动当前位置, 相邻节点通常已缓存, 无需重新计算
+// 修改某一步的参数只会使其后的缓存失效, 重新计算时从最近的已缓存节点开始
+// 界面线程用 replayTo 取得重放所需的数据, 在后台线程执行后用 store 保存结果
+class EditStack
+{
+public:
+    // 最多缓存的中间结果数量(不含底图), 超出时淘汰离当前位置最远的节点
+    static constexpr int MaxCachedNodes = 16;
+
+    EditStack();
+
+    // 设置底图并清空操作
+    void reset(const QImage &base, qreal scale = 1.0);
+    // 替换底图(例如代理图尺寸变化), 保留操作, 清空中间结果
+    // scale 为底图相对于操作参数所在分辨率的缩放比例
+    void setBase(const QImage &base, qreal scale);
+    void clear();
+
+    // 在当前位置之后追加操作, 丢弃可重做的部分
+    void push(const ImageOperation &operation);
+    // 修改第 index 步的参数
+    void replace(int index, const ImageOperation &operation);
+
+    bool canUndo() const { return position > 0; }
+    bool canRedo() const { return position < entries.size(); }
+    bool undo();
+    bool redo();
+    // 回到底图, 之后可以通过重做恢复
+    void rewind();
+
+    int count() const { return entries.size(); }
+    int currentPosition() const { return position; }
+    const ImageOperation &operationAt(int index) const { return entries.at(index).operation; }
+    // 当前位置之前的操作
+    QVector<ImageOperation> appliedOperations() const;
+
+    // 当前位置的结果, 未缓存时在调用线程计算
+    QImage result() const;
+    bool hasResult() const { return isCached(position); }
+
+    // 从最近的已缓存节点重放到 node 所需数据的快照, 可在后台线程执行
+    struct Replay
+    {
+        QImage base;                        // 节点 baseNode 的结果
+        int baseNode = 0;
+        QVector<ImageOperation> chain;      // baseNode 之后到 node 的操作, 已按底图缩放
+        int node = 0;
+        int keepNode = -1;                  // 途经时一并保留结果的节点(修改中的步骤之前), -1 表示没有
+        quint64 version = 0;
+
+        // 返回节点 node 的结果, keepNode 有效时其结果写入 kept
+        QImage run(QImage *kept, const std::atomic<bool> *cancel = nullptr) const;
+    };
+    Replay replayTo(int node) const;
+    Replay replay() const { return replayTo(position); }
+    // 保存后台重放的结果; 期间操作或底图已改变时忽略
+    void store(const Replay &replay, const QImage &result, const QImage &kept);
+
+    // 修改第 index 步期间保留其之前节点(节点 index)的结果, 不被淘汰, 重放从该节点开始; -1 取消
+    void setEditingStep(int index);
+
+    // 直方图按节点保存(不随中间结果淘汰), 撤销/重做回到已统计的节点时直接使用
+    // 当前位置的直方图, 未统计时为空
+    Histogram histogram() const;
+    void setHistogram(const Histogram &histogram);
+    // 当前操作是局部操作, 且上一节点已统计、结果已缓存时, 返回上一节点的结果与直方图
+    // 以及当前操作改变的区域, 只需重新统计该区域
+    bool histogramBase(QImage *previous, Histogram *previousHistogram, QRect *rect) const;
+
+private:
+    struct Entry
+    {
+        ImageOperation operation;
+        QImage cached;      // 执行该操作后的结果, 为空表示未缓存
+        Histogram histogram;    // 结果的直方图, 为空表示未统计
+    };
+
+    // 节点 node 的结果, 必要时从最近的已缓存节点开始计算
+    QImage resultAt(int node) const;
+    bool isCached(int node) const;
+    void invalidateFrom(int node);
+    void evict() const;
+
+    QImage base;
+    Histogram baseHistogram;
+    qreal scale = 1.0;
+    mutable QVector<Entry> entries;
+    int position = 0;
+    int pinnedNode = -1;
+    quint64 version = 0;        // 操作或底图每次改变都会增加, 用于识别过期的重放
+};
+
+#endif // EDITSTACK_H
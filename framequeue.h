@@ -0,0 +1,106 @@
+﻿#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// 单生产者单消费者的有界无锁队列, 用于在线程之间传递视频帧
+// 队列满时按策略丢弃: DropNewest 丢弃新来的帧, DropOldest 由生产者丢弃队首最旧的帧
+//
+// head 只由生产者推进; tail 由消费者出队推进, DropOldest 时生产者也会推进,
+// 双方都先读出槽位中的指针再用 CAS 推进 tail, 只有 CAS 成功的一方拥有该元素,
+// 槽位在 tail 越过它之前不会被生产者改写, 因此失败的一方读到的指针不会被使用
+template <typename T>
+class FrameQueue
+{
+public:
+    enum class DropPolicy {
+        DropOldest,
+        DropNewest
+    };
+
+    explicit FrameQueue(int capacity, DropPolicy policy = DropPolicy::DropOldest)
+        : slots(size_t(qMax(1, capacity))), dropPolicy(policy)
+    {
+        for (std::atomic<T *> &slot : slots) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~FrameQueue()
+    {
+        while (pop()) {
+        }
+    }
+
+    FrameQueue(const FrameQueue &) = delete;
+    FrameQueue &operator=(const FrameQueue &) = delete;
+
+    // 生产者调用; 返回 false 表示新元素被丢弃(DropNewest 且队列已满)
+    bool push(T value)
+    {
+        const quint64 h = head.load(std::memory_order_relaxed);
+        while (h - tail.load(std::memory_order_acquire) >= slots.size()) {
+            if (dropPolicy.load(std::memory_order_relaxed) == DropPolicy::DropNewest) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (std::unique_ptr<T> oldest = takeFront()) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        slots[h % slots.size()].store(new T(std::move(value)), std::memory_order_relaxed);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 消费者调用; 队列为空时返回 std::nullopt
+    std::optional<T> pop()
+    {
+        if (std::unique_ptr<T> item = takeFront()) {
+            return std::optional<T>(std::move(*item));
+        }
+        return std::nullopt;
+    }
+
+    int size() const
+    {
+        const quint64 t = tail.load(std::memory_order_acquire);
+        const quint64 h = head.load(std::memory_order_acquire);
+        return int(h - qMin(h, t));
+    }
+
+    int capacity() const { return int(slots.size()); }
+
+    DropPolicy policy() const { return dropPolicy.load(std::memory_order_relaxed); }
+    void setPolicy(DropPolicy policy) { dropPolicy.store(policy, std::memory_order_relaxed); }
+
+    // 累计丢弃的元素数
+    quint64 droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    // 取出队首元素, 生产者(丢弃最旧)与消费者都可调用
+    std::unique_ptr<T> takeFront()
+    {
+        quint64 t = tail.load(std::memory_order_acquire);
+        while (t != head.load(std::memory_order_acquire)) {
+            T *item = slots[t % slots.size()].load(std::memory_order_relaxed);
+            if (tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return std::unique_ptr<T>(item);
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<std::atomic<T *>> slots;
+    std::atomic<DropPolicy> dropPolicy;
+    alignas(64) std::atomic<quint64> head{0};
+    alignas(64) std::atomic<quint64> tail{0};
+    std::atomic<quint64> dropped{0};
+};
+
+#endif // FRAMEQUEUE_H
@@ -0,0 +1,166 @@
+﻿#include "frameschemehandler.h"
+#include "imageprocessor.h"
+#include "tracer.h"
+#include <QWebEngineUrlRequestJob>
+#include <QWebEngineUrlScheme>
+#include <QBuffer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QDebug>
+
+namespace {
+
+// 页面尚未读取的帧最多保留的数量, 页面跟不上时丢弃最旧的
+const int MaxRetainedFrames = 4;
+
+// 直接包装 QImage 内存的只读设备, 设备存活期间持有图像引用
+class ImageBuffer : public QBuffer
+{
+public:
+    explicit ImageBuffer(const QImage &image)
+        : frame(image)
+    {
+        setData(QByteArray::fromRawData(reinterpret_cast<const char *>(frame.constBits()),
+                                        frame.sizeInBytes()));
+        open(QIODevice::ReadOnly);
+    }
+
+private:
+    QImage frame;
+};
+
+// 设备不归 QWebEngine 所有, 请求结束后释放
+void replyWithDevice(QWebEngineUrlRequestJob *job, const QByteArray &contentType, QIODevice *device)
+{
+    QObject::connect(job, &QObject::destroyed, device, &QObject::deleteLater);
+    job->reply(contentType, device);
+}
+
+} // namespace
+
+const QByteArray FrameSchemeHandler::SchemeName = QByteArrayLiteral("qtframe");
+
+FrameSchemeHandler::FrameSchemeHandler(QObject *parent)
+    : QWebEngineUrlSchemeHandler(parent)
+{
+}
+
+FrameSchemeHandler::~FrameSchemeHandler()
+{
+}
+
+void FrameSchemeHandler::registerUrlScheme()
+{
+    QWebEngineUrlScheme scheme(SchemeName);
+    scheme.setSyntax(QWebEngineUrlScheme::Syntax::Host);
+    scheme.setDefaultPort(QWebEngineUrlScheme::PortUnspecified);
+    scheme.setFlags(QWebEngineUrlScheme::SecureScheme |
+                    QWebEngineUrlScheme::LocalAccessAllowed |
+                    QWebEngineUrlScheme::CorsEnabled |
+                    QWebEngineUrlScheme::FetchApiAllowed);
+    QWebEngineUrlScheme::registerScheme(scheme);
+}
+
+QUrl FrameSchemeHandler::viewerUrl()
+{
+    return QUrl(QString::fromLatin1(SchemeName) + "://canvas/viewer.html");
+}
+
+quint64 FrameSchemeHandler::publishFrame(const QImage &image)
+{
+    const quint64 frameId = nextFrameId++;
+    frames.insert(frameId, image);
+    while (frames.size() > MaxRetainedFrames) {
+        frames.erase(frames.begin());
+    }
+    return frameId;
+}
+
+void FrameSchemeHandler::setTileProvider(const TileProvider &provider)
+{
+    tileProvider = provider;
+}
+
+void FrameSchemeHandler::requestStarted(QWebEngineUrlRequestJob *job)
+{
+    const QUrl url = job->requestUrl();
+    const QStringList parts = url.path().split('/', Qt::SkipEmptyParts);
+
+    if (url.host() != "canvas" || parts.isEmpty()) {
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+        return;
+    }
+
+    if (parts.first() == "viewer.html") {
+        serveViewer(job);
+    } else if (parts.first() == "frames" && parts.size() == 2) {
+        serveFrame(job, parts.at(1).toULongLong());
+    } else if (parts.first() == "tiles" && parts.size() == 5) {
+        serveTile(job, parts);
+    } else if (parts.first() == "message" && parts.size() == 2 && job->requestMethod() == "POST") {
+        receiveMessage(job, parts.at(1));
+    } else {
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+    }
+}
+
+void FrameSchemeHandler::serveViewer(QWebEngineUrlRequestJob *job)
+{
+    // 从资源文件加载HTML
+    QFile htmlFile(":/html/canvas_viewer.html");
+    if (!htmlFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "无法打开HTML资源文件";
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+        return;
+    }
+
+    QBuffer *buffer = new QBuffer;
+    buffer->setData(htmlFile.readAll());
+    buffer->open(QIODevice::ReadOnly);
+    replyWithDevice(job, "text/html", buffer);
+}
+
+void FrameSchemeHandler::serveFrame(QWebEngineUrlRequestJob *job, quint64 frameId)
+{
+    TRACE_SCOPE("canvas", "frame.serve");
+    const QImage frame = frames.take(frameId);
+    if (frame.isNull()) {
+        // 帧已被更新的帧替换, 页面会忽略这次请求
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+        return;
+    }
+    replyWithDevice(job, "application/octet-stream", new ImageBuffer(frame));
+}
+
+void FrameSchemeHandler::serveTile(QWebEngineUrlRequestJob *job, const QStringList &parts)
+{
+    TRACE_SCOPE("canvas", "tile.serve");
+    const QImage tile = tileProvider
+        ? tileProvider(parts.at(1).toULongLong(), parts.at(2).toInt(), parts.at(3).toInt(), parts.at(4).toInt())
+        : QImage();
+    if (tile.isNull()) {
+        // 图像或操作已经改变, 页面会按新版本重新请求
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+        return;
+    }
+    replyWithDevice(job, "application/octet-stream", new ImageBuffer(ImageProcessor::toWorkingFormat(tile)));
+}
+
+void FrameSchemeHandler::receiveMessage(QWebEngineUrlRequestJob *job, const QString &name)
+{
+    TRACE_SCOPE("canvas", "frame.message");
+    QIODevice *body = job->requestBody();
+    QJsonParseError error;
+    const QJsonDocument json = QJsonDocument::fromJson(body ? body->readAll() : QByteArray(), &error);
+    if (error.error != QJsonParseError::NoError || !json.isObject()) {
+        qWarning() << "页面消息无效" << name << error.errorString();
+        job->fail(QWebEngineUrlRequestJob::RequestFailed);
+        return;
+    }
+
+    QBuffer *reply = new QBuffer;
+    reply->open(QIODevice::ReadOnly);
+    replyWithDevice(job, "text/plain", reply);
+
+    emit messageReceived(name, json.object());
+}
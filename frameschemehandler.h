@@ -0,0 +1,62 @@
+﻿#ifndef FRAMESCHEMEHANDLER_H
+#define FRAMESCHEMEHANDLER_H
+
+#include <QWebEngineUrlSchemeHandler>
+#include <QImage>
+#include <QJsonObject>
+#include <QMap>
+#include <QUrl>
+#include <functional>
+
+class QWebEngineUrlRequestJob;
+
+// qtframe:// 协议处理器: MainWindow 与画布页面之间的二进制帧通道
+//   qtframe://canvas/viewer.html        画布页面
+//   qtframe://canvas/frames/<id>        GET, 已发布帧的原始 RGBA8888 数据
+//   qtframe://canvas/tiles/<revision>/<level>/<x>/<y>
+//                                       GET, 金字塔某层上一个分块的 RGBA8888 数据
+//   qtframe://canvas/message/<name>     POST, 页面发来的 JSON 消息
+// 帧数据直接以 QImage 的内存提供给页面, 不经过 PNG 编码和 Base64
+class FrameSchemeHandler : public QWebEngineUrlSchemeHandler
+{
+    Q_OBJECT
+
+public:
+    explicit FrameSchemeHandler(QObject *parent = nullptr);
+    ~FrameSchemeHandler();
+
+    static const QByteArray SchemeName;
+
+    // 注册协议, 必须在创建 QApplication 之前调用
+    static void registerUrlScheme();
+
+    // 画布页面地址
+    static QUrl viewerUrl();
+
+    // 发布一帧供页面读取, 返回帧序号; 图像需为 RGBA8888 格式
+    // 每帧只读取一次, 读取后处理器不再持有图像, 调用方之后修改自己的副本时不必整帧复制
+    quint64 publishFrame(const QImage &image);
+
+    // 分块由提供者在请求时生成, 版本已过期或分块不可用时返回空图像
+    using TileProvider = std::function<QImage(quint64 revision, int level, int column, int row)>;
+    void setTileProvider(const TileProvider &provider);
+
+    void requestStarted(QWebEngineUrlRequestJob *job) override;
+
+signals:
+    // 页面发来了消息
+    void messageReceived(const QString &name, const QJsonObject &message);
+
+private:
+    void serveViewer(QWebEngineUrlRequestJob *job);
+    void serveFrame(QWebEngineUrlRequestJob *job, quint64 frameId);
+    void serveTile(QWebEngineUrlRequestJob *job, const QStringList &parts);
+    void receiveMessage(QWebEngineUrlRequestJob *job, const QString &name);
+
+    // 最近发布而页面尚未读取的帧; 读取时移出, 传输期间由应答设备持有
+    QMap<quint64, QImage> frames;
+    quint64 nextFrameId = 1;
+    TileProvider tileProvider;
+};
+
+#endif // FRAMESCHEMEHANDLER_H
@@ -0,0 +1,123 @@
+﻿#include "histogram.h"
+#include "imageprocessor.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+#include <QMutex>
+#include <algorithm>
+
+quint32 Histogram::maxCount(Channel channel) const
+{
+    return *std::max_element(bins[channel].begin(), bins[channel].end());
+}
+
+quint64 Histogram::lumaAtMost(int value) const
+{
+    if (value < 0) return 0;
+    return lumaCumulative[qMin(value, 255)];
+}
+
+int Histogram::otsuThreshold() const
+{
+    if (total == 0) return 128;
+
+    double sumAll = 0;
+    for (int i = 0; i < 256; ++i) {
+        sumAll += double(i) * bins[Luma][i];
+    }
+
+    // 类间方差 w0 * w1 * (m0 - m1)^2, 逐个阈值累加前缀和
+    double sumBelow = 0;
+    double bestVariance = -1;
+    int best = 128;
+    for (int t = 0; t < 255; ++t) {
+        sumBelow += double(t) * bins[Luma][t];
+        const double below = double(lumaCumulative[t]);
+        const double above = double(total) - below;
+        if (below == 0) continue;
+        if (above == 0) break;
+
+        const double meanDiff = sumBelow / below - (sumAll - sumBelow) / above;
+        const double variance = below * above * meanDiff * meanDiff;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            best = t;
+        }
+    }
+    return best;
+}
+
+Histogram Histogram::compute(const QImage &image, const std::atomic<bool> *cancel)
+{
+    return compute(image, image.rect(), cancel);
+}
+
+Histogram Histogram::compute(const QImage &image, const QRect &rect, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "histogram");
+    Histogram histogram;
+    const QImage input = ImageProcessor::toWorkingFormat(image);
+    const QRect area = rect & input.rect();
+    if (input.isNull() || area.isEmpty()) return histogram;
+
+    const uchar *bits = input.constBits();
+    const qsizetype stride = input.bytesPerLine();
+    QMutex mutex;
+
+    // 每个条带先统计到局部直方图, 最后合并一次; 条带约 64K 像素, 合并开销可忽略
+    const int rows = qMax(1, 65536 / area.width());
+    const bool finished = TileScheduler::run(area, QSize(area.width(), rows), [&](const QRect &tile) {
+        std::array<std::array<quint32, 256>, ChannelCount> local{};
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            const uchar *p = bits + y * stride + tile.left() * 4;
+            for (int x = 0; x < tile.width(); ++x, p += 4) {
+                ++local[Red][p[0]];
+                ++local[Green][p[1]];
+                ++local[Blue][p[2]];
+                ++local[Luma][(p[0] + p[1] + p[2] + 1) / 3];
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int channel = 0; channel < ChannelCount; ++channel) {
+            for (int i = 0; i < 256; ++i) {
+                histogram.bins[channel][i] += local[channel][i];
+            }
+        }
+    }, cancel);
+    if (!finished) return Histogram();
+
+    histogram.updateCumulative();
+    return histogram;
+}
+
+Histogram Histogram::updated(const Histogram &histogram, const QImage &before, const QImage &after,
+                             const QRect &rect, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "histogramUpdate");
+    if (before.size() != after.size()) return compute(after, cancel);
+
+    const Histogram removed = compute(before, rect, cancel);
+    const Histogram added = compute(after, rect, cancel);
+    if (cancel && cancel->load(std::memory_order_relaxed)) return Histogram();
+
+    // 区域内每个像素在两次统计中各计一次, 差值加到原直方图上不会出现负数
+    Histogram result = histogram;
+    for (int channel = 0; channel < ChannelCount; ++channel) {
+        for (int i = 0; i < 256; ++i) {
+            result.bins[channel][i] += added.bins[channel][i];
+            result.bins[channel][i] -= removed.bins[channel][i];
+        }
+    }
+    result.updateCumulative();
+    return result;
+}
+
+void Histogram::updateCumulative()
+{
+    quint64 sum = 0;
+    for (int i = 0; i < 256; ++i) {
+        sum += bins[Luma][i];
+        lumaCumulative[i] = sum;
+    }
+    total = sum;
+}
@@ -0,0 +1,50 @@
+﻿#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QImage>
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+
+// 图像直方图: R、G、B 三个通道, 以及与灰度化、二值化相同的灰度 (R + G + B) / 3
+// 计算一次后可在 O(256) 内得到 Otsu 阈值, 任意灰度区间的像素数为 O(1)
+class Histogram
+{
+public:
+    enum Channel {
+        Red,
+        Green,
+        Blue,
+        Luma,
+        ChannelCount
+    };
+
+    bool isEmpty() const { return total == 0; }
+    quint64 pixelCount() const { return total; }
+    quint32 count(Channel channel, int value) const { return bins[channel][value]; }
+    quint32 maxCount(Channel channel) const;
+    // 灰度不大于 value 的像素数
+    quint64 lumaAtMost(int value) const;
+
+    // Otsu 阈值: 使灰度不大于阈值与大于阈值两类之间的方差最大
+    // 与二值化的判定(灰度大于阈值为白色)一致, 直方图为空或只有一种灰度时返回 128
+    int otsuThreshold() const;
+
+    // 分条带并行统计, 被取消时返回空直方图
+    static Histogram compute(const QImage &image, const std::atomic<bool> *cancel = nullptr);
+    // 只统计 rect 内的像素
+    static Histogram compute(const QImage &image, const QRect &rect, const std::atomic<bool> *cancel = nullptr);
+    // 图像由 before 变为 after 且只有 rect 内的像素改变时, 由 before 的直方图得到 after 的直方图
+    // 只需统计 rect 内的像素; 被取消时返回空直方图
+    static Histogram updated(const Histogram &histogram, const QImage &before, const QImage &after,
+                             const QRect &rect, const std::atomic<bool> *cancel = nullptr);
+
+private:
+    void updateCumulative();
+
+    std::array<std::array<quint32, 256>, ChannelCount> bins{};
+    std::array<quint64, 256> lumaCumulative{};
+    quint64 total = 0;
+};
+
+#endif // HISTOGRAM_H
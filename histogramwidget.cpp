@@ -0,0 +1,88 @@
+﻿#include "histogramwidget.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <cmath>
+
+HistogramWidget::HistogramWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+}
+
+void HistogramWidget::setHistogram(const Histogram &newHistogram)
+{
+    histogram = newHistogram;
+    update();
+}
+
+void HistogramWidget::clear()
+{
+    histogram = Histogram();
+    update();
+}
+
+void HistogramWidget::setThreshold(int newThreshold)
+{
+    if (threshold == newThreshold) return;
+    threshold = newThreshold;
+    update();
+}
+
+QSize HistogramWidget::sizeHint() const
+{
+    return QSize(256, 120);
+}
+
+QSize HistogramWidget::minimumSizeHint() const
+{
+    return QSize(128, 80);
+}
+
+void HistogramWidget::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    const QRectF area = QRectF(rect()).adjusted(1, 1, -1, -1);
+    painter.fillRect(rect(), QColor(32, 32, 32));
+    if (histogram.isEmpty()) return;
+
+    // 纵轴取平方根, 避免单个尖峰把其余部分压扁
+    const double lumaMax = std::sqrt(double(histogram.maxCount(Histogram::Luma)));
+    auto xAt = [&](int value) { return area.left() + area.width() * (value + 0.5) / 256.0; };
+    auto yAt = [&](quint32 count, double maxValue) {
+        return area.bottom() - (maxValue > 0 ? area.height() * std::sqrt(double(count)) / maxValue : 0.0);
+    };
+
+    // 灰度: 阈值两侧分别以二值化后的颜色着色
+    for (int i = 0; i < 256; ++i) {
+        const double top = yAt(histogram.count(Histogram::Luma, i), lumaMax);
+        QColor color(150, 150, 150);
+        if (threshold >= 0) {
+            color = i > threshold ? QColor(220, 220, 220) : QColor(90, 90, 90);
+        }
+        painter.fillRect(QRectF(area.left() + area.width() * i / 256.0, top,
+                                area.width() / 256.0 + 0.5, area.bottom() - top), color);
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing);
+    const struct { Histogram::Channel channel; QColor color; } curves[] = {
+        { Histogram::Red, QColor(230, 70, 70, 200) },
+        { Histogram::Green, QColor(70, 200, 70, 200) },
+        { Histogram::Blue, QColor(80, 120, 240, 200) },
+    };
+    for (const auto &curve : curves) {
+        const double maxValue = std::sqrt(double(histogram.maxCount(curve.channel)));
+        QPainterPath path;
+        path.moveTo(xAt(0), yAt(histogram.count(curve.channel, 0), maxValue));
+        for (int i = 1; i < 256; ++i) {
+            path.lineTo(xAt(i), yAt(histogram.count(curve.channel, i), maxValue));
+        }
+        painter.setPen(QPen(curve.color, 1));
+        painter.drawPath(path);
+    }
+
+    if (threshold >= 0) {
+        const double x = area.left() + area.width() * (threshold + 1) / 256.0;
+        painter.setPen(QPen(QColor(255, 200, 0), 1.5));
+        painter.drawLine(QPointF(x, area.top()), QPointF(x, area.bottom()));
+    }
+}
@@ -0,0 +1,32 @@
+﻿#ifndef HISTOGRAMWIDGET_H
+#define HISTOGRAMWIDGET_H
+
+#include <QWidget>
+#include "histogram.h"
+
+// 直方图显示: 灰度为填充区域, R、G、B 为曲线, 阈值处画竖线并把两侧分别着色
+// 阈值变化只重绘, 不重新统计; 直方图只在图像变化时由调用方更新
+class HistogramWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit HistogramWidget(QWidget *parent = nullptr);
+
+    void setHistogram(const Histogram &histogram);
+    void clear();
+    // 阈值竖线, -1 表示不显示
+    void setThreshold(int threshold);
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    Histogram histogram;
+    int threshold = -1;
+};
+
+#endif // HISTOGRAMWIDGET_H
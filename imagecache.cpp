@@ -0,0 +1,90 @@
+﻿#include "imagecache.h"
+#include "imageprocessor.h"
+#include "tiledimagestore.h"
+#include <QImageReader>
+#include <QtConcurrent/QtConcurrentRun>
+
+ImageCache::ImageCache(qint64 byteBudget, QObject *parent)
+    : QObject(parent)
+    , cache(byteBudget)
+{
+    // 预取只需一两张, 少量线程即可, 不与预览计算争抢
+    pool.setMaxThreadCount(2);
+}
+
+ImageCache::~ImageCache()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+QImage ImageCache::load(const QString &path)
+{
+    if (const QImage *image = cache.object(path)) {
+        ++hitCount;
+        emit statisticsChanged();
+        return *image;
+    }
+
+    ++missCount;
+    QImage image;
+    const auto it = inFlight.constFind(path);
+    if (it != inFlight.constEnd()) {
+        // 预取中, 等待后台结果而不是重新解码
+        image = it.value().result();
+    } else {
+        image = decode(path);
+    }
+    inFlight.remove(path);
+    insert(path, image);
+    emit statisticsChanged();
+    return image;
+}
+
+void ImageCache::prefetch(const QStringList &paths)
+{
+    for (const QString &path : paths) {
+        if (path.isEmpty() || cache.contains(path) || inFlight.contains(path)) continue;
+
+        QFuture<QImage> future = QtConcurrent::run(&pool, &ImageCache::decode, path);
+        inFlight.insert(path, future);
+        future.then(this, [this, path](const QImage &image) {
+            // 期间已被 load 取走或已移除
+            if (!inFlight.contains(path)) return;
+            inFlight.remove(path);
+            insert(path, image);
+            emit statisticsChanged();
+        });
+    }
+}
+
+void ImageCache::remove(const QString &path)
+{
+    cache.remove(path);
+    inFlight.remove(path);
+    emit statisticsChanged();
+}
+
+void ImageCache::clear()
+{
+    cache.clear();
+    inFlight.clear();
+    emit statisticsChanged();
+}
+
+QImage ImageCache::decode(const QString &path)
+{
+    // 超大图片由 TiledImageStore 按需解码, 预取时跳过
+    if (TiledImageStore::isLargeImage(path)) return QImage();
+
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    return ImageProcessor::toWorkingFormat(reader.read());
+}
+
+void ImageCache::insert(const QString &path, const QImage &image)
+{
+    // 超过总容量的图像不缓存
+    if (image.isNull() || image.sizeInBytes() > cache.maxCost()) return;
+    cache.insert(path, new QImage(image), image.sizeInBytes());
+}
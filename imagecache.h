@@ -0,0 +1,52 @@
+﻿#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QFuture>
+#include <QHash>
+#include <QImage>
+#include <QStringList>
+#include <QThreadPool>
+
+// 已解码图像的 LRU 缓存, 按字节数限制容量, 由 ImageList 与 MainWindow 共用
+// 图像统一解码为处理引擎的工作格式, 取出后无需再转换
+// prefetch 在后台线程预先解码相邻图片, load 遇到正在预取的图片时直接等待其结果
+class ImageCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageCache(qint64 byteBudget, QObject *parent = nullptr);
+    ~ImageCache();
+
+    // 取出图像, 未缓存时同步解码; 解码失败返回空图像
+    QImage load(const QString &path);
+    // 在后台解码并缓存, 已缓存或正在解码的路径会被跳过
+    void prefetch(const QStringList &paths);
+    // 移除指定路径, 文件被删除或修改时调用
+    void remove(const QString &path);
+    void clear();
+
+    // 统计信息
+    quint64 hits() const { return hitCount; }
+    quint64 misses() const { return missCount; }
+    qint64 residentBytes() const { return cache.totalCost(); }
+    qint64 byteBudget() const { return cache.maxCost(); }
+    int count() const { return cache.count(); }
+
+signals:
+    void statisticsChanged();
+
+private:
+    static QImage decode(const QString &path);
+    void insert(const QString &path, const QImage &image);
+
+    QCache<QString, QImage> cache;
+    QHash<QString, QFuture<QImage>> inFlight;
+    QThreadPool pool;
+    quint64 hitCount = 0;
+    quint64 missCount = 0;
+};
+
+#endif // IMAGECACHE_H
@@ -0,0 +1,371 @@
+﻿#include "imagedocument.h"
+#include <cmath>
+
+ImageDocument::ImageDocument()
+{
+}
+
+void ImageDocument::setImage(const QImage &image)
+{
+    master = ImageProcessor::toWorkingFormat(image);
+    tiled.reset();
+    overview = QImage();
+    levels.reset();
+    ++currentRevision;
+    active = ImageOperation();
+    history.clear();
+    rebuildProxy();
+}
+
+void ImageDocument::setTiledImage(const std::shared_ptr<TiledImageStore> &store)
+{
+    master = QImage();
+    tiled = store;
+    overview = store ? store->overview(QSize(OverviewSize, OverviewSize)) : QImage();
+    if (overview.isNull()) {
+        tiled.reset();
+    }
+    levels.reset();
+    ++currentRevision;
+    active = ImageOperation();
+    history.clear();
+    rebuildProxy();
+}
+
+void ImageDocument::clear()
+{
+    master = QImage();
+    tiled.reset();
+    overview = QImage();
+    levels.reset();
+    processedLevel = QImage();
+    ++currentRevision;
+    proxy = QImage();
+    history.clear();
+    active = ImageOperation();
+}
+
+bool ImageDocument::isNull() const
+{
+    return master.isNull() && !tiled;
+}
+
+void ImageDocument::setProxySize(const QSize &size)
+{
+    if (size == proxySize) return;
+    proxySize = size;
+    rebuildProxy();
+}
+
+void ImageDocument::setPyramid(const std::shared_ptr<const ImagePyramid> &pyramid)
+{
+    levels = pyramid;
+    ++currentRevision;
+}
+
+const std::shared_ptr<const ImagePyramid> &ImageDocument::pyramid() const
+{
+    return levels;
+}
+
+quint64 ImageDocument::revision() const
+{
+    return currentRevision;
+}
+
+const QImage &ImageDocument::masterImage() const
+{
+    return master;
+}
+
+QSize ImageDocument::imageSize() const
+{
+    return tiled ? tiled->size() : master.size();
+}
+
+QVector<ImageOperation> ImageDocument::operations() const
+{
+    return history.appliedOperations();
+}
+
+const ImageOperation &ImageDocument::activeOperation() const
+{
+    return active;
+}
+
+void ImageDocument::setActiveOperation(const ImageOperation &operation)
+{
+    active = operation;
+    ++currentRevision;
+}
+
+void ImageDocument::commitOperation(const ImageOperation &operation)
+{
+    if (isNull()) return;
+
+    // 当前操作已在显示结果中, 提交后只有新操作改变显示
+    commitActiveOperation();
+    history.push(operation);
+    proxyDamage = proxyDamageOf(operation);
+    ++currentRevision;
+}
+
+void ImageDocument::commitActiveOperation()
+{
+    if (isNull() || !active.isValid()) return;
+
+    history.push(active);
+    active = ImageOperation();
+}
+
+void ImageDocument::replaceOperation(int index, const ImageOperation &operation)
+{
+    history.replace(index, operation);
+    // 之后的步骤都要重新计算, 整张代理图都可能改变
+    proxyDamage = QRect(QPoint(0, 0), proxy.size());
+    ++currentRevision;
+}
+
+bool ImageDocument::canUndo() const
+{
+    return active.isValid() || history.canUndo();
+}
+
+bool ImageDocument::canRedo() const
+{
+    return !active.isValid() && history.canRedo();
+}
+
+bool ImageDocument::undo()
+{
+    if (active.isValid()) {
+        ++currentRevision;
+        proxyDamage = proxyDamageOf(active);
+        active = ImageOperation();
+        return true;
+    }
+    if (!history.undo()) return false;
+    ++currentRevision;
+    proxyDamage = proxyDamageOf(history.operationAt(history.currentPosition()));
+    return true;
+}
+
+bool ImageDocument::redo()
+{
+    if (active.isValid()) return false;
+    ++currentRevision;
+    if (!history.redo()) return false;
+    proxyDamage = proxyDamageOf(history.operationAt(history.currentPosition() - 1));
+    return true;
+}
+
+void ImageDocument::revertToOriginal()
+{
+    active = ImageOperation();
+    history.rewind();
+    ++currentRevision;
+}
+
+QImage ImageDocument::proxyImage() const
+{
+    return history.result();
+}
+
+bool ImageDocument::hasProxyImage() const
+{
+    return history.hasResult();
+}
+
+EditStack::Replay ImageDocument::proxyReplay() const
+{
+    return history.replay();
+}
+
+void ImageDocument::storeProxyReplay(const EditStack::Replay &replay, const QImage &result, const QImage &kept)
+{
+    history.store(replay, result, kept);
+}
+
+void ImageDocument::setEditingStep(int index)
+{
+    history.setEditingStep(index);
+}
+
+Histogram ImageDocument::proxyHistogram() const
+{
+    return history.histogram();
+}
+
+void ImageDocument::setProxyHistogram(const Histogram &histogram)
+{
+    history.setHistogram(histogram);
+}
+
+bool ImageDocument::proxyHistogramBase(QImage *previous, Histogram *previousHistogram, QRect *rect) const
+{
+    return history.histogramBase(previous, previousHistogram, rect);
+}
+
+ImageOperation ImageDocument::activeProxyOperation() const
+{
+    return active.scaled(proxyScale());
+}
+
+QVector<ImageOperation> ImageDocument::currentChain() const
+{
+    QVector<ImageOperation> chain = history.appliedOperations();
+    if (active.isValid()) {
+        chain.append(active);
+    }
+    return chain;
+}
+
+QImage ImageDocument::renderTile(int level, int column, int row) const
+{
+    if (!levels || level < 0 || level >= levels->levelCount()) return QImage();
+    const QRect levelRect(QPoint(0, 0), levels->levelSize(level));
+    const int tileSize = ImagePyramid::TileSize;
+    const QRect tile = QRect(column * tileSize, row * tileSize, tileSize, tileSize) & levelRect;
+    if (tile.isEmpty()) return QImage();
+
+    const QVector<ImageOperation> chain = levelChain(level);
+    if (chain.isEmpty()) return levels->region(level, tile);
+
+    // 只读取有限邻域的操作链: 分块加上邻域单独计算
+    if (TiledImageStore::canStream(chain)) {
+        int halo = 0;
+        for (const ImageOperation &operation : std::as_const(chain)) {
+            halo += ImageProcessor::neighbourhoodRadius(operation);
+        }
+        const QRect area = tile.adjusted(-halo, -halo, halo, halo) & levelRect;
+        const QImage result = ImageProcessor::applyChain(levels->region(level, area), chain);
+        return result.copy(tile.translated(-area.topLeft()));
+    }
+
+    // 马赛克与 Canny 在后台对整层执行一次, 同一版本的分块直接裁剪
+    if (processedRevision != currentRevision || processedLevel.isNull()) return QImage();
+    if (processedLevelIndex == level) return processedLevel.copy(tile);
+
+    // 整层结果尚未算好: 同一版本已算好的较低一层放大代替, 只处理分块覆盖的区域
+    if (processedLevelIndex < level) return QImage();
+    const qreal factorX = qreal(processedLevel.width()) / levelRect.width();
+    const qreal factorY = qreal(processedLevel.height()) / levelRect.height();
+    const QRect source = QRect(QPoint(int(std::floor(tile.left() * factorX)), int(std::floor(tile.top() * factorY))),
+                               QPoint(int(std::ceil((tile.right() + 1) * factorX)) - 1,
+                                      int(std::ceil((tile.bottom() + 1) * factorY)) - 1))
+                         & processedLevel.rect();
+    if (source.isEmpty()) return QImage();
+    return processedLevel.copy(source).scaled(tile.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+QVector<ImageOperation> ImageDocument::levelChain(int level) const
+{
+    QVector<ImageOperation> chain = currentChain();
+    const qreal scale = levels->levelScale(level);
+    for (ImageOperation &operation : chain) {
+        operation = operation.scaled(scale);
+    }
+    return chain;
+}
+
+ImageDocument::LevelJob ImageDocument::wholeLevelJob(int level) const
+{
+    LevelJob job;
+    if (!levels || level < 0 || level >= levels->levelCount()) return job;
+    if (processedRevision == currentRevision && processedLevelIndex == level && !processedLevel.isNull()) return job;
+
+    const QVector<ImageOperation> chain = levelChain(level);
+    if (chain.isEmpty() || TiledImageStore::canStream(chain)) return job;
+    const QSize size = levels->levelSize(level);
+    if (qint64(size.width()) * size.height() > MaxWholeLevelPixels) return job;
+
+    job.levels = levels;
+    job.level = level;
+    job.revision = currentRevision;
+    job.chain = chain;
+    return job;
+}
+
+QImage ImageDocument::LevelJob::render(const std::atomic<bool> *cancel) const
+{
+    const QImage levelImage = levels ? levels->levelImage(level) : QImage();
+    if (levelImage.isNull()) return QImage();
+    return ImageProcessor::applyChain(levelImage, chain, cancel);
+}
+
+void ImageDocument::setProcessedLevel(quint64 revision, int level, const QImage &image)
+{
+    if (revision != currentRevision || image.isNull()) return;
+    processedLevel = image;
+    processedLevelIndex = level;
+    processedRevision = revision;
+}
+
+ImageDocument::FullResolutionJob ImageDocument::fullResolutionJob() const
+{
+    FullResolutionJob job;
+    if (isNull()) return job;
+    job.master = master;
+    job.tiled = tiled;
+    job.chain = currentChain();
+    return job;
+}
+
+QImage ImageDocument::FullResolutionJob::render(const std::atomic<bool> *cancel) const
+{
+    if (isNull()) return QImage();
+    if (!tiled) {
+        return ImageProcessor::applyChain(master, chain, cancel);
+    }
+
+    // 分块存储的原图按带流式处理, 结果也在内存映射文件中
+    // 马赛克与 Canny 需要整幅图像, 只能在映射的原图上整体执行
+    // 分块中只有像素, 元数据由存储单独保存, 最后补回结果
+    QImage result;
+    if (TiledImageStore::canStream(chain)) {
+        result = tiled->applyChain(chain, cancel);
+    } else {
+        const QImage mapped = tiled->mappedImage(cancel);
+        if (mapped.isNull()) return QImage();
+        result = ImageProcessor::applyChain(mapped, chain, cancel);
+    }
+    tiled->copyMetadata(result);
+    return result;
+}
+
+QRect ImageDocument::proxyDamageOf(const ImageOperation &operation) const
+{
+    return ImageProcessor::damagedRect(operation.scaled(proxyScale()), proxy.size());
+}
+
+qreal ImageDocument::proxyScale() const
+{
+    if (isNull() || proxy.isNull()) return 1.0;
+    return qreal(proxy.width()) / imageSize().width();
+}
+
+void ImageDocument::rebuildProxy()
+{
+    if (isNull()) {
+        proxy = QImage();
+        history.setBase(QImage(), 1.0);
+        return;
+    }
+
+    // 只缩小不放大; 尺寸未知时直接使用主图(分块存储时为概览图)
+    // 有金字塔时从不小于显示尺寸的最小一层缩放
+    QImage source = tiled ? overview : master;
+    if (levels && !proxySize.isEmpty()) {
+        const QImage level = levels->levelImage(levels->levelFor(proxySize));
+        if (!level.isNull()) {
+            source = level;
+        }
+    }
+    proxy = source;
+    if (!proxySize.isEmpty() &&
+        (source.width() > proxySize.width() || source.height() > proxySize.height())) {
+        proxy = ImageProcessor::toWorkingFormat(
+            source.scaled(proxySize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
+    history.setBase(proxy, proxyScale());
+}
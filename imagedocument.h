@@ -0,0 +1,147 @@
+﻿#ifndef IMAGEDOCUMENT_H
+#define IMAGEDOCUMENT_H
+
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <memory>
+#include "editstack.h"
+#include "imagepyramid.h"
+#include "imageprocessor.h"
+#include "tiledimagestore.h"
+
+// 当前编辑的图像: 全分辨率主图 + 显示尺寸的代理图
+// 交互预览只在代理图上计算, 保存时在主图上重放同一操作链
+// 已提交的操作保存在编辑栈中, 支持撤销/重做和修改之前步骤的参数
+// 超大图像的主图保存在分块存储中, 代理图来自缩小的全图, 保存时按带流式重放
+// 缩放和平移时画布按分块请求金字塔某一层上的结果, 只计算屏幕上可见的部分
+class ImageDocument
+{
+public:
+    ImageDocument();
+
+    void setImage(const QImage &image);
+    void setTiledImage(const std::shared_ptr<TiledImageStore> &store);
+    void clear();
+    bool isNull() const;
+
+    // 代理图的最大尺寸(画布显示区域), 尺寸变化时重建代理图
+    // 有金字塔时从不小于该尺寸的最小一层缩放, 开销与显示尺寸有关而与原图尺寸无关
+    void setProxySize(const QSize &size);
+
+    // 后台为当前原图建立的金字塔, 更换图像时清除
+    void setPyramid(const std::shared_ptr<const ImagePyramid> &pyramid);
+    const std::shared_ptr<const ImagePyramid> &pyramid() const;
+    // 图像或操作链每次变化都会增加, 用于识别过期的显示分块
+    quint64 revision() const;
+    // 金字塔第 level 层上 (column, row) 分块的显示结果: 在该层的区域上执行按层缩放的操作链
+    // 操作链需要整幅图像(马赛克与 Canny)时从 setProcessedLevel 保存的整层结果裁剪; 该层尚未算好时
+    // 用同一版本已算好的较低一层放大代替, 都没有时返回空图像. 开销只与分块大小有关
+    QImage renderTile(int level, int column, int row) const;
+
+    // 整层执行操作链所需数据的快照: 在界面线程获取, 交给后台线程执行
+    struct LevelJob
+    {
+        std::shared_ptr<const ImagePyramid> levels;
+        int level = -1;
+        quint64 revision = 0;
+        QVector<ImageOperation> chain;     // 已按层缩放
+
+        bool isNull() const { return !levels; }
+        QImage render(const std::atomic<bool> *cancel = nullptr) const;
+    };
+    // renderTile 在第 level 层需要而尚未算好的整层结果; 不需要整层、已算好或层超过 MaxWholeLevelPixels 时为空
+    LevelJob wholeLevelJob(int level) const;
+    // 保存整层结果, 版本已过期时忽略
+    void setProcessedLevel(quint64 revision, int level, const QImage &image);
+
+    // 分块存储的图像没有内存中的主图, 此时 masterImage 为空
+    const QImage &masterImage() const;
+    QSize imageSize() const;
+
+    // 已提交且未被撤销的操作链
+    QVector<ImageOperation> operations() const;
+    // 当前正在调整的操作, 参数变化时整体替换
+    const ImageOperation &activeOperation() const;
+    void setActiveOperation(const ImageOperation &operation);
+
+    // 提交操作: 先提交当前操作, 再追加新操作
+    void commitOperation(const ImageOperation &operation);
+    void commitActiveOperation();
+    // 修改第 index 个已提交操作的参数
+    void replaceOperation(int index, const ImageOperation &operation);
+
+    // 撤销: 有正在调整的操作时先放弃它, 否则撤销上一个已提交操作
+    bool canUndo() const;
+    bool canRedo() const;
+    bool undo();
+    bool redo();
+    // 回到原图, 可以通过重做恢复
+    void revertToOriginal();
+
+    // 最近一次 commitOperation / undo / redo 使显示结果(代理图 + 当前操作)改变的区域,
+    // 以代理图坐标表示; 局部操作(马赛克)只是落笔覆盖的块, 显示端可以只更新这一部分
+    QRect lastProxyDamage() const { return proxyDamage; }
+
+    // 代理图应用已提交操作后的结果, 预览在此基础上计算当前操作
+    // 未缓存时在调用线程重放; 界面上用 proxyReplay 交给预览在后台计算
+    QImage proxyImage() const;
+    bool hasProxyImage() const;
+    EditStack::Replay proxyReplay() const;
+    void storeProxyReplay(const EditStack::Replay &replay, const QImage &result, const QImage &kept);
+    // 修改第 index 步期间保留其之前的代理图节点, -1 结束修改
+    void setEditingStep(int index);
+    // 换算到代理图分辨率的当前操作
+    ImageOperation activeProxyOperation() const;
+    // proxyImage() 的直方图按编辑节点保存, 见 EditStack::histogram
+    Histogram proxyHistogram() const;
+    void setProxyHistogram(const Histogram &histogram);
+    bool proxyHistogramBase(QImage *previous, Histogram *previousHistogram, QRect *rect) const;
+    // 全分辨率结果所需数据的快照(在主图上重放已提交操作与当前操作): 在界面线程获取, 可交给后台线程执行, 不受之后编辑的影响
+    struct FullResolutionJob
+    {
+        QImage master;
+        std::shared_ptr<TiledImageStore> tiled;
+        QVector<ImageOperation> chain;
+
+        bool isNull() const { return master.isNull() && !tiled; }
+        // 被取消或失败时返回空图像
+        QImage render(const std::atomic<bool> *cancel = nullptr) const;
+    };
+    FullResolutionJob fullResolutionJob() const;
+
+private:
+    void rebuildProxy();
+
+    // 分块存储原图的概览尺寸, 画布在高分屏上全屏时也不需要放大
+    static constexpr int OverviewSize = 4096;
+    // 整层执行操作链的最大像素数: 结果整层常驻内存(RGBA 64 MB), 后台线程算一次也需控制在一次交互可接受的时间内
+    static constexpr qint64 MaxWholeLevelPixels = 4096 * 4096;
+    // 当前操作链(已提交 + 正在调整)
+    QVector<ImageOperation> currentChain() const;
+    // 代理图与主图的宽度比
+    qreal proxyScale() const;
+    // 操作在代理图上可能改变的区域
+    QRect proxyDamageOf(const ImageOperation &operation) const;
+
+    // 按第 level 层缩放的当前操作链
+    QVector<ImageOperation> levelChain(int level) const;
+
+    QImage master;            // 全分辨率原图
+    std::shared_ptr<TiledImageStore> tiled;   // 或分块存储的原图
+    QImage overview;          // 分块存储原图缩小到 OverviewSize 以内, 代理图由它缩放
+    QImage proxy;             // 缩放到显示尺寸的原图
+    QSize proxySize;
+    EditStack history;        // 代理图上的编辑栈
+    ImageOperation active;
+    std::shared_ptr<const ImagePyramid> levels;
+    quint64 currentRevision = 0;
+    QRect proxyDamage;
+
+    // 后台整层执行的结果, 供 renderTile 裁剪
+    QImage processedLevel;
+    int processedLevelIndex = -1;
+    quint64 processedRevision = 0;
+};
+
+#endif // IMAGEDOCUMENT_H
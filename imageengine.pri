@@ -0,0 +1,27 @@
+# 图像处理引擎: 不依赖界面, 主程序和基准测试共用
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/cannydetector.cpp \
+    $$PWD/histogram.cpp \
+    $$PWD/imagekernels.cpp \
+    $$PWD/imagekernels_avx2.cpp \
+    $$PWD/imagepyramid.cpp \
+    $$PWD/imageprocessor.cpp \
+    $$PWD/mosaicengine.cpp \
+    $$PWD/pointstage.cpp \
+    $$PWD/tiledimagestore.cpp \
+    $$PWD/tilescheduler.cpp \
+    $$PWD/tracer.cpp
+
+HEADERS += \
+    $$PWD/cannydetector.h \
+    $$PWD/histogram.h \
+    $$PWD/imagekernels.h \
+    $$PWD/imagepyramid.h \
+    $$PWD/imageprocessor.h \
+    $$PWD/mosaicengine.h \
+    $$PWD/pointstage.h \
+    $$PWD/tiledimagestore.h \
+    $$PWD/tilescheduler.h \
+    $$PWD/tracer.h
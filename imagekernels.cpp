@@ -0,0 +1,750 @@
+﻿#include "imagekernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEKERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace ImageKernels {
+
+// ---------------- 标量实现 ----------------
+// 舍入规则与原 JavaScript 实现一致: Math.round(sum / 3) == (sum + 1) / 3,
+// Math.round(sum / 9) == (sum + 4) / 9
+
+static void grayscaleScalar(const uint8_t *src, uint8_t *dst, int count)
+{
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        const uint8_t gray = uint8_t((src[0] + src[1] + src[2] + 1) / 3);
+        dst[0] = gray;
+        dst[1] = gray;
+        dst[2] = gray;
+        dst[3] = src[3];
+    }
+}
+
+static void binarizeScalar(const uint8_t *src, uint8_t *dst, int count, int threshold)
+{
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        const int gray = (src[0] + src[1] + src[2] + 1) / 3;
+        const uint8_t value = gray > threshold ? 255 : 0;
+        dst[0] = value;
+        dst[1] = value;
+        dst[2] = value;
+        dst[3] = src[3];
+    }
+}
+
+static void applyLutScalar(const uint8_t *src, uint8_t *dst, int count, const uint8_t *lut)
+{
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        dst[0] = lut[src[0]];
+        dst[1] = lut[src[1]];
+        dst[2] = lut[src[2]];
+        dst[3] = src[3];
+    }
+}
+
+static void grayLutScalar(const uint8_t *src, uint8_t *dst, int count, const uint8_t *preLut,
+                          const uint8_t *postLut)
+{
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        const uint8_t value = postLut[(preLut[src[0]] + preLut[src[1]] + preLut[src[2]] + 1) / 3];
+        dst[0] = value;
+        dst[1] = value;
+        dst[2] = value;
+        dst[3] = src[3];
+    }
+}
+
+static void lumaRowScalar(const uint8_t *src, uint8_t *gray, int count)
+{
+    for (int i = 0; i < count; ++i, src += 4) {
+        gray[i] = uint8_t((src[0] + src[1] + src[2] + 1) / 3);
+    }
+}
+
+static void expandGrayScalar(const uint8_t *gray, uint8_t *dst, int count, const uint8_t *lut)
+{
+    for (int i = 0; i < count; ++i, dst += 4) {
+        const uint8_t value = lut[gray[i]];
+        dst[0] = value;
+        dst[1] = value;
+        dst[2] = value;
+        dst[3] = 255;
+    }
+}
+
+static inline uint8_t clampByte(int value)
+{
+    return uint8_t(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static void yuvToRgbaScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                            uint8_t *dst, int count, const YuvCoefficients &k)
+{
+    for (int i = 0; i < count; ++i, dst += 4) {
+        const int c = (y[i] - k.yOffset) * k.yScale + 128;
+        const int d = u[(i >> 1) * uvStep] - 128;
+        const int e = v[(i >> 1) * uvStep] - 128;
+        dst[0] = clampByte((c + k.rv * e) >> 8);
+        dst[1] = clampByte((c + k.gu * d + k.gv * e) >> 8);
+        dst[2] = clampByte((c + k.bu * d) >> 8);
+        dst[3] = 255;
+    }
+}
+
+static void mean3x3Scalar(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                          uint8_t *dst, int x0, int x1)
+{
+    for (int x = x0; x < x1; ++x) {
+        const int left = (x - 1) * 4;
+        for (int c = 0; c < 3; ++c) {
+            const int sum = above[left + c] + above[left + 4 + c] + above[left + 8 + c]
+                          + row[left + c] + row[left + 4 + c] + row[left + 8 + c]
+                          + below[left + c] + below[left + 4 + c] + below[left + 8 + c];
+            dst[x * 4 + c] = uint8_t((sum + 4) / 9);
+        }
+        dst[x * 4 + 3] = row[x * 4 + 3];
+    }
+}
+
+static inline uint32_t sobelThreshold(int threshold)
+{
+    // sqrt(m) > t 等价于 m > t * t (m 为整数, t >= 0)
+    return threshold < 0 ? 0 : uint32_t(threshold * threshold);
+}
+
+static void sobelScalar(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                        uint8_t *dst, int x0, int x1, int threshold)
+{
+    const uint32_t limit = sobelThreshold(threshold);
+    const bool all = threshold < 0;
+    for (int x = x0; x < x1; ++x) {
+        const int gx = (above[x + 1] - above[x - 1])
+                     + 2 * (row[x + 1] - row[x - 1])
+                     + (below[x + 1] - below[x - 1]);
+        const int gy = (below[x - 1] + 2 * below[x] + below[x + 1])
+                     - (above[x - 1] + 2 * above[x] + above[x + 1]);
+        const uint32_t magnitude = uint32_t(gx * gx + gy * gy);
+        const uint8_t value = (all || magnitude > limit) ? 255 : 0;
+        dst[x * 4 + 0] = value;
+        dst[x * 4 + 1] = value;
+        dst[x * 4 + 2] = value;
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+static void gaussianColumnScalar(const uint8_t *const rows[5], uint16_t *dst, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = uint16_t(rows[0][i] + 4 * rows[1][i] + 6 * rows[2][i] + 4 * rows[3][i] + rows[4][i]);
+    }
+}
+
+static void gaussianRowScalar(const uint16_t *src, uint8_t *dst, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int sum = src[i] + 4 * src[i + 1] + 6 * src[i + 2] + 4 * src[i + 3] + src[i + 4];
+        dst[i] = uint8_t((sum + 128) >> 8);
+    }
+}
+
+// 方向量化: tan(22.5°) ≈ 53/128, tan(67.5°) ≈ 309/128
+static inline uint8_t gradientDirection(int gx, int gy)
+{
+    const int ax = gx < 0 ? -gx : gx;
+    const int ay = gy < 0 ? -gy : gy;
+    if (ay * 128 <= ax * 53) return 0;
+    if (ay * 128 >= ax * 309) return 2;
+    return (gx ^ gy) >= 0 ? 1 : 3;
+}
+
+static void gradientScalar(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                           uint32_t *magnitude, uint8_t *direction, int x0, int x1)
+{
+    for (int x = x0; x < x1; ++x) {
+        const int gx = (above[x + 1] - above[x - 1])
+                     + 2 * (row[x + 1] - row[x - 1])
+                     + (below[x + 1] - below[x - 1]);
+        const int gy = (below[x - 1] + 2 * below[x] + below[x + 1])
+                     - (above[x - 1] + 2 * above[x] + above[x + 1]);
+        magnitude[x] = uint32_t(gx * gx + gy * gy);
+        direction[x] = gradientDirection(gx, gy);
+    }
+}
+
+static void suppressScalar(const uint32_t *above, const uint32_t *row, const uint32_t *below,
+                           const uint8_t *direction, uint8_t *dst, int x0, int x1,
+                           uint32_t lowLimit, uint32_t highLimit)
+{
+    for (int x = x0; x < x1; ++x) {
+        const uint32_t m = row[x];
+        uint32_t a, b;
+        switch (direction[x]) {
+        case 0: a = row[x - 1]; b = row[x + 1]; break;
+        case 1: a = above[x - 1]; b = below[x + 1]; break;
+        case 2: a = above[x]; b = below[x]; break;
+        default: a = above[x + 1]; b = below[x - 1]; break;
+        }
+        uint8_t value = 0;
+        if (m > lowLimit && m > a && m >= b) {
+            value = m > highLimit ? 255 : 1;
+        }
+        dst[x] = value;
+    }
+}
+
+static const KernelTable scalarTable = {
+    grayscaleScalar,
+    binarizeScalar,
+    applyLutScalar,
+    grayLutScalar,
+    lumaRowScalar,
+    expandGrayScalar,
+    yuvToRgbaScalar,
+    mean3x3Scalar,
+    sobelScalar,
+    gaussianColumnScalar,
+    gaussianRowScalar,
+    gradientScalar,
+    suppressScalar
+};
+
+// ---------------- SSE2 实现 ----------------
+#ifdef IMAGEKERNELS_SSE2
+
+// 每个 32 位通道内求 (b + g + r + 1) / 3, 结果在低 8 位
+// 除以 3 用 (n * 43691) >> 17 代替, 对 n < 131072 精确
+static inline __m128i graySum3SSE2(__m128i pixels)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i c0 = _mm_and_si128(pixels, mask);
+    const __m128i c1 = _mm_and_si128(_mm_srli_epi32(pixels, 8), mask);
+    const __m128i c2 = _mm_and_si128(_mm_srli_epi32(pixels, 16), mask);
+    const __m128i sum = _mm_add_epi32(_mm_add_epi32(c0, c1), _mm_add_epi32(c2, _mm_set1_epi32(1)));
+    return _mm_srli_epi32(_mm_mulhi_epu16(sum, _mm_set1_epi32(43691)), 1);
+}
+
+static inline __m128i broadcastGraySSE2(__m128i gray)
+{
+    return _mm_or_si128(gray, _mm_or_si128(_mm_slli_epi32(gray, 8), _mm_slli_epi32(gray, 16)));
+}
+
+static void grayscaleSSE2(const uint8_t *src, uint8_t *dst, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000u));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        const __m128i gray = broadcastGraySSE2(graySum3SSE2(pixels));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                         _mm_or_si128(gray, _mm_and_si128(pixels, alphaMask)));
+    }
+    grayscaleScalar(src + i * 4, dst + i * 4, count - i);
+}
+
+static void binarizeSSE2(const uint8_t *src, uint8_t *dst, int count, int threshold)
+{
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000u));
+    const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i limit = _mm_set1_epi32(threshold);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        const __m128i above = _mm_cmpgt_epi32(graySum3SSE2(pixels), limit);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                         _mm_or_si128(_mm_and_si128(above, colorMask),
+                                      _mm_and_si128(pixels, alphaMask)));
+    }
+    binarizeScalar(src + i * 4, dst + i * 4, count - i, threshold);
+}
+
+static void lumaRowSSE2(const uint8_t *src, uint8_t *gray, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i lo = graySum3SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4)));
+        const __m128i hi = graySum3SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16)));
+        const __m128i words = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(gray + i), _mm_packus_epi16(words, words));
+    }
+    lumaRowScalar(src + i * 4, gray + i, count - i);
+}
+
+// 4 个像素的三行 x 三列邻域求和, 每 16 位通道 (最大 2295)
+static inline void sum3x3SSE2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                              int offset, __m128i &lo, __m128i &hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    lo = _mm_setzero_si128();
+    hi = _mm_setzero_si128();
+    const uint8_t *rows[3] = { above, row, below };
+    for (const uint8_t *line : rows) {
+        for (int dx = -4; dx <= 4; dx += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + offset + dx));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+    }
+}
+
+static void mean3x3SSE2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                        uint8_t *dst, int x0, int x1)
+{
+    // (sum + 4) / 9 用 ((sum + 4) * 7282) >> 16 代替, 对 sum < 32768 精确
+    const __m128i bias = _mm_set1_epi16(4);
+    const __m128i reciprocal = _mm_set1_epi16(7282);
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000u));
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        __m128i lo, hi;
+        sum3x3SSE2(above, row, below, x * 4, lo, hi);
+        lo = _mm_mulhi_epu16(_mm_add_epi16(lo, bias), reciprocal);
+        hi = _mm_mulhi_epu16(_mm_add_epi16(hi, bias), reciprocal);
+        const __m128i mean = _mm_packus_epi16(lo, hi);
+        const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                         _mm_or_si128(_mm_andnot_si128(alphaMask, mean),
+                                      _mm_and_si128(center, alphaMask)));
+    }
+    mean3x3Scalar(above, row, below, dst, x, x1);
+}
+
+// 8 个灰度像素扩展为 16 位
+static inline __m128i load8x16SSE2(const uint8_t *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128());
+}
+
+static void sobelSSE2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                      uint8_t *dst, int x0, int x1, int threshold)
+{
+    if (threshold < 0) {
+        sobelScalar(above, row, below, dst, x0, x1, threshold);
+        return;
+    }
+    const __m128i limit = _mm_set1_epi32(int(sobelThreshold(threshold)));
+    const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000u));
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        const __m128i a0 = load8x16SSE2(above + x - 1), a1 = load8x16SSE2(above + x), a2 = load8x16SSE2(above + x + 1);
+        const __m128i b0 = load8x16SSE2(row + x - 1), b2 = load8x16SSE2(row + x + 1);
+        const __m128i c0 = load8x16SSE2(below + x - 1), c1 = load8x16SSE2(below + x), c2 = load8x16SSE2(below + x + 1);
+
+        const __m128i b = _mm_sub_epi16(b2, b0);
+        const __m128i gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(c2, c0)),
+                                         _mm_add_epi16(b, b));
+        const __m128i top = _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_add_epi16(a1, a1));
+        const __m128i bottom = _mm_add_epi16(_mm_add_epi16(c0, c2), _mm_add_epi16(c1, c1));
+        const __m128i gy = _mm_sub_epi16(bottom, top);
+
+        // gx * gx + gy * gy, 每个像素一个 32 位结果
+        const __m128i lo = _mm_unpacklo_epi16(gx, gy);
+        const __m128i hi = _mm_unpackhi_epi16(gx, gy);
+        const __m128i edgeLo = _mm_cmpgt_epi32(_mm_madd_epi16(lo, lo), limit);
+        const __m128i edgeHi = _mm_cmpgt_epi32(_mm_madd_epi16(hi, hi), limit);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                         _mm_or_si128(_mm_and_si128(edgeLo, colorMask), alphaMask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4 + 16),
+                         _mm_or_si128(_mm_and_si128(edgeHi, colorMask), alphaMask));
+    }
+    sobelScalar(above, row, below, dst, x, x1, threshold);
+}
+
+// 查找表之后把每个灰度值复制到 R/G/B 三个通道, 每次 16 个像素
+static void expandGraySSE2(const uint8_t *gray, uint8_t *dst, int count, const uint8_t *lut)
+{
+    const __m128i alpha = _mm_set1_epi8(char(0xff));
+    alignas(16) uint8_t mapped[16];
+    int i = 0;
+    for (; i + 16 <= count; i += 16, dst += 64) {
+        for (int j = 0; j < 16; ++j) {
+            mapped[j] = lut[gray[i + j]];
+        }
+        const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(mapped));
+        const __m128i vv0 = _mm_unpacklo_epi8(v, v);
+        const __m128i vv1 = _mm_unpackhi_epi8(v, v);
+        const __m128i va0 = _mm_unpacklo_epi8(v, alpha);
+        const __m128i va1 = _mm_unpackhi_epi8(v, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(vv0, va0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi16(vv0, va0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_unpacklo_epi16(vv1, va1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 48), _mm_unpackhi_epi16(vv1, va1));
+    }
+    expandGrayScalar(gray + i, dst, count - i, lut);
+}
+
+// 两个 16 位系数拼成 _mm_madd_epi16 的乘数: 低位乘 a, 高位乘 b
+static inline __m128i coefficientPairSSE2(int16_t a, int16_t b)
+{
+    return _mm_set1_epi32(int(uint16_t(a)) | (int(uint16_t(b)) << 16));
+}
+
+// 8 个像素的一个颜色通道: a * ca + b * cb + c * cc + d * cd, 在 32 位中求和后右移 8 位
+static inline __m128i maddChannelSSE2(__m128i a, __m128i b, __m128i ab,
+                                      __m128i c, __m128i d, __m128i cd)
+{
+    const __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), ab),
+                                     _mm_madd_epi16(_mm_unpacklo_epi16(c, d), cd));
+    const __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), ab),
+                                     _mm_madd_epi16(_mm_unpackhi_epi16(c, d), cd));
+    return _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+}
+
+// 每次 8 个像素(4 个色度样本), 乘加用 _mm_madd_epi16 在 32 位中完成, 与标量结果一致
+static void yuvToRgbaSSE2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                          uint8_t *dst, int count, const YuvCoefficients &k)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yOffset = _mm_set1_epi16(k.yOffset);
+    const __m128i chromaOffset = _mm_set1_epi16(128);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i alpha = _mm_set1_epi16(255);
+    // 舍入项 128 作为常数 1 的系数并入乘加
+    const __m128i yr = coefficientPairSSE2(k.yScale, k.rv);
+    const __m128i yg = coefficientPairSSE2(k.yScale, k.gu);
+    const __m128i yb = coefficientPairSSE2(k.yScale, k.bu);
+    const __m128i gv = coefficientPairSSE2(k.gv, 128);
+    const __m128i round = coefficientPairSSE2(0, 128);
+
+    // NV21 的 V 在前, 交错行从两者中较小的地址开始
+    const uint8_t *interleaved = std::min(u, v);
+    const bool swapped = v < u;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8, dst += 32) {
+        const __m128i c = _mm_sub_epi16(
+            _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + i)), zero), yOffset);
+
+        // 色度样本复制到相邻两个像素
+        __m128i d, e;
+        if (uvStep == 2) {
+            const __m128i uv = _mm_unpacklo_epi8(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(interleaved + i)), zero);
+            d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+            e = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+            if (swapped) {
+                std::swap(d, e);
+            }
+        } else {
+            int u4, v4;
+            std::memcpy(&u4, u + i / 2, 4);
+            std::memcpy(&v4, v + i / 2, 4);
+            const __m128i u16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero);
+            const __m128i v16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero);
+            d = _mm_unpacklo_epi16(u16, u16);
+            e = _mm_unpacklo_epi16(v16, v16);
+        }
+        d = _mm_sub_epi16(d, chromaOffset);
+        e = _mm_sub_epi16(e, chromaOffset);
+
+        const __m128i r = maddChannelSSE2(c, e, yr, zero, one, round);
+        const __m128i g = maddChannelSSE2(c, d, yg, e, one, gv);
+        const __m128i b = maddChannelSSE2(c, d, yb, zero, one, round);
+
+        // 交错为 R G B A
+        const __m128i rg = _mm_packus_epi16(r, g);
+        const __m128i ba = _mm_packus_epi16(b, alpha);
+        const __m128i rgPairs = _mm_unpacklo_epi8(rg, _mm_srli_si128(rg, 8));
+        const __m128i baPairs = _mm_unpacklo_epi8(ba, _mm_srli_si128(ba, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(rgPairs, baPairs));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi16(rgPairs, baPairs));
+    }
+    yuvToRgbaScalar(y + i, u + (i / 2) * uvStep, v + (i / 2) * uvStep, uvStep, dst, count - i, k);
+}
+
+// 每次 16 个像素, 6x 拆成 4x + 2x
+static void gaussianColumnSSE2(const uint8_t *const rows[5], uint16_t *dst, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i r[5];
+        for (int k = 0; k < 5; ++k) {
+            r[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + i));
+        }
+        for (int half = 0; half < 2; ++half) {
+            auto widen = [&](__m128i v) {
+                return half == 0 ? _mm_unpacklo_epi8(v, zero) : _mm_unpackhi_epi8(v, zero);
+            };
+            const __m128i center = widen(r[2]);
+            __m128i sum = _mm_add_epi16(widen(r[0]), widen(r[4]));
+            sum = _mm_add_epi16(sum, _mm_slli_epi16(_mm_add_epi16(widen(r[1]), widen(r[3])), 2));
+            sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(center, 2), _mm_slli_epi16(center, 1)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + half * 8), sum);
+        }
+    }
+    const uint8_t *rest[5];
+    for (int k = 0; k < 5; ++k) {
+        rest[k] = rows[k] + i;
+    }
+    gaussianColumnScalar(rest, dst + i, count - i);
+}
+
+// 每次 8 个像素; 和最大为 65280 + 128, 16 位无符号不会溢出
+static void gaussianRowSSE2(const uint16_t *src, uint8_t *dst, int count)
+{
+    const __m128i round = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto load = [&](int offset) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + offset));
+        };
+        const __m128i center = load(2);
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(load(0), load(4)), round);
+        sum = _mm_add_epi16(sum, _mm_slli_epi16(_mm_add_epi16(load(1), load(3)), 2));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(center, 2), _mm_slli_epi16(center, 1)));
+        const __m128i value = _mm_srli_epi16(sum, 8);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(value, value));
+    }
+    gaussianRowScalar(src + i, dst + i, count - i);
+}
+
+// 每次 8 个像素: 梯度在 16 位中计算, 幅值平方与方向判定用 _mm_madd_epi16 在 32 位中完成
+static void gradientSSE2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                         uint32_t *magnitude, uint8_t *direction, int x0, int x1)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i flatCoefficients = coefficientPairSSE2(128, -53);
+    const __m128i steepCoefficients = coefficientPairSSE2(128, -309);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i minusOne = _mm_set1_epi16(-1);
+    const __m128i two = _mm_set1_epi16(2);
+    auto load = [&](const uint8_t *p) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+    };
+    // 两组 32 位结果饱和打包为 16 位, 只用于判断符号
+    auto maddPacked = [](__m128i a, __m128i b, __m128i coefficients) {
+        return _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coefficients),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(a, b), coefficients));
+    };
+
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        const __m128i aL = load(above + x - 1), aC = load(above + x), aR = load(above + x + 1);
+        const __m128i rL = load(row + x - 1), rR = load(row + x + 1);
+        const __m128i bL = load(below + x - 1), bC = load(below + x), bR = load(below + x + 1);
+
+        const __m128i gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(aR, aL), _mm_sub_epi16(bR, bL)),
+                                         _mm_slli_epi16(_mm_sub_epi16(rR, rL), 1));
+        const __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(bL, bR), _mm_slli_epi16(bC, 1)),
+                                         _mm_add_epi16(_mm_add_epi16(aL, aR), _mm_slli_epi16(aC, 1)));
+
+        const __m128i lo = _mm_unpacklo_epi16(gx, gy);
+        const __m128i hi = _mm_unpackhi_epi16(gx, gy);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(magnitude + x), _mm_madd_epi16(lo, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(magnitude + x + 4), _mm_madd_epi16(hi, hi));
+
+        // flat: ay * 128 - ax * 53 <= 0; steep: ay * 128 - ax * 309 >= 0
+        const __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+        const __m128i ay = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+        const __m128i flat = _mm_cmplt_epi16(maddPacked(ay, ax, flatCoefficients), one);
+        const __m128i steep = _mm_cmpgt_epi16(maddPacked(ay, ax, steepCoefficients), minusOne);
+        // 同号为 1, 异号为 3
+        const __m128i diagonal = _mm_add_epi16(one, _mm_and_si128(_mm_srai_epi16(_mm_xor_si128(gx, gy), 15), two));
+        const __m128i notFlat = _mm_or_si128(_mm_and_si128(steep, two), _mm_andnot_si128(steep, diagonal));
+        const __m128i result = _mm_andnot_si128(flat, notFlat);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(direction + x), _mm_packus_epi16(result, result));
+    }
+    gradientScalar(above, row, below, magnitude, direction, x, x1);
+}
+
+// 每次 4 个像素: 按方向从 4 组候选邻居中选出两侧的幅值
+// 幅值小于 2^31, 可以直接用有符号比较
+static void suppressSSE2(const uint32_t *above, const uint32_t *row, const uint32_t *below,
+                         const uint8_t *direction, uint8_t *dst, int x0, int x1,
+                         uint32_t lowLimit, uint32_t highLimit)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low = _mm_set1_epi32(int(lowLimit));
+    const __m128i high = _mm_set1_epi32(int(highLimit));
+    const __m128i weakValue = _mm_set1_epi32(1);
+    const __m128i strongValue = _mm_set1_epi32(255);
+    auto load = [](const uint32_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        int packedDirection;
+        std::memcpy(&packedDirection, direction + x, 4);
+        const __m128i d = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packedDirection), zero), zero);
+        const __m128i d0 = _mm_cmpeq_epi32(d, zero);
+        const __m128i d1 = _mm_cmpeq_epi32(d, weakValue);
+        const __m128i d2 = _mm_cmpeq_epi32(d, _mm_set1_epi32(2));
+        const __m128i d3 = _mm_cmpeq_epi32(d, _mm_set1_epi32(3));
+
+        const __m128i m = load(row + x);
+        const __m128i a = _mm_or_si128(_mm_or_si128(_mm_and_si128(d0, load(row + x - 1)),
+                                                    _mm_and_si128(d1, load(above + x - 1))),
+                                       _mm_or_si128(_mm_and_si128(d2, load(above + x)),
+                                                    _mm_and_si128(d3, load(above + x + 1))));
+        const __m128i b = _mm_or_si128(_mm_or_si128(_mm_and_si128(d0, load(row + x + 1)),
+                                                    _mm_and_si128(d1, load(below + x + 1))),
+                                       _mm_or_si128(_mm_and_si128(d2, load(below + x)),
+                                                    _mm_and_si128(d3, load(below + x - 1))));
+
+        const __m128i edge = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(m, low), _mm_cmpgt_epi32(m, a)),
+                                           _mm_andnot_si128(_mm_cmpgt_epi32(b, m), _mm_cmpeq_epi32(m, m)));
+        const __m128i strong = _mm_and_si128(edge, _mm_cmpgt_epi32(m, high));
+        const __m128i value = _mm_or_si128(_mm_and_si128(edge, weakValue), _mm_and_si128(strong, strongValue));
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(value, value), zero);
+        const int packed = _mm_cvtsi128_si32(bytes);
+        std::memcpy(dst + x, &packed, 4);
+    }
+    suppressScalar(above, row, below, direction, dst, x, x1, lowLimit, highLimit);
+}
+
+// 查找表运算没有合适的 SSE2 指令, 沿用标量实现
+static const KernelTable sse2Table = {
+    grayscaleSSE2,
+    binarizeSSE2,
+    applyLutScalar,
+    grayLutScalar,
+    lumaRowSSE2,
+    expandGraySSE2,
+    yuvToRgbaSSE2,
+    mean3x3SSE2,
+    sobelSSE2,
+    gaussianColumnSSE2,
+    gaussianRowSSE2,
+    gradientSSE2,
+    suppressSSE2
+};
+
+#endif // IMAGEKERNELS_SSE2
+
+// ---------------- 分派 ----------------
+
+YuvCoefficients yuvCoefficients(bool bt709, bool fullRange)
+{
+    // 有限范围: 亮度 219 级、色度 224 级扩展到 255 级
+    if (bt709) {
+        return fullRange ? YuvCoefficients{ 0, 256, 403, -48, -120, 475 }
+                         : YuvCoefficients{ 16, 298, 459, -55, -136, 541 };
+    }
+    return fullRange ? YuvCoefficients{ 0, 256, 359, -88, -183, 454 }
+                     : YuvCoefficients{ 16, 298, 409, -100, -208, 516 };
+}
+
+const KernelTable *scalarKernels()
+{
+    return &scalarTable;
+}
+
+const KernelTable *sse2Kernels()
+{
+#ifdef IMAGEKERNELS_SSE2
+    return &sse2Table;
+#else
+    return nullptr;
+#endif
+}
+
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // 需要操作系统保存 YMM 寄存器 (OSXSAVE + XCR0)
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+SimdLevel detectedSimdLevel()
+{
+    static const SimdLevel level = [] {
+        if (avx2Kernels() && cpuHasAvx2())
+            return SimdLevel::AVX2;
+        if (sse2Kernels())
+            return SimdLevel::SSE2;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+static SimdLevel clampLevel(SimdLevel level)
+{
+    return int(level) > int(detectedSimdLevel()) ? detectedSimdLevel() : level;
+}
+
+static SimdLevel initialLevel()
+{
+    const char *env = std::getenv("QT_IMAGE_SIMD");
+    if (env) {
+        if (std::strcmp(env, "scalar") == 0)
+            return SimdLevel::Scalar;
+        if (std::strcmp(env, "sse2") == 0)
+            return clampLevel(SimdLevel::SSE2);
+        if (std::strcmp(env, "avx2") == 0)
+            return clampLevel(SimdLevel::AVX2);
+    }
+    return detectedSimdLevel();
+}
+
+static std::atomic<int> &currentLevel()
+{
+    static std::atomic<int> level{int(initialLevel())};
+    return level;
+}
+
+SimdLevel activeSimdLevel()
+{
+    return SimdLevel(currentLevel().load(std::memory_order_relaxed));
+}
+
+void setSimdLevel(SimdLevel level)
+{
+    currentLevel().store(int(clampLevel(level)), std::memory_order_relaxed);
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::AVX2:
+        return "avx2";
+    case SimdLevel::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+const KernelTable &kernels(SimdLevel level)
+{
+    switch (clampLevel(level)) {
+    case SimdLevel::AVX2:
+        return *avx2Kernels();
+    case SimdLevel::SSE2:
+        return *sse2Kernels();
+    default:
+        return scalarTable;
+    }
+}
+
+const KernelTable &kernels()
+{
+    return kernels(activeSimdLevel());
+}
+
+} // namespace ImageKernels
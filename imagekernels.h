@@ -0,0 +1,100 @@
+﻿#ifndef IMAGEKERNELS_H
+#define IMAGEKERNELS_H
+
+#include <cstdint>
+
+// 像素内核层: 不依赖 Qt, 只处理原始缓冲区
+// 像素统一为 4 字节, 第 4 个字节为 Alpha, 前三个字节为颜色通道
+// (RGBA8888 与小端下的 ARGB32 都满足, 内核不关心 R/B 顺序)
+namespace ImageKernels {
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// YUV 转 RGB 的定点系数(Q8): c = Y - yOffset, d = U - 128, e = V - 128
+//   R = (yScale * c + rv * e + 128) >> 8
+//   G = (yScale * c + gu * d + gv * e + 128) >> 8
+//   B = (yScale * c + bu * d + 128) >> 8
+struct YuvCoefficients {
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+};
+
+// BT.601 / BT.709, 有限范围(16-235) / 全范围
+YuvCoefficients yuvCoefficients(bool bt709, bool fullRange);
+
+struct KernelTable {
+    // 点运算: 处理一行中连续的 count 个像素
+    void (*grayscale)(const uint8_t *src, uint8_t *dst, int count);
+    void (*binarize)(const uint8_t *src, uint8_t *dst, int count, int threshold);
+    void (*applyLut)(const uint8_t *src, uint8_t *dst, int count, const uint8_t *lut);
+    // 融合的灰度点运算: v = postLut[(preLut[c0] + preLut[c1] + preLut[c2] + 1) / 3]
+    void (*grayLut)(const uint8_t *src, uint8_t *dst, int count, const uint8_t *preLut,
+                    const uint8_t *postLut);
+    // 将 4 字节像素转换为单通道灰度
+    void (*lumaRow)(const uint8_t *src, uint8_t *gray, int count);
+
+    // 单通道经查找表展开为 4 字节灰度像素, Alpha 为 255
+    void (*expandGray)(const uint8_t *gray, uint8_t *dst, int count, const uint8_t *lut);
+    // 4:2:0 视频的一行 YUV 转为 RGBA8888(字节顺序 R, G, B, A), 每个色度样本对应两个像素
+    // uvStep 为相邻色度样本的字节间隔: NV12 为 2(u 指向 UV 交错行, v = u + 1), I420 为 1
+    void (*yuvToRgba)(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                      uint8_t *dst, int count, const YuvCoefficients &coefficients);
+
+    // 邻域运算: above/row/below 为相邻三行的行首, 处理 [x0, x1) 列
+    // 调用方保证 1 <= x0 且 x1 <= width - 1
+    void (*mean3x3)(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                    uint8_t *dst, int x0, int x1);
+    // Sobel 梯度幅值阈值化: 输入为灰度行, 输出为 4 字节像素行
+    void (*sobel)(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                  uint8_t *dst, int x0, int x1, int threshold);
+
+    // Canny 各阶段, 均处理单通道平面的一行
+    // 5x5 高斯的纵向和: dst[i] = r0[i] + 4 r1[i] + 6 r2[i] + 4 r3[i] + r4[i]
+    void (*gaussianColumn)(const uint8_t *const rows[5], uint16_t *dst, int count);
+    // 横向和并归一化: dst[i] = (s[i] + 4 s[i+1] + 6 s[i+2] + 4 s[i+3] + s[i+4] + 128) >> 8, src 含 count + 4 项
+    void (*gaussianRow)(const uint16_t *src, uint8_t *dst, int count);
+    // Sobel 梯度幅值的平方与量化方向(0 水平, 1 左上-右下, 2 竖直, 3 右上-左下), 处理 [x0, x1) 列
+    void (*gradient)(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                     uint32_t *magnitude, uint8_t *direction, int x0, int x1);
+    // 非极大值抑制与双阈值, 输入为相邻三行的幅值与本行方向, 处理 [x0, x1) 列
+    // 沿梯度方向大于一侧且不小于另一侧的像素: 幅值大于 highLimit 输出 255, 大于 lowLimit 输出 1, 其余为 0
+    // 幅值与阈值都不超过 2^31
+    void (*suppress)(const uint32_t *above, const uint32_t *row, const uint32_t *below,
+                     const uint8_t *direction, uint8_t *dst, int x0, int x1,
+                     uint32_t lowLimit, uint32_t highLimit);
+};
+
+// 当前 CPU 可用的最高指令集
+SimdLevel detectedSimdLevel();
+
+// 当前使用的指令集, 默认为 detectedSimdLevel(), 可通过环境变量
+// QT_IMAGE_SIMD=scalar|sse2|avx2 限制
+SimdLevel activeSimdLevel();
+
+// 强制指定指令集(基准测试和结果比对使用), 超过 CPU 能力时自动降级
+void setSimdLevel(SimdLevel level);
+
+const char *simdLevelName(SimdLevel level);
+
+// 当前指令集对应的内核表
+const KernelTable &kernels();
+
+// 指定指令集的内核表
+const KernelTable &kernels(SimdLevel level);
+
+// 各指令集实现, 不可用时返回 nullptr
+const KernelTable *scalarKernels();
+const KernelTable *sse2Kernels();
+const KernelTable *avx2Kernels();
+
+} // namespace ImageKernels
+
+#endif // IMAGEKERNELS_H
@@ -0,0 +1,276 @@
+﻿// AVX2 内核: 整个编译单元以 AVX2 目标编译, 仅在运行时检测到 CPU 支持后才会被调用
+// MSVC 无需额外编译选项即可使用 AVX2 intrinsics
+// 部分操作沿用 SSE2 内核, 条件与 imagekernels.cpp 中的 IMAGEKERNELS_SSE2 相同; 没有 SSE2 时不提供 AVX2 内核
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEKERNELS_AVX2 1
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+#endif
+
+#include "imagekernels.h"
+
+#ifdef IMAGEKERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace ImageKernels {
+
+#ifdef IMAGEKERNELS_AVX2
+
+// 与 SSE2 版本相同的算法, 每次处理 8 个像素
+static inline __m256i graySum3AVX2(__m256i pixels)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i c0 = _mm256_and_si256(pixels, mask);
+    const __m256i c1 = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask);
+    const __m256i c2 = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask);
+    const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(c0, c1),
+                                         _mm256_add_epi32(c2, _mm256_set1_epi32(1)));
+    return _mm256_srli_epi32(_mm256_mulhi_epu16(sum, _mm256_set1_epi32(43691)), 1);
+}
+
+static void grayscaleAVX2(const uint8_t *src, uint8_t *dst, int count)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000u));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        const __m256i gray = graySum3AVX2(pixels);
+        const __m256i rgb = _mm256_or_si256(gray, _mm256_or_si256(_mm256_slli_epi32(gray, 8),
+                                                                  _mm256_slli_epi32(gray, 16)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4),
+                            _mm256_or_si256(rgb, _mm256_and_si256(pixels, alphaMask)));
+    }
+    scalarKernels()->grayscale(src + i * 4, dst + i * 4, count - i);
+}
+
+static void binarizeAVX2(const uint8_t *src, uint8_t *dst, int count, int threshold)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000u));
+    const __m256i colorMask = _mm256_set1_epi32(0x00ffffff);
+    const __m256i limit = _mm256_set1_epi32(threshold);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        const __m256i above = _mm256_cmpgt_epi32(graySum3AVX2(pixels), limit);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4),
+                            _mm256_or_si256(_mm256_and_si256(above, colorMask),
+                                            _mm256_and_si256(pixels, alphaMask)));
+    }
+    scalarKernels()->binarize(src + i * 4, dst + i * 4, count - i, threshold);
+}
+
+// 查找表通过 gather 指令实现, 每个通道一次 gather
+static void applyLutAVX2(const uint8_t *src, uint8_t *dst, int count, const uint8_t *lut)
+{
+    alignas(32) int table[256];
+    for (int i = 0; i < 256; ++i)
+        table[i] = lut[i];
+
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000u));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        const __m256i c0 = _mm256_i32gather_epi32(table, _mm256_and_si256(pixels, mask), 4);
+        const __m256i c1 = _mm256_i32gather_epi32(table, _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask), 4);
+        const __m256i c2 = _mm256_i32gather_epi32(table, _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask), 4);
+        const __m256i rgb = _mm256_or_si256(c0, _mm256_or_si256(_mm256_slli_epi32(c1, 8),
+                                                                _mm256_slli_epi32(c2, 16)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4),
+                            _mm256_or_si256(rgb, _mm256_and_si256(pixels, alphaMask)));
+    }
+    scalarKernels()->applyLut(src + i * 4, dst + i * 4, count - i, lut);
+}
+
+static void grayLutAVX2(const uint8_t *src, uint8_t *dst, int count, const uint8_t *preLut,
+                        const uint8_t *postLut)
+{
+    alignas(32) int pre[256];
+    alignas(32) int post[256];
+    for (int i = 0; i < 256; ++i) {
+        pre[i] = preLut[i];
+        post[i] = postLut[i] * 0x010101;
+    }
+
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000u));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        const __m256i c0 = _mm256_i32gather_epi32(pre, _mm256_and_si256(pixels, mask), 4);
+        const __m256i c1 = _mm256_i32gather_epi32(pre, _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask), 4);
+        const __m256i c2 = _mm256_i32gather_epi32(pre, _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask), 4);
+        const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(c0, c1),
+                                             _mm256_add_epi32(c2, _mm256_set1_epi32(1)));
+        const __m256i gray = _mm256_srli_epi32(_mm256_mulhi_epu16(sum, _mm256_set1_epi32(43691)), 1);
+        // post 表中已把灰度值复制到三个通道
+        const __m256i rgb = _mm256_i32gather_epi32(post, gray, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4),
+                            _mm256_or_si256(rgb, _mm256_and_si256(pixels, alphaMask)));
+    }
+    scalarKernels()->grayLut(src + i * 4, dst + i * 4, count - i, preLut, postLut);
+}
+
+static void lumaRowAVX2(const uint8_t *src, uint8_t *gray, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i lo = graySum3AVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4)));
+        const __m256i hi = graySum3AVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4 + 32)));
+        // pack 按 128 位分道进行, 需要重新排列
+        const __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+        const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                               _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gray + i), bytes);
+    }
+    scalarKernels()->lumaRow(src + i * 4, gray + i, count - i);
+}
+
+static void mean3x3AVX2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                        uint8_t *dst, int x0, int x1)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(4);
+    const __m256i reciprocal = _mm256_set1_epi16(7282);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000u));
+    const uint8_t *rows[3] = { above, row, below };
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (const uint8_t *line : rows) {
+            for (int dx = -4; dx <= 4; dx += 4) {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(line + x * 4 + dx));
+                lo = _mm256_add_epi16(lo, _mm256_unpacklo_epi8(v, zero));
+                hi = _mm256_add_epi16(hi, _mm256_unpackhi_epi8(v, zero));
+            }
+        }
+        lo = _mm256_mulhi_epu16(_mm256_add_epi16(lo, bias), reciprocal);
+        hi = _mm256_mulhi_epu16(_mm256_add_epi16(hi, bias), reciprocal);
+        // unpack 与 pack 都按分道进行, 顺序自然还原
+        const __m256i mean = _mm256_packus_epi16(lo, hi);
+        const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4),
+                            _mm256_or_si256(_mm256_andnot_si256(alphaMask, mean),
+                                            _mm256_and_si256(center, alphaMask)));
+    }
+    scalarKernels()->mean3x3(above, row, below, dst, x, x1);
+}
+
+static inline __m256i load16x16AVX2(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+static void sobelAVX2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                      uint8_t *dst, int x0, int x1, int threshold)
+{
+    if (threshold < 0) {
+        scalarKernels()->sobel(above, row, below, dst, x0, x1, threshold);
+        return;
+    }
+    const __m256i limit = _mm256_set1_epi32(threshold * threshold);
+    const __m256i colorMask = _mm256_set1_epi32(0x00ffffff);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000u));
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        const __m256i a0 = load16x16AVX2(above + x - 1), a1 = load16x16AVX2(above + x), a2 = load16x16AVX2(above + x + 1);
+        const __m256i b0 = load16x16AVX2(row + x - 1), b2 = load16x16AVX2(row + x + 1);
+        const __m256i c0 = load16x16AVX2(below + x - 1), c1 = load16x16AVX2(below + x), c2 = load16x16AVX2(below + x + 1);
+
+        const __m256i b = _mm256_sub_epi16(b2, b0);
+        const __m256i gx = _mm256_add_epi16(_mm256_add_epi16(_mm256_sub_epi16(a2, a0), _mm256_sub_epi16(c2, c0)),
+                                            _mm256_add_epi16(b, b));
+        const __m256i top = _mm256_add_epi16(_mm256_add_epi16(a0, a2), _mm256_add_epi16(a1, a1));
+        const __m256i bottom = _mm256_add_epi16(_mm256_add_epi16(c0, c2), _mm256_add_epi16(c1, c1));
+        const __m256i gy = _mm256_sub_epi16(bottom, top);
+
+        // lo 含像素 0-3 与 8-11, hi 含像素 4-7 与 12-15
+        const __m256i lo = _mm256_unpacklo_epi16(gx, gy);
+        const __m256i hi = _mm256_unpackhi_epi16(gx, gy);
+        const __m256i edgeLo = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi32(_mm256_madd_epi16(lo, lo), limit), colorMask), alphaMask);
+        const __m256i edgeHi = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi32(_mm256_madd_epi16(hi, hi), limit), colorMask), alphaMask);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4),
+                            _mm256_permute2x128_si256(edgeLo, edgeHi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4 + 32),
+                            _mm256_permute2x128_si256(edgeLo, edgeHi, 0x31));
+    }
+    scalarKernels()->sobel(above, row, below, dst, x, x1, threshold);
+}
+
+// 视频转换每行只执行一次, 沿用 SSE2 实现
+static void expandGrayAVX2(const uint8_t *gray, uint8_t *dst, int count, const uint8_t *lut)
+{
+    sse2Kernels()->expandGray(gray, dst, count, lut);
+}
+
+static void yuvToRgbaAVX2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                          uint8_t *dst, int count, const YuvCoefficients &coefficients)
+{
+    sse2Kernels()->yuvToRgba(y, u, v, uvStep, dst, count, coefficients);
+}
+
+// Canny 各阶段受内存带宽限制, 沿用 SSE2 实现
+static void gaussianColumnAVX2(const uint8_t *const rows[5], uint16_t *dst, int count)
+{
+    sse2Kernels()->gaussianColumn(rows, dst, count);
+}
+
+static void gaussianRowAVX2(const uint16_t *src, uint8_t *dst, int count)
+{
+    sse2Kernels()->gaussianRow(src, dst, count);
+}
+
+static void gradientAVX2(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                         uint32_t *magnitude, uint8_t *direction, int x0, int x1)
+{
+    sse2Kernels()->gradient(above, row, below, magnitude, direction, x0, x1);
+}
+
+static void suppressAVX2(const uint32_t *above, const uint32_t *row, const uint32_t *below,
+                         const uint8_t *direction, uint8_t *dst, int x0, int x1,
+                         uint32_t lowLimit, uint32_t highLimit)
+{
+    sse2Kernels()->suppress(above, row, below, direction, dst, x0, x1, lowLimit, highLimit);
+}
+
+static const KernelTable avx2Table = {
+    grayscaleAVX2,
+    binarizeAVX2,
+    applyLutAVX2,
+    grayLutAVX2,
+    lumaRowAVX2,
+    expandGrayAVX2,
+    yuvToRgbaAVX2,
+    mean3x3AVX2,
+    sobelAVX2,
+    gaussianColumnAVX2,
+    gaussianRowAVX2,
+    gradientAVX2,
+    suppressAVX2
+};
+
+const KernelTable *avx2Kernels()
+{
+    return &avx2Table;
+}
+
+#else
+
+const KernelTable *avx2Kernels()
+{
+    return nullptr;
+}
+
+#endif // IMAGEKERNELS_AVX2
+
+} // namespace ImageKernels
+
+#if defined(IMAGEKERNELS_AVX2) && defined(__clang__)
+#pragma clang attribute pop
+#endif
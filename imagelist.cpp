@@ -3,12 +3,24 @@
 #include <QFileInfo>
 #include <QIcon>
 #include <QMainWindow>
+#include <QPainter>
 
-ImageList::ImageList(QWidget *parent) : QObject(parent)
+namespace {
+
+// 列表图标尺寸; 缩略图按两倍解码, 高分屏下依然清晰
+const QSize IconSize(48, 48);
+
+} // namespace
+
+ImageList::ImageList(ImageCache *cache, QWidget *parent) : QObject(parent), imageCache(cache)
 {
     // 初始化界面
     initUi();
     
+    // 缩略图加载器
+    thumbnailLoader = new ThumbnailLoader(IconSize * 2, this);
+    connect(thumbnailLoader, &ThumbnailLoader::thumbnailReady, this, &ImageList::onThumbnailReady);
+    
     // 连接信号槽
     connect(imageListWidget, &QListWidget::itemClicked, this, &ImageList::onItemClicked);
     connect(imageListWidget, &QListWidget::customContextMenuRequested, this, &ImageList::showContextMenu);
@@ -38,7 +50,7 @@ void ImageList::initUi()
     
     // 设置列表样式 - 使用更小的图标和网格
     imageListWidget->setViewMode(QListWidget::IconMode);
-    imageListWidget->setIconSize(QSize(48, 48));  // 更小的图标
+    imageListWidget->setIconSize(IconSize);  // 更小的图标
     imageListWidget->setGridSize(QSize(60, 60));  // 更小的网格
     imageListWidget->setResizeMode(QListWidget::Adjust);
     imageListWidget->setMovement(QListWidget::Static);
@@ -63,6 +75,17 @@ void ImageList::initUi()
     // 应用样式
     initStyles();
     
+    // 缩略图就绪前的占位图标
+    QPixmap placeholder(IconSize);
+    placeholder.fill(Qt::transparent);
+    QPainter painter(&placeholder);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QColor("#c0c0c0"));
+    painter.setBrush(QColor("#e8e8e8"));
+    painter.drawRoundedRect(QRectF(placeholder.rect()).adjusted(2.5, 2.5, -2.5, -2.5), 4, 4);
+    painter.end();
+    placeholderIcon = QIcon(placeholder);
+    
     // 设置停靠窗口的高度限制
     imageListDock->setMinimumHeight(80);   // 最小高度
     imageListDock->setMaximumHeight(150);  // 最大高度
@@ -104,11 +127,28 @@ void ImageList::addImage(const QString &path)
     if (path.isEmpty()) return;
     
     QListWidgetItem *item = new QListWidgetItem(imageListWidget);
-    item->setIcon(QIcon(path));
+    item->setIcon(placeholderIcon);
     item->setText(QFileInfo(path).fileName());
     item->setTextAlignment(Qt::AlignCenter);
     item->setData(Qt::UserRole, path);
     imageListWidget->addItem(item);
+    
+    // 缩略图在后台解码, 不阻塞界面
+    thumbnailLoader->request(path);
+}
+
+void ImageList::onThumbnailReady(const QString &path, const QImage &image)
+{
+    if (image.isNull()) return;
+    
+    // 同一路径可能被添加多次, 全部更新
+    const QIcon icon(QPixmap::fromImage(image));
+    for (int i = 0; i < imageListWidget->count(); ++i) {
+        QListWidgetItem *item = imageListWidget->item(i);
+        if (item->data(Qt::UserRole).toString() == path) {
+            item->setIcon(icon);
+        }
+    }
 }
 
 void ImageList::addImages(const QStringList &paths)
@@ -132,8 +172,9 @@ void ImageList::addImages(const QStringList &paths)
 
 void ImageList::clear()
 {
+    thumbnailLoader->cancelPending();
     imageListWidget->clear();
-    currentPixmap = QPixmap();
+    currentImage = QImage();
     currentPath = QString();
 }
 
@@ -154,9 +195,9 @@ void ImageList::setCurrentItem(QListWidgetItem* item)
     }
 }
 
-QPixmap ImageList::getCurrentPixmap() const
+QImage ImageList::getCurrentImage() const
 {
-    return currentPixmap;
+    return currentImage;
 }
 
 void ImageList::onItemClicked(QListWidgetItem *item)
@@ -167,15 +208,40 @@ void ImageList::onItemClicked(QListWidgetItem *item)
     QString imagePath = item->data(Qt::UserRole).toString();
     qDebug() << "选中图片: " << imagePath;
     
-    // 如果路径不为空，加载图片
-    if (!imagePath.isEmpty()) {
-        QPixmap pixmap(imagePath);
-        if (!pixmap.isNull()) {
-            currentPixmap = pixmap;
+    // 超大图片按分块打开, 像素在访问时才解码, 不进入解码缓存
+    if (!imagePath.isEmpty() && TiledImageStore::isLargeImage(imagePath)) {
+        QString error;
+        if (std::shared_ptr<TiledImageStore> store = TiledImageStore::open(imagePath, &error)) {
+            currentImage = QImage();
+            currentPath = imagePath;
+            emit tiledImageSelected(store, imagePath);
+        } else {
+            qWarning() << "无法打开图片" << imagePath << error;
+        }
+    }
+    // 如果路径不为空，从缓存加载图片
+    else if (!imagePath.isEmpty()) {
+        QImage image = imageCache->load(imagePath);
+        if (!image.isNull()) {
+            currentImage = image;
             currentPath = imagePath;
-            emit imageSelected(pixmap, imagePath);
+            emit imageSelected(image, imagePath);
+        }
+    }
+    
+    // 浏览时预先解码前后两张
+    prefetchNeighbours(imageListWidget->row(item));
+}
+
+void ImageList::prefetchNeighbours(int row)
+{
+    QStringList paths;
+    for (int neighbour : { row + 1, row - 1 }) {
+        if (QListWidgetItem *item = imageListWidget->item(neighbour)) {
+            paths << item->data(Qt::UserRole).toString();
         }
     }
+    imageCache->prefetch(paths);
 }
 
 void ImageList::showContextMenu(const QPoint &pos)
@@ -226,7 +292,7 @@ void ImageList::deleteCurrentItem()
             onItemClicked(newItem);
         } else {
             // 如果没有图片了，清空当前图片
-            currentPixmap = QPixmap();
+            currentImage = QImage();
             currentPath = QString();
             emit imageDeleted(path);
         }
@@ -9,13 +9,19 @@
 #include <QMenu>
 #include <QAction>
 #include <QPixmap>
+#include <QIcon>
+#include <memory>
+#include "thumbnailloader.h"
+#include "imagecache.h"
+#include "tiledimagestore.h"
 
 class ImageList : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit ImageList(QWidget *parent = nullptr);
+    // cache 为解码图像缓存, 由调用方持有
+    explicit ImageList(ImageCache *cache, QWidget *parent = nullptr);
     ~ImageList();
 
     // 获取图片列表停靠窗口
@@ -36,11 +42,13 @@ public:
     void setCurrentItem(QListWidgetItem* item);
 
     // 获取当前显示图片
-    QPixmap getCurrentPixmap() const;
+    QImage getCurrentImage() const;
 
 signals:
     // 图片选中信号
-    void imageSelected(const QPixmap &pixmap, const QString &path);
+    void imageSelected(const QImage &image, const QString &path);
+    // 超大图片不整图解码, 以分块存储的形式选中
+    void tiledImageSelected(const std::shared_ptr<TiledImageStore> &store, const QString &path);
     // 图片删除信号
     void imageDeleted(const QString &path);
 
@@ -53,13 +61,23 @@ private slots:
     void handleFloatingChanged(bool isFloating);
     // 处理停靠区域变化
     void onDockLocationChanged(Qt::DockWidgetArea area);
+    // 缩略图解码完成
+    void onThumbnailReady(const QString &path, const QImage &image);
 
 private:
     QDockWidget *imageListDock;
     QListWidget *imageListWidget;
-    QPixmap currentPixmap;
+    QImage currentImage;
     QString currentPath;
 
+    // 已解码图像缓存, 点击时优先从中取出, 并预取前后两张
+    ImageCache *imageCache;
+    void prefetchNeighbours(int row);
+
+    // 后台解码缩略图, 完成前显示占位图标
+    ThumbnailLoader *thumbnailLoader;
+    QIcon placeholderIcon;
+
     // 初始化界面和样式
     void initUi();
     void initStyles();
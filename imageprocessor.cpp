@@ -0,0 +1,779 @@
+﻿#include "imageprocessor.h"
+#include "cannydetector.h"
+#include "imagekernels.h"
+#include "mosaicengine.h"
+#include "pointstage.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+#include <QDebug>
+#include <QMutex>
+#include <QVector>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// 逐点操作: 分块并行, 每个分块逐行调用 rowKernel(src, dst, count)
+template <typename RowKernel>
+QImage runPointKernel(const QImage &input, const std::atomic<bool> *cancel, RowKernel rowKernel)
+{
+    QImage output(input.size(), ImageProcessor::WorkingFormat);
+    const uchar *srcBits = input.constBits();
+    const qsizetype srcStride = input.bytesPerLine();
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+
+    const bool finished = TileScheduler::run(input.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            rowKernel(srcBits + y * srcStride + tile.left() * 4,
+                      dstBits + y * dstStride + tile.left() * 4, tile.width());
+        }
+    }, cancel);
+    return finished ? output : QImage();
+}
+
+// 均值滤波的一个分块: 先按列维护窗口内的纵向和, 再沿行滑动求横向和
+// 越界的行列取最近的边界像素; 分块左右各多算 radius 列的纵向和, 上下只在开始时累加一次窗口
+void boxFilterTile(const QImage &input, uchar *dstBits, qsizetype dstStride, const QRect &tile, int radius)
+{
+    const int width = input.width();
+    const int height = input.height();
+    const uchar *srcBits = input.constBits();
+    const qsizetype srcStride = input.bytesPerLine();
+    const int window = 2 * radius + 1;
+    const int span = tile.width() + 2 * radius;
+
+    // 每列对应的源像素偏移(已按边界钳制)
+    std::vector<int> columnOffset(span);
+    for (int i = 0; i < span; ++i) {
+        columnOffset[i] = qBound(0, tile.left() - radius + i, width - 1) * 4;
+    }
+    auto sourceRow = [&](int y) {
+        return srcBits + qBound(0, y, height - 1) * srcStride;
+    };
+
+    // 纵向和初始化为 tile.top() 所在窗口
+    std::vector<quint32> columnSum(size_t(span) * 3, 0);
+    for (int dy = -radius; dy <= radius; ++dy) {
+        const uchar *row = sourceRow(tile.top() + dy);
+        for (int i = 0; i < span; ++i) {
+            const uchar *p = row + columnOffset[i];
+            columnSum[i * 3] += p[0];
+            columnSum[i * 3 + 1] += p[1];
+            columnSum[i * 3 + 2] += p[2];
+        }
+    }
+
+    // 用乘法代替除法: sum 不超过 256 * n, n 不超过 2^16 时 (sum * m) >> 40 与 sum / n 相同
+    const quint32 area = quint32(window) * quint32(window);
+    const quint64 reciprocal = ((quint64(1) << 40) + area - 1) / area;
+    const quint32 half = area / 2;
+
+    for (int y = tile.top(); y <= tile.bottom(); ++y) {
+        if (y > tile.top()) {
+            const uchar *added = sourceRow(y + radius);
+            const uchar *removed = sourceRow(y - radius - 1);
+            for (int i = 0; i < span; ++i) {
+                const uchar *a = added + columnOffset[i];
+                const uchar *r = removed + columnOffset[i];
+                columnSum[i * 3] += a[0] - r[0];
+                columnSum[i * 3 + 1] += a[1] - r[1];
+                columnSum[i * 3 + 2] += a[2] - r[2];
+            }
+        }
+
+        quint32 sum[3] = { 0, 0, 0 };
+        for (int i = 0; i < window; ++i) {
+            sum[0] += columnSum[i * 3];
+            sum[1] += columnSum[i * 3 + 1];
+            sum[2] += columnSum[i * 3 + 2];
+        }
+
+        const uchar *src = sourceRow(y) + tile.left() * 4;
+        uchar *dst = dstBits + y * dstStride + tile.left() * 4;
+        for (int x = 0; x < tile.width(); ++x, src += 4, dst += 4) {
+            dst[0] = uchar(((sum[0] + half) * reciprocal) >> 40);
+            dst[1] = uchar(((sum[1] + half) * reciprocal) >> 40);
+            dst[2] = uchar(((sum[2] + half) * reciprocal) >> 40);
+            dst[3] = src[3];
+            if (x + 1 < tile.width()) {
+                const int in = (x + window) * 3, out = x * 3;
+                sum[0] += columnSum[in] - columnSum[out];
+                sum[1] += columnSum[in + 1] - columnSum[out + 1];
+                sum[2] += columnSum[in + 2] - columnSum[out + 2];
+            }
+        }
+    }
+}
+
+// 均值滤波的分块执行; epilogue 不为空时, 每个分块算完后立即在缓存中完成其后的点运算
+QImage meanFilterTiles(const QImage &input, int radius, const PointStage *epilogue,
+                       const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "meanFilter");
+    if (input.isNull()) return QImage();
+
+    radius = qBound(1, radius, ImageProcessor::MaxMeanRadius);
+    const int width = input.width();
+    const int height = input.height();
+    QImage output(input.size(), ImageProcessor::WorkingFormat);
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+
+    // 3x3 的内部区域使用 SIMD 内核, 只剩一像素宽的边框走通用路径, 两者舍入方式相同
+    if (radius == 1 && width >= 3 && height >= 3) {
+        const ImageKernels::KernelTable &k = ImageKernels::kernels();
+        const uchar *srcBits = input.constBits();
+        const qsizetype srcStride = input.bytesPerLine();
+        bool finished = TileScheduler::run(QRect(1, 1, width - 2, height - 2), 4, [&](const QRect &tile) {
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                const uchar *row = srcBits + y * srcStride;
+                k.mean3x3(row - srcStride, row, row + srcStride, dstBits + y * dstStride,
+                          tile.left(), tile.right() + 1);
+            }
+            if (epilogue) epilogue->applyRect(dstBits, dstStride, tile);
+        }, cancel);
+        if (!finished) return QImage();
+
+        const QRect border[4] = { QRect(0, 0, width, 1), QRect(0, height - 1, width, 1),
+                                  QRect(0, 1, 1, height - 2), QRect(width - 1, 1, 1, height - 2) };
+        for (const QRect &rect : border) {
+            boxFilterTile(input, dstBits, dstStride, rect, radius);
+            if (epilogue) epilogue->applyRect(dstBits, dstStride, rect);
+        }
+        return output;
+    }
+
+    // 分块越高, 初始化窗口的开销占比越小; 宽度额外计算的 2r 列同理
+    const QSize tileSize(qMax(256, 8 * radius), qMax(64, 8 * (2 * radius + 1)));
+    const bool finished = TileScheduler::run(input.rect(), tileSize, [&](const QRect &tile) {
+        boxFilterTile(input, dstBits, dstStride, tile, radius);
+        if (epilogue) epilogue->applyRect(dstBits, dstStride, tile);
+    }, cancel);
+    return finished ? output : QImage();
+}
+
+// Sobel 边缘检测的分块执行, epilogue 同上
+// 在完整的灰度平面上计算 Sobel 梯度, 分块边缘的邻域直接读灰度平面
+// 边界像素为不透明黑色; 宽或高小于 3 时不读取灰度平面
+QImage sobelFromGray(const uchar *grayBits, qsizetype grayStride, int width, int height, int threshold,
+                     const PointStage *epilogue, const std::atomic<bool> *cancel)
+{
+    QImage output(width, height, ImageProcessor::WorkingFormat);
+    output.fill(QColor(0, 0, 0, 255));
+    if (width < 3 || height < 3) {
+        if (epilogue) epilogue->applyRect(output.bits(), output.bytesPerLine(), output.rect());
+        return output;
+    }
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+
+    const bool finished = TileScheduler::run(QRect(1, 1, width - 2, height - 2), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            const uchar *row = grayBits + y * grayStride;
+            k.sobel(row - grayStride, row, row + grayStride, dstBits + y * dstStride,
+                    tile.left(), tile.right() + 1, threshold);
+        }
+        if (epilogue) epilogue->applyRect(dstBits, dstStride, tile);
+    }, cancel);
+    if (!finished) return QImage();
+
+    if (epilogue) {
+        const QRect border[4] = { QRect(0, 0, width, 1), QRect(0, height - 1, width, 1),
+                                  QRect(0, 1, 1, height - 2), QRect(width - 1, 1, 1, height - 2) };
+        for (const QRect &rect : border) {
+            epilogue->applyRect(dstBits, dstStride, rect);
+        }
+    }
+    return output;
+}
+
+QImage edgeDetectionTiles(const QImage &input, int threshold, const PointStage *epilogue,
+                          const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "edgeDetection");
+    if (input.isNull()) return QImage();
+
+    const int width = input.width();
+    const int height = input.height();
+    if (width < 3 || height < 3) {
+        return sobelFromGray(nullptr, 0, width, height, threshold, epilogue, cancel);
+    }
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    const uchar *srcBits = input.constBits();
+    const qsizetype srcStride = input.bytesPerLine();
+
+    // 先转换为灰度平面
+    QVector<uchar> gray(qsizetype(width) * height);
+    uchar *grayBits = gray.data();
+    const bool finished = TileScheduler::run(input.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            k.lumaRow(srcBits + y * srcStride + tile.left() * 4,
+                      grayBits + qsizetype(y) * width + tile.left(), tile.width());
+        }
+    }, cancel);
+    if (!finished) return QImage();
+
+    return sobelFromGray(grayBits, width, width, height, threshold, epilogue, cancel);
+}
+
+// 最近一次 Canny 预览的输入与梯度: 拖动阈值滑块时输入不变, 只需重做抑制与连接
+// 键为输入图像的 cacheKey, 0 表示不缓存; 只由 applyPreview 读写
+struct CannyGradientCache
+{
+    QMutex mutex;
+    qint64 key = 0;
+    std::shared_ptr<const CannyDetector::Gradient> gradient;
+};
+
+CannyGradientCache &cannyGradientCache()
+{
+    static CannyGradientCache cache;
+    return cache;
+}
+
+std::shared_ptr<const CannyDetector::Gradient> cachedCannyGradient(qint64 key)
+{
+    if (key == 0) return nullptr;
+    CannyGradientCache &cache = cannyGradientCache();
+    QMutexLocker locker(&cache.mutex);
+    return cache.key == key ? cache.gradient : nullptr;
+}
+
+void storeCannyGradient(qint64 key, const std::shared_ptr<const CannyDetector::Gradient> &gradient)
+{
+    if (key == 0) return;
+    CannyGradientCache &cache = cannyGradientCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.key = key;
+    cache.gradient = gradient;
+}
+
+// 抑制与连接, 只有强边缘展开为白色像素, 未连接的弱边缘在查找表中归零
+QImage cannyFromGradient(const CannyDetector::Gradient &gradient, int lowThreshold, int highThreshold,
+                         const PointStage *epilogue, const std::atomic<bool> *cancel)
+{
+    const int width = gradient.width;
+    const int height = gradient.height;
+    std::vector<uchar> edges(size_t(width) * height);
+    if (!CannyDetector::detect(gradient, lowThreshold, highThreshold, edges.data(), cancel)) return QImage();
+
+    uchar lut[256] = {};
+    lut[CannyDetector::StrongEdge] = 255;
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    QImage output(width, height, ImageProcessor::WorkingFormat);
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+    const bool finished = TileScheduler::run(output.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            k.expandGray(edges.data() + qsizetype(y) * width + tile.left(),
+                         dstBits + y * dstStride + tile.left() * 4, tile.width(), lut);
+        }
+        if (epilogue) epilogue->applyRect(dstBits, dstStride, tile);
+    }, cancel);
+    return finished ? output : QImage();
+}
+
+// 在灰度平面上做 Canny
+QImage cannyFromGray(const uchar *grayBits, qsizetype grayStride, int width, int height,
+                     int lowThreshold, int highThreshold, const PointStage *epilogue,
+                     const std::atomic<bool> *cancel)
+{
+    const std::shared_ptr<const CannyDetector::Gradient> gradient =
+        CannyDetector::computeGradient(grayBits, grayStride, width, height, cancel);
+    if (!gradient) return QImage();
+    return cannyFromGradient(*gradient, lowThreshold, highThreshold, epilogue, cancel);
+}
+
+QImage cannyTiles(const QImage &input, int lowThreshold, int highThreshold, const PointStage *epilogue,
+                  const std::atomic<bool> *cancel, bool cacheGradient = false)
+{
+    TRACE_SCOPE("kernel", "canny");
+    if (input.isNull()) return QImage();
+
+    std::shared_ptr<const CannyDetector::Gradient> gradient;
+    if (cacheGradient) {
+        gradient = cachedCannyGradient(input.cacheKey());
+    }
+    if (!gradient) {
+        const int width = input.width();
+        const int height = input.height();
+        const ImageKernels::KernelTable &k = ImageKernels::kernels();
+        const uchar *srcBits = input.constBits();
+        const qsizetype srcStride = input.bytesPerLine();
+
+        QVector<uchar> gray(qsizetype(width) * height);
+        uchar *grayBits = gray.data();
+        const bool finished = TileScheduler::run(input.rect(), 4, [&](const QRect &tile) {
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                k.lumaRow(srcBits + y * srcStride + tile.left() * 4,
+                          grayBits + qsizetype(y) * width + tile.left(), tile.width());
+            }
+        }, cancel);
+        if (!finished) return QImage();
+
+        gradient = CannyDetector::computeGradient(grayBits, width, width, height, cancel);
+        if (!gradient) return QImage();
+        if (cacheGradient) {
+            storeCannyGradient(input.cacheKey(), gradient);
+        }
+    }
+    return cannyFromGradient(*gradient, lowThreshold, highThreshold, epilogue, cancel);
+}
+
+// 亮度值到灰度值: 有限范围(16-235)扩展到 0-255, 全范围不变
+void buildLumaLut(bool fullRange, uchar *lut)
+{
+    for (int i = 0; i < 256; ++i) {
+        lut[i] = fullRange ? uchar(i) : uchar(qBound(0, ((i - 16) * 298 + 128) >> 8, 255));
+    }
+}
+
+// YUV 的一行 [x0, x0 + count) 转为 RGBA; 奇数起点先单独转换一个像素, 使之后的色度样本对齐
+void yuvRowToRgba(const ImageKernels::KernelTable &k, const YuvPlanes &planes,
+                  const ImageKernels::YuvCoefficients &coefficients, int y, int x0, int count, uchar *dst)
+{
+    const uchar *yRow = planes.y + y * planes.yStride;
+    const qsizetype chromaRow = qsizetype(y / 2) * planes.uvStride;
+    auto chromaU = [&](int x) { return planes.u + chromaRow + (x / 2) * planes.uvStep; };
+    auto chromaV = [&](int x) { return planes.v + chromaRow + (x / 2) * planes.uvStep; };
+
+    if ((x0 & 1) && count > 0) {
+        k.yuvToRgba(yRow + x0, chromaU(x0), chromaV(x0), planes.uvStep, dst, 1, coefficients);
+        ++x0;
+        --count;
+        dst += 4;
+    }
+    if (count > 0) {
+        k.yuvToRgba(yRow + x0, chromaU(x0), chromaV(x0), planes.uvStep, dst, count, coefficients);
+    }
+}
+
+} // namespace
+
+ImageOperation ImageOperation::grayscale()
+{
+    ImageOperation op;
+    op.type = Grayscale;
+    return op;
+}
+
+ImageOperation ImageOperation::binarize(int threshold)
+{
+    ImageOperation op;
+    op.type = Binarize;
+    op.threshold = threshold;
+    return op;
+}
+
+ImageOperation ImageOperation::meanFilter(int radius)
+{
+    ImageOperation op;
+    op.type = MeanFilter;
+    op.radius = radius;
+    return op;
+}
+
+ImageOperation ImageOperation::gammaTransform(float gamma)
+{
+    ImageOperation op;
+    op.type = Gamma;
+    op.gamma = gamma;
+    return op;
+}
+
+ImageOperation ImageOperation::edgeDetection(int threshold)
+{
+    ImageOperation op;
+    op.type = EdgeDetection;
+    op.threshold = threshold;
+    return op;
+}
+
+ImageOperation ImageOperation::canny(int lowThreshold, int highThreshold)
+{
+    ImageOperation op;
+    op.type = Canny;
+    op.lowThreshold = lowThreshold;
+    op.threshold = highThreshold;
+    return op;
+}
+
+ImageOperation ImageOperation::mosaic(const QVector<MosaicDab> &dabs)
+{
+    ImageOperation op;
+    op.type = Mosaic;
+    op.mosaicDabs = dabs;
+    return op;
+}
+
+ImageOperation ImageOperation::levels(int blackPoint, int whitePoint, float gamma)
+{
+    ImageOperation op;
+    op.type = Levels;
+    op.blackPoint = blackPoint;
+    op.whitePoint = whitePoint;
+    op.gamma = gamma;
+    return op;
+}
+
+ImageOperation ImageOperation::scaled(qreal factor) const
+{
+    ImageOperation op = *this;
+    if (type == MeanFilter) {
+        op.radius = qMax(1, qRound(radius * factor));
+    }
+    return op;
+}
+
+int ImageProcessor::neighbourhoodRadius(const ImageOperation &operation)
+{
+    switch (operation.type) {
+    case ImageOperation::MeanFilter:
+        return qBound(1, operation.radius, MaxMeanRadius);
+    case ImageOperation::EdgeDetection:
+        return 1;
+    case ImageOperation::Mosaic:
+    case ImageOperation::Canny:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+QRect ImageProcessor::damagedRect(const ImageOperation &operation, const QSize &size)
+{
+    const QRect whole(QPoint(0, 0), size);
+    switch (operation.type) {
+    case ImageOperation::None:
+        return QRect();
+    case ImageOperation::Mosaic: {
+        QRect damage;
+        for (const MosaicDab &dab : operation.mosaicDabs) {
+            damage = damage.united(MosaicEngine::dabBounds(dab, size));
+        }
+        return damage;
+    }
+    default:
+        return whole;
+    }
+}
+
+QVector<ImagePatch> ImageProcessor::extractPatches(const QImage &image, const QVector<QRect> &rects)
+{
+    QVector<ImagePatch> patches;
+    const QImage input = toWorkingFormat(image);
+    for (const QRect &rect : rects) {
+        const QRect area = rect & input.rect();
+        if (area.isEmpty()) continue;
+        patches.append({ area, input.copy(area) });
+    }
+    return patches;
+}
+
+void ImageProcessor::applyPatches(QImage &target, const QVector<ImagePatch> &patches)
+{
+    TRACE_SCOPE("kernel", "applyPatches");
+    if (target.format() != WorkingFormat) {
+        target = toWorkingFormat(target);
+    }
+    for (const ImagePatch &patch : patches) {
+        const QImage pixels = toWorkingFormat(patch.pixels);
+        const QRect area = patch.rect & target.rect() & QRect(patch.rect.topLeft(), pixels.size());
+        if (area.isEmpty()) continue;
+
+        const int offsetX = area.left() - patch.rect.left();
+        const int offsetY = area.top() - patch.rect.top();
+        const qsizetype bytes = qsizetype(area.width()) * 4;
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            memcpy(target.scanLine(y) + area.left() * 4,
+                   pixels.constScanLine(y - area.top() + offsetY) + offsetX * 4, bytes);
+        }
+    }
+}
+
+QImage ImageProcessor::toWorkingFormat(const QImage &src)
+{
+    if (src.format() == WorkingFormat) {
+        return src;
+    }
+    return src.convertToFormat(WorkingFormat);
+}
+
+void ImageProcessor::copyMetadata(const QImage &source, QImage &target)
+{
+    if (target.isNull()) return;
+    target.setColorSpace(source.colorSpace());
+    target.setDotsPerMeterX(source.dotsPerMeterX());
+    target.setDotsPerMeterY(source.dotsPerMeterY());
+    const QStringList keys = source.textKeys();
+    for (const QString &key : keys) {
+        target.setText(key, source.text(key));
+    }
+}
+
+QImage ImageProcessor::grayscale(const QImage &src, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "grayscale");
+    const QImage input = toWorkingFormat(src);
+    if (input.isNull()) return QImage();
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    return runPointKernel(input, cancel, [&k](const uchar *src, uchar *dst, int count) {
+        k.grayscale(src, dst, count);
+    });
+}
+
+QImage ImageProcessor::binarize(const QImage &src, int threshold, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "binarize");
+    const QImage input = toWorkingFormat(src);
+    if (input.isNull()) return QImage();
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    return runPointKernel(input, cancel, [&k, threshold](const uchar *src, uchar *dst, int count) {
+        k.binarize(src, dst, count, threshold);
+    });
+}
+
+QImage ImageProcessor::meanFilter(const QImage &src, int radius, const std::atomic<bool> *cancel)
+{
+    return meanFilterTiles(toWorkingFormat(src), radius, nullptr, cancel);
+}
+
+QImage ImageProcessor::gammaTransform(const QImage &src, float gamma, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "gamma");
+    const QImage input = toWorkingFormat(src);
+    if (input.isNull()) return QImage();
+
+    // 查找表
+    uchar lut[256];
+    if (!PointStage::buildLut(ImageOperation::gammaTransform(gamma), lut)) return QImage();
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    return runPointKernel(input, cancel, [&k, &lut](const uchar *src, uchar *dst, int count) {
+        k.applyLut(src, dst, count, lut);
+    });
+}
+
+QImage ImageProcessor::levels(const QImage &src, int blackPoint, int whitePoint, float gamma,
+                              const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "levels");
+    const QImage input = toWorkingFormat(src);
+    if (input.isNull()) return QImage();
+
+    uchar lut[256];
+    if (!PointStage::buildLut(ImageOperation::levels(blackPoint, whitePoint, gamma), lut)) return QImage();
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    return runPointKernel(input, cancel, [&k, &lut](const uchar *src, uchar *dst, int count) {
+        k.applyLut(src, dst, count, lut);
+    });
+}
+
+QImage ImageProcessor::edgeDetection(const QImage &src, int threshold, const std::atomic<bool> *cancel)
+{
+    return edgeDetectionTiles(toWorkingFormat(src), threshold, nullptr, cancel);
+}
+
+QImage ImageProcessor::canny(const QImage &src, int lowThreshold, int highThreshold,
+                             const std::atomic<bool> *cancel)
+{
+    return cannyTiles(toWorkingFormat(src), lowThreshold, highThreshold, nullptr, cancel);
+}
+
+bool ImageProcessor::isLumaOperation(const ImageOperation &operation)
+{
+    return operation.type == ImageOperation::Grayscale
+        || operation.type == ImageOperation::Binarize
+        || operation.type == ImageOperation::EdgeDetection
+        || operation.type == ImageOperation::Canny;
+}
+
+QImage ImageProcessor::yuvToRgba(const YuvPlanes &planes, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "yuvToRgba");
+    if (!planes.isValid()) return QImage();
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    const ImageKernels::YuvCoefficients coefficients = ImageKernels::yuvCoefficients(planes.bt709, planes.fullRange);
+
+    QImage output(planes.width, planes.height, WorkingFormat);
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+
+    const bool finished = TileScheduler::run(output.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            yuvRowToRgba(k, planes, coefficients, y, tile.left(), tile.width(),
+                         dstBits + y * dstStride + tile.left() * 4);
+        }
+    }, cancel);
+    return finished ? output : QImage();
+}
+
+QImage ImageProcessor::applyToYuv(const YuvPlanes &planes, const ImageOperation &operation,
+                                  const std::atomic<bool> *cancel)
+{
+    if (!planes.isValid()) return QImage();
+    if (!isLumaOperation(operation)) {
+        const QImage rgba = yuvToRgba(planes, cancel);
+        if (rgba.isNull()) return QImage();
+        return operation.isValid() ? apply(rgba, operation, cancel) : rgba;
+    }
+
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    const int width = planes.width;
+    const int height = planes.height;
+    uchar lumaLut[256];
+    buildLumaLut(planes.fullRange, lumaLut);
+
+    if (operation.type == ImageOperation::EdgeDetection || operation.type == ImageOperation::Canny) {
+        TRACE_SCOPE("kernel", operation.type == ImageOperation::Canny ? "canny.yuv" : "edgeDetection.yuv");
+        auto detect = [&](const uchar *grayBits, qsizetype grayStride) {
+            return operation.type == ImageOperation::Canny
+                ? cannyFromGray(grayBits, grayStride, width, height, operation.lowThreshold,
+                                operation.threshold, nullptr, cancel)
+                : sobelFromGray(grayBits, grayStride, width, height, operation.threshold, nullptr, cancel);
+        };
+        if (planes.fullRange || width < 3 || height < 3) {
+            return detect(planes.y, planes.yStride);
+        }
+
+        // 有限范围先扩展为灰度平面, 使阈值与 RGB 图像的灰度尺度一致
+        QVector<uchar> gray(qsizetype(width) * height);
+        uchar *grayBits = gray.data();
+        const bool finished = TileScheduler::run(QRect(0, 0, width, height), 1, [&](const QRect &tile) {
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                const uchar *src = planes.y + y * planes.yStride;
+                uchar *dst = grayBits + qsizetype(y) * width;
+                for (int x = tile.left(); x <= tile.right(); ++x) {
+                    dst[x] = lumaLut[src[x]];
+                }
+            }
+        }, cancel);
+        if (!finished) return QImage();
+        return detect(grayBits, width);
+    }
+
+    // 灰度化与二值化都是亮度的查找表, 与范围扩展合成为一张表
+    TRACE_SCOPE("kernel", operation.type == ImageOperation::Grayscale ? "grayscale.yuv" : "binarize.yuv");
+    uchar lut[256];
+    for (int i = 0; i < 256; ++i) {
+        lut[i] = operation.type == ImageOperation::Grayscale
+            ? lumaLut[i]
+            : (lumaLut[i] > operation.threshold ? 255 : 0);
+    }
+
+    QImage output(width, height, WorkingFormat);
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+    const bool finished = TileScheduler::run(output.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            k.expandGray(planes.y + y * planes.yStride + tile.left(),
+                         dstBits + y * dstStride + tile.left() * 4, tile.width(), lut);
+        }
+    }, cancel);
+    return finished ? output : QImage();
+}
+
+QImage ImageProcessor::mosaic(const QImage &src, const QVector<MosaicDab> &dabs,
+                              const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "mosaic");
+    // 块平均色取自积分图, 只为画过的分块建立积分图
+    MosaicEngine engine(src);
+    if (engine.isNull()) return QImage();
+
+    for (const MosaicDab &dab : dabs) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return QImage();
+        engine.paint(dab);
+    }
+    return engine.result();
+}
+
+QImage ImageProcessor::apply(const QImage &src, const ImageOperation &operation,
+                             const std::atomic<bool> *cancel)
+{
+    switch (operation.type) {
+    case ImageOperation::Grayscale:
+        return grayscale(src, cancel);
+    case ImageOperation::Binarize:
+        return binarize(src, operation.threshold, cancel);
+    case ImageOperation::MeanFilter:
+        return meanFilter(src, operation.radius, cancel);
+    case ImageOperation::Gamma:
+        return gammaTransform(src, operation.gamma, cancel);
+    case ImageOperation::EdgeDetection:
+        return edgeDetection(src, operation.threshold, cancel);
+    case ImageOperation::Mosaic:
+        return mosaic(src, operation.mosaicDabs, cancel);
+    case ImageOperation::Levels:
+        return levels(src, operation.blackPoint, operation.whitePoint, operation.gamma, cancel);
+    case ImageOperation::Canny:
+        return canny(src, operation.lowThreshold, operation.threshold, cancel);
+    default:
+        return toWorkingFormat(src);
+    }
+}
+
+QImage ImageProcessor::applyPreview(const QImage &src, const ImageOperation &operation,
+                                    const std::atomic<bool> *cancel)
+{
+    if (operation.type == ImageOperation::Canny) {
+        return cannyTiles(toWorkingFormat(src), operation.lowThreshold, operation.threshold, nullptr, cancel, true);
+    }
+    return apply(src, operation, cancel);
+}
+
+QImage ImageProcessor::applyChain(const QImage &src, const QVector<ImageOperation> &operations,
+                                  const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("kernel", "applyChain");
+    QImage result = toWorkingFormat(src);
+    int i = 0;
+    while (i < operations.size() && !result.isNull()) {
+        // 连续的点运算合成为一个阶段
+        if (PointStage::isPointOperation(operations.at(i))) {
+            PointStage stage;
+            for (; i < operations.size() && PointStage::isPointOperation(operations.at(i)); ++i) {
+                if (!stage.append(operations.at(i))) return QImage();
+            }
+            result = stage.run(result, cancel);
+            continue;
+        }
+
+        // 邻域运算之后的点运算作为分块的收尾, 在同一次遍历中完成
+        const ImageOperation &operation = operations.at(i++);
+        PointStage epilogue;
+        for (; i < operations.size() && PointStage::isPointOperation(operations.at(i)); ++i) {
+            if (!epilogue.append(operations.at(i))) return QImage();
+        }
+        const PointStage *tail = epilogue.isIdentity() ? nullptr : &epilogue;
+
+        if (operation.type == ImageOperation::MeanFilter) {
+            result = meanFilterTiles(result, operation.radius, tail, cancel);
+        } else if (operation.type == ImageOperation::EdgeDetection) {
+            result = edgeDetectionTiles(result, operation.threshold, tail, cancel);
+        } else if (operation.type == ImageOperation::Canny) {
+            result = cannyTiles(result, operation.lowThreshold, operation.threshold, tail, cancel);
+        } else {
+            result = apply(result, operation, cancel);
+            if (tail && !result.isNull()) {
+                result = tail->run(result, cancel);
+            }
+        }
+    }
+    // 各阶段新建的结果图像不带元数据, 保存时需要原图的色彩空间、分辨率与文字信息
+    if (!result.isNull() && result.cacheKey() != src.cacheKey()) {
+        copyMetadata(src, result);
+    }
+    return result;
+}
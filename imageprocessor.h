@@ -0,0 +1,155 @@
+﻿#ifndef IMAGEPROCESSOR_H
+#define IMAGEPROCESSOR_H
+
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <QVector>
+#include <atomic>
+
+// 马赛克画笔的一次落笔, 坐标与尺寸均以图像宽度为单位, 与分辨率无关
+struct MosaicDab
+{
+    QPointF center;
+    qreal radius = 0;
+    qreal blockSize = 0;
+};
+
+// 一次处理操作及其参数, 可在任意分辨率上重放
+struct ImageOperation
+{
+    enum Type {
+        None,
+        Grayscale,
+        Binarize,
+        MeanFilter,
+        Gamma,
+        EdgeDetection,
+        Mosaic,
+        Levels,
+        Canny
+    };
+
+    Type type = None;
+    int threshold = 0;          // 二值化与边缘检测的阈值, Canny 为高阈值
+    int lowThreshold = 0;       // Canny 的低阈值
+    int radius = 1;
+    int blackPoint = 0;
+    int whitePoint = 255;
+    float gamma = 1.0f;
+    QVector<MosaicDab> mosaicDabs;
+
+    bool isValid() const { return type != None; }
+
+    // 以像素为单位的参数(均值滤波半径)按分辨率缩放, 用于在代理图上预览主图的操作
+    ImageOperation scaled(qreal factor) const;
+
+    static ImageOperation grayscale();
+    static ImageOperation binarize(int threshold);
+    static ImageOperation meanFilter(int radius = 1);
+    static ImageOperation gammaTransform(float gamma);
+    static ImageOperation edgeDetection(int threshold);
+    static ImageOperation mosaic(const QVector<MosaicDab> &dabs);
+    static ImageOperation levels(int blackPoint, int whitePoint, float gamma = 1.0f);
+    static ImageOperation canny(int lowThreshold, int highThreshold);
+};
+
+// 映射后的 4:2:0 视频帧平面, 数据由调用方持有
+// NV12: u 指向 UV 交错平面, v = u + 1, uvStep = 2 (NV21 则 u = v + 1)
+// I420: u、v 指向各自的平面, uvStep = 1 (YV12 只是平面顺序不同)
+struct YuvPlanes
+{
+    const uchar *y = nullptr;
+    qsizetype yStride = 0;
+    const uchar *u = nullptr;
+    const uchar *v = nullptr;
+    qsizetype uvStride = 0;
+    int uvStep = 1;
+    int width = 0;
+    int height = 0;
+    bool bt709 = false;     // 否则为 BT.601
+    bool fullRange = false; // 否则为有限范围(16-235)
+
+    bool isValid() const { return y && u && v && width > 0 && height > 0; }
+};
+
+// 图像上变化的一块矩形区域及其像素(工作格式)
+// 局部修改(画笔等)只传递和重绘这些区域, 不必整幅发送
+struct ImagePatch
+{
+    QRect rect;
+    QImage pixels;
+};
+
+// 图像处理引擎: 在 QImage 缓冲区上直接运行 SIMD 内核, 由 TileScheduler 分块并行
+// 所有结果统一为 QImage::Format_RGBA8888, 输入图像不会被修改
+// cancel 不为空时每个分块开始前检查一次, 置位后放弃计算并返回空图像
+class ImageProcessor
+{
+public:
+    // 工作格式, 与 Canvas 的 ImageData 字节顺序一致
+    static constexpr QImage::Format WorkingFormat = QImage::Format_RGBA8888;
+
+    // 灰度化: (R + G + B) / 3
+    static QImage grayscale(const QImage &src, const std::atomic<bool> *cancel = nullptr);
+    // 二值化: 灰度值大于阈值为白色, 否则为黑色
+    static QImage binarize(const QImage &src, int threshold, const std::atomic<bool> *cancel = nullptr);
+    // 均值滤波: (2r+1)x(2r+1) 窗口, 越界像素取最近的边界像素
+    // 行列方向滑动求和, 每像素耗时与半径无关
+    static constexpr int MaxMeanRadius = 100;
+    static QImage meanFilter(const QImage &src, int radius = 1, const std::atomic<bool> *cancel = nullptr);
+    // 伽马变换: 255 * (v / 255) ^ (1 / gamma)
+    static QImage gammaTransform(const QImage &src, float gamma, const std::atomic<bool> *cancel = nullptr);
+    // Sobel 边缘检测, 梯度幅值大于阈值为白色, 边界像素为黑色
+    static QImage edgeDetection(const QImage &src, int threshold, const std::atomic<bool> *cancel = nullptr);
+    // Canny 边缘检测: 5x5 高斯平滑后求 Sobel 梯度, 非极大值抑制细化为单像素宽,
+    // 梯度幅值大于高阈值的为边缘, 大于低阈值且与边缘相连的也是边缘; 阈值与 Sobel 边缘检测同一尺度
+    static QImage canny(const QImage &src, int lowThreshold, int highThreshold,
+                        const std::atomic<bool> *cancel = nullptr);
+    // 色阶: 输入 [black, white] 线性拉伸到 [0, 255], 再按 gamma 调整中间调
+    static QImage levels(const QImage &src, int blackPoint, int whitePoint, float gamma = 1.0f,
+                         const std::atomic<bool> *cancel = nullptr);
+    // 马赛克: 与画笔相交的块填充为块内平均色, 块网格以图像左上角对齐
+    static QImage mosaic(const QImage &src, const QVector<MosaicDab> &dabs,
+                         const std::atomic<bool> *cancel = nullptr);
+
+    // 执行单个操作或操作链
+    // 操作链中连续的点运算合成为一次遍历, 紧跟在邻域运算之后的点运算在同一分块内完成,
+    // 结果与逐个执行相同
+    static QImage apply(const QImage &src, const ImageOperation &operation,
+                        const std::atomic<bool> *cancel = nullptr);
+    static QImage applyChain(const QImage &src, const QVector<ImageOperation> &operations,
+                             const std::atomic<bool> *cancel = nullptr);
+    // 交互预览: 结果与 apply 相同, 但 Canny 的梯度按输入缓存, 拖动阈值滑块时只需重做抑制与连接
+    // 缓存只保留一份, 只在代理图预览上使用; 保存、导出与批处理不经过缓存
+    static QImage applyPreview(const QImage &src, const ImageOperation &operation,
+                               const std::atomic<bool> *cancel = nullptr);
+
+    // 直接处理视频帧平面
+    // 只依赖亮度的操作(灰度化、二值化、两种边缘检测)只读取 Y 平面, 不做颜色转换;
+    // 此时灰度值取扩展到全范围的 Y, 而不是 (R + G + B) / 3
+    // 其余操作先经 SIMD 内核转换为 RGBA 再执行
+    static bool isLumaOperation(const ImageOperation &operation);
+    static QImage yuvToRgba(const YuvPlanes &planes, const std::atomic<bool> *cancel = nullptr);
+    static QImage applyToYuv(const YuvPlanes &planes, const ImageOperation &operation,
+                             const std::atomic<bool> *cancel = nullptr);
+
+    // 操作读取的邻域半径(像素), 分带处理时每带上下需多读取的行数
+    // 需要整幅图像的操作(马赛克的块网格、Canny 的边缘连接)返回 -1
+    static int neighbourhoodRadius(const ImageOperation &operation);
+
+    // 局部更新
+    // 操作在 size 大小的图像上可能改变的区域: 马赛克为落笔覆盖的块, 其余操作为整幅图像
+    static QRect damagedRect(const ImageOperation &operation, const QSize &size);
+    // 复制 image 上各区域的像素(工作格式), 区域先与图像求交, 空区域被忽略
+    static QVector<ImagePatch> extractPatches(const QImage &image, const QVector<QRect> &rects);
+    // 把各区域的像素原地写入 target(工作格式); target 与其他图像共享数据时只复制一次
+    static void applyPatches(QImage &target, const QVector<ImagePatch> &patches);
+
+    // 转换为工作格式, 已是工作格式时不复制
+    static QImage toWorkingFormat(const QImage &src);
+    // 把 source 的色彩空间、分辨率与文字信息复制到 target, 像素不变
+    static void copyMetadata(const QImage &source, QImage &target);
+};
+
+#endif // IMAGEPROCESSOR_H
@@ -0,0 +1,126 @@
+﻿#include "imagepyramid.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+
+namespace {
+
+// 从分块存储建立第 1 层时每次读取的源图字节数
+constexpr qint64 ChunkBudget = TiledImageStore::LargeImagePixels;
+
+// 2x2 平均缩小: src 的 srcRows 行缩小为 dst 的 (srcRows + 1) / 2 行
+// 宽或高为奇数时最后一列(行)与自身平均
+bool halve(const uchar *srcBits, qsizetype srcStride, int srcWidth, int srcRows,
+           uchar *dstBits, qsizetype dstStride, const std::atomic<bool> *cancel)
+{
+    const QRect area(0, 0, (srcWidth + 1) / 2, (srcRows + 1) / 2);
+    return TileScheduler::run(area, 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            const uchar *row0 = srcBits + qsizetype(2 * y) * srcStride;
+            const uchar *row1 = srcBits + qsizetype(qMin(2 * y + 1, srcRows - 1)) * srcStride;
+            uchar *dst = dstBits + y * dstStride;
+            for (int x = tile.left(); x <= tile.right(); ++x) {
+                const int x0 = 2 * x * 4;
+                const int x1 = qMin(2 * x + 1, srcWidth - 1) * 4;
+                for (int c = 0; c < 4; ++c) {
+                    dst[x * 4 + c] = uchar((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+    }, cancel);
+}
+
+QSize halfSize(const QSize &size)
+{
+    return QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+}
+
+} // namespace
+
+std::shared_ptr<const ImagePyramid> ImagePyramid::build(const QImage &image, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("pyramid", "build");
+    const QImage base = ImageProcessor::toWorkingFormat(image);
+    if (base.isNull()) return nullptr;
+
+    std::shared_ptr<ImagePyramid> pyramid(new ImagePyramid);
+    pyramid->levels.append(base);
+    pyramid->sizes.append(base.size());
+    if (!pyramid->buildUpperLevels(cancel)) return nullptr;
+    return pyramid;
+}
+
+std::shared_ptr<const ImagePyramid> ImagePyramid::build(const std::shared_ptr<TiledImageStore> &store,
+                                                        const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("pyramid", "buildTiled");
+    if (!store) return nullptr;
+
+    std::shared_ptr<ImagePyramid> pyramid(new ImagePyramid);
+    pyramid->tiled = store;
+    pyramid->levels.append(QImage());
+    pyramid->sizes.append(store->size());
+
+    // 第 1 层按带从分块存储缩小, 每次只有一带源像素在内存中
+    if (!store->decodeAll()) return nullptr;
+    const QSize size = halfSize(store->size());
+    QImage level = TiledImageStore::createMappedImage(size);
+    if (level.isNull()) return nullptr;
+    uchar *levelBits = level.bits();
+    const qsizetype levelStride = level.bytesPerLine();
+    const int rowsPerRead = qMax(1, int(ChunkBudget / (qint64(store->width()) * 4 * 2))) * 2;
+
+    for (int top = 0; top < store->height(); top += rowsPerRead) {
+        const QImage band = store->region(QRect(0, top, store->width(), rowsPerRead), cancel);
+        if (band.isNull()) return nullptr;
+        if (!halve(band.constBits(), band.bytesPerLine(), band.width(), band.height(),
+                   levelBits + (top / 2) * levelStride, levelStride, cancel)) {
+            return nullptr;
+        }
+    }
+
+    pyramid->levels.append(level);
+    pyramid->sizes.append(size);
+    if (!pyramid->buildUpperLevels(cancel)) return nullptr;
+    return pyramid;
+}
+
+bool ImagePyramid::buildUpperLevels(const std::atomic<bool> *cancel)
+{
+    while (sizes.last().width() > TileSize || sizes.last().height() > TileSize) {
+        const QImage &source = levels.last();
+        QImage level(halfSize(source.size()), ImageProcessor::WorkingFormat);
+        if (level.isNull()) return false;
+        if (!halve(source.constBits(), source.bytesPerLine(), source.width(), source.height(),
+                   level.bits(), level.bytesPerLine(), cancel)) {
+            return false;
+        }
+        levels.append(level);
+        sizes.append(level.size());
+    }
+    return true;
+}
+
+qreal ImagePyramid::levelScale(int level) const
+{
+    return qreal(sizes.value(level).width()) / sizes.first().width();
+}
+
+int ImagePyramid::levelFor(const QSize &size) const
+{
+    const int lowest = tiled ? 1 : 0;
+    for (int level = levelCount() - 1; level > lowest; --level) {
+        if (sizes.at(level).width() >= size.width() && sizes.at(level).height() >= size.height()) {
+            return level;
+        }
+    }
+    return qMin(lowest, levelCount() - 1);
+}
+
+QImage ImagePyramid::region(int level, const QRect &rect) const
+{
+    if (level < 0 || level >= levelCount()) return QImage();
+    const QRect area = rect & QRect(QPoint(0, 0), sizes.at(level));
+    if (area.isEmpty()) return QImage();
+    if (level == 0 && tiled) return tiled->region(area);
+    return levels.at(level).copy(area);
+}
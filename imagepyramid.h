@@ -0,0 +1,49 @@
+﻿#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "tiledimagestore.h"
+
+// 多分辨率金字塔: 第 0 层为原图, 之后每层由上一层 2x2 平均得到, 尺寸向上取整,
+// 直到整层放得进一个分块; 各层合计只比原图多约 1/3
+// 显示时按缩放比例取最接近的层, 缩放、平移和改变窗口大小的开销只与屏幕像素数有关
+// 原图在分块存储中时第 0 层直接读取分块存储, 第 1 层放在内存映射文件中
+class ImagePyramid
+{
+public:
+    static constexpr int TileSize = 256;
+
+    // 在后台线程建立, 被取消时返回空指针
+    static std::shared_ptr<const ImagePyramid> build(const QImage &image,
+                                                     const std::atomic<bool> *cancel = nullptr);
+    static std::shared_ptr<const ImagePyramid> build(const std::shared_ptr<TiledImageStore> &store,
+                                                     const std::atomic<bool> *cancel = nullptr);
+
+    int levelCount() const { return sizes.size(); }
+    QSize levelSize(int level) const { return sizes.value(level); }
+    // 层宽与原图宽之比
+    qreal levelScale(int level) const;
+    // 覆盖 size 的最小一层(不小于 size), 原图在分块存储中时不会返回第 0 层
+    int levelFor(const QSize &size) const;
+
+    // 整层图像; 原图在分块存储中时第 0 层为空
+    QImage levelImage(int level) const { return levels.value(level); }
+    // 层上的区域, 先与层求交
+    QImage region(int level, const QRect &rect) const;
+
+private:
+    ImagePyramid() = default;
+    // 由最后一层逐层缩小到分块尺寸以内
+    bool buildUpperLevels(const std::atomic<bool> *cancel);
+
+    std::shared_ptr<TiledImageStore> tiled;
+    QVector<QImage> levels;
+    QVector<QSize> sizes;
+};
+
+#endif // IMAGEPYRAMID_H
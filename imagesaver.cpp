@@ -0,0 +1,212 @@
+﻿#include "imagesaver.h"
+#include "tracer.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+
+// 写入时统计字节数; 取消后写入失败, 编码器随即停止
+class ProgressFile : public QSaveFile
+{
+public:
+    ProgressFile(const QString &name, const std::atomic<bool> *cancel,
+                 const std::function<void(qint64)> &written)
+        : QSaveFile(name), cancel(cancel), written(written)
+    {
+    }
+
+    bool wasCanceled() const { return cancel && cancel->load(std::memory_order_relaxed); }
+
+protected:
+    qint64 writeData(const char *data, qint64 length) override
+    {
+        if (wasCanceled()) return -1;
+        const qint64 result = QSaveFile::writeData(data, length);
+        if (result > 0) {
+            total += result;
+            if (written) written(total);
+        }
+        return result;
+    }
+
+private:
+    const std::atomic<bool> *cancel;
+    std::function<void(qint64)> written;
+    qint64 total = 0;
+};
+
+bool isOpaque(const QImage &image)
+{
+    for (int y = 0; y < image.height(); ++y) {
+        const uchar *line = image.constScanLine(y);
+        for (int x = 0; x < image.width(); ++x) {
+            if (line[x * 4 + 3] != 255) return false;
+        }
+    }
+    return true;
+}
+
+// 交给编码器的图像, 与 image 共用像素, 只在 image 存在期间有效
+// 不透明的工作格式图像按 RGBX 写出, 编码器不再写 Alpha 通道; 去除元数据时只保留像素
+QImage encodableImage(const QImage &image, bool stripMetadata)
+{
+    QImage::Format format = image.format();
+    if (format == ImageProcessor::WorkingFormat && isOpaque(image)) {
+        format = QImage::Format_RGBX8888;
+    }
+    if (format == image.format() && !stripMetadata) return image;
+
+    QImage wrapped(image.constBits(), image.width(), image.height(), image.bytesPerLine(), format);
+    if (!stripMetadata) {
+        wrapped.setDotsPerMeterX(image.dotsPerMeterX());
+        wrapped.setDotsPerMeterY(image.dotsPerMeterY());
+        wrapped.setColorSpace(image.colorSpace());
+        const QStringList keys = image.textKeys();
+        for (const QString &key : keys) {
+            wrapped.setText(key, image.text(key));
+        }
+    }
+    return wrapped;
+}
+
+} // namespace
+
+ImageSaver::ImageSaver(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ImageSaver::~ImageSaver()
+{
+    cancel();
+    future.waitForFinished();
+}
+
+QByteArray ImageSaver::formatForFile(const QString &fileName)
+{
+    QByteArray format = QFileInfo(fileName).suffix().toLower().toLatin1();
+    if (format == "jpg") format = "jpeg";
+    if (format == "tif") format = "tiff";
+    return QImageWriter::supportedImageFormats().contains(format) ? format : QByteArray();
+}
+
+bool ImageSaver::supportsQuality(const QByteArray &format)
+{
+    return format == "jpeg" || format == "webp";
+}
+
+bool ImageSaver::supportsCompression(const QByteArray &format)
+{
+    return format == "png" || format == "tiff";
+}
+
+bool ImageSaver::start(const ImageDocument::FullResolutionJob &job, const Options &options)
+{
+    if (running || job.isNull()) return false;
+
+    running = true;
+    cancelFlag = std::make_shared<std::atomic<bool>>(false);
+    const std::shared_ptr<std::atomic<bool>> cancelled = cancelFlag;
+    emit progress(Stage::Rendering, 0);
+
+    // 析构时等待任务结束, 任务中可以安全地向 this 投递
+    future = QtConcurrent::run([this, job, options, cancelled]() {
+        TRACE_SCOPE("save", "save");
+        QElapsedTimer clock;
+        clock.start();
+
+        const QImage image = job.render(cancelled.get());
+        if (image.isNull()) {
+            const QString message = cancelled->load() ? tr("保存已取消") : tr("无法计算全分辨率结果");
+            QMetaObject::invokeMethod(this, [this, message]() { finish(false, message); }, Qt::QueuedConnection);
+            return;
+        }
+
+        QMetaObject::invokeMethod(this, [this]() {
+            if (running) emit progress(Stage::Encoding, 0);
+        }, Qt::QueuedConnection);
+        QElapsedTimer sinceReport;
+        sinceReport.start();
+        QString error;
+        const bool ok = write(image, options, cancelled.get(), [this, &sinceReport](qint64 written) {
+            if (!sinceReport.hasExpired(ProgressIntervalMs)) return;
+            sinceReport.restart();
+            QMetaObject::invokeMethod(this, [this, written]() {
+                if (running) emit progress(Stage::Encoding, written);
+            }, Qt::QueuedConnection);
+        }, &error);
+
+        const QString message = ok ? tr("已保存 %1 (%2 秒)").arg(QFileInfo(options.fileName).fileName())
+                                         .arg(clock.elapsed() / 1000.0, 0, 'f', 1)
+                                   : error;
+        QMetaObject::invokeMethod(this, [this, ok, message]() { finish(ok, message); }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+void ImageSaver::cancel()
+{
+    if (cancelFlag) {
+        cancelFlag->store(true);
+    }
+}
+
+void ImageSaver::finish(bool success, const QString &message)
+{
+    if (!running) return;
+    running = false;
+    cancelFlag.reset();
+    emit finished(success, message);
+}
+
+bool ImageSaver::write(const QImage &image, const Options &options, const std::atomic<bool> *cancel,
+                       const std::function<void(qint64)> &written, QString *error)
+{
+    TRACE_SCOPE("save", "encode");
+    const QByteArray format = options.format.isEmpty() ? formatForFile(options.fileName) : options.format;
+    if (format.isEmpty()) {
+        if (error) *error = tr("不支持的文件格式: %1").arg(options.fileName);
+        return false;
+    }
+
+    ProgressFile file(options.fileName, cancel, written);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error) *error = tr("无法写入 %1: %2").arg(options.fileName, file.errorString());
+        return false;
+    }
+
+    QImageWriter writer(&file, format);
+    if (supportsQuality(format) && options.quality >= 0) {
+        writer.setQuality(qBound(0, options.quality, 100));
+    }
+    if (format == "png") {
+        // Qt 的 PNG 编码器以质量表示压缩级别: 质量 q 对应 zlib 级别 (100 - q) * 9 / 91
+        const int level = options.fast ? 1 : options.compression;
+        if (level >= 0) {
+            writer.setQuality(100 - qBound(0, level, 9) * 100 / 9);
+        }
+    } else if (format == "tiff") {
+        const int level = options.fast ? 0 : options.compression;
+        if (level >= 0) {
+            writer.setCompression(level > 0 ? 1 : 0);
+        }
+    }
+
+    const QImage output = encodableImage(image, options.stripMetadata);
+    if (!writer.write(output) || file.wasCanceled()) {
+        file.cancelWriting();
+        if (error) {
+            *error = file.wasCanceled() ? tr("保存已取消")
+                                        : tr("无法写入 %1: %2").arg(options.fileName, writer.errorString());
+        }
+        return false;
+    }
+    if (!file.commit()) {
+        if (error) *error = tr("无法写入 %1: %2").arg(options.fileName, file.errorString());
+        return false;
+    }
+    return true;
+}
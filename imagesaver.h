@@ -0,0 +1,70 @@
+﻿#ifndef IMAGESAVER_H
+#define IMAGESAVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFuture>
+#include <QImage>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "imagedocument.h"
+
+// 在后台线程保存编辑结果: 在全分辨率主图上重放操作链, 再编码写入文件
+// 界面线程只取文档的快照, 保存期间可以继续编辑
+// 先写入同目录下的临时文件, 成功后才替换目标文件; 取消或失败时目标文件不变
+class ImageSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Stage {
+        Rendering,      // 在主图上重放操作链
+        Encoding        // 编码并写入文件
+    };
+
+    struct Options
+    {
+        QString fileName;
+        QByteArray format;              // 为空时由扩展名决定
+        int quality = -1;               // JPEG/WebP 质量 0-100, -1 为默认
+        int compression = -1;           // PNG 压缩级别 0-9(TIFF 为 0 不压缩, 其余 LZW), -1 为默认
+        bool stripMetadata = false;     // 不写入文字信息、色彩空间和分辨率
+        bool fast = false;              // 快速草稿: PNG 用最低压缩级别, TIFF 不压缩
+    };
+
+    explicit ImageSaver(QObject *parent = nullptr);
+    ~ImageSaver();
+
+    // 扩展名对应的可写入格式, 不支持时为空
+    static QByteArray formatForFile(const QString &fileName);
+    static bool supportsQuality(const QByteArray &format);
+    static bool supportsCompression(const QByteArray &format);
+
+    // 开始保存, 已在保存或快照为空时返回 false
+    bool start(const ImageDocument::FullResolutionJob &job, const Options &options);
+    // 取消保存, 正在编码时下一次写入即失败
+    void cancel();
+    bool isRunning() const { return running; }
+
+    // 在当前线程编码写入; written 为已写出的字节数, 可为空; 失败时返回 false 并填写 error
+    static bool write(const QImage &image, const Options &options, const std::atomic<bool> *cancel = nullptr,
+                      const std::function<void(qint64 written)> &written = nullptr, QString *error = nullptr);
+
+signals:
+    // 编码阶段按时间节流, 大约每 100 毫秒一次
+    void progress(ImageSaver::Stage stage, qint64 bytesWritten);
+    void finished(bool success, const QString &message);
+
+private:
+    void finish(bool success, const QString &message);
+
+    static constexpr int ProgressIntervalMs = 100;
+
+    bool running = false;
+    std::shared_ptr<std::atomic<bool>> cancelFlag;
+    QFuture<void> future;
+};
+
+#endif // IMAGESAVER_H
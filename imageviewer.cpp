@@ -0,0 +1,93 @@
+﻿#include "imageviewer.h"
+#include "rasterviewer.h"
+#ifdef IMAGE_VIEWER_WEB
+#include "webcanvasviewer.h"
+#endif
+#include <QDebug>
+#include <QSizeF>
+
+namespace {
+
+bool parseBackend(const QByteArray &name, ImageViewer::Backend *backend)
+{
+    if (name == "web") {
+        *backend = ImageViewer::Backend::Web;
+        return true;
+    }
+    if (name == "raster") {
+        *backend = ImageViewer::Backend::Raster;
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+ImageViewer::ImageViewer(QWidget *parent)
+    : QWidget(parent)
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    setMinimumSize(QSize(0, 0));
+}
+
+ImageViewer::Backend ImageViewer::selectBackend(int argc, char *argv[])
+{
+    Backend backend = isAvailable(Backend::Web) ? Backend::Web : Backend::Raster;
+
+    const QByteArray environment = qgetenv("QT_IMAGE_VIEWER").trimmed().toLower();
+    if (!environment.isEmpty() && !parseBackend(environment, &backend)) {
+        qWarning() << "未知的画布类型" << environment;
+    }
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray argument(argv[i]);
+        if (!argument.startsWith("--viewer=")) continue;
+        const QByteArray name = argument.mid(qstrlen("--viewer=")).toLower();
+        if (!parseBackend(name, &backend)) {
+            qWarning() << "未知的画布类型" << name;
+        }
+    }
+
+    if (!isAvailable(backend)) {
+        qWarning() << "此版本未包含 WebEngine 画布, 改用原生画布";
+        backend = Backend::Raster;
+    }
+    return backend;
+}
+
+bool ImageViewer::isAvailable(Backend backend)
+{
+#ifdef IMAGE_VIEWER_WEB
+    Q_UNUSED(backend);
+    return true;
+#else
+    return backend == Backend::Raster;
+#endif
+}
+
+void ImageViewer::prepare(Backend backend)
+{
+#ifdef IMAGE_VIEWER_WEB
+    if (backend == Backend::Web) {
+        WebCanvasViewer::registerUrlScheme();
+    }
+#else
+    Q_UNUSED(backend);
+#endif
+}
+
+ImageViewer *ImageViewer::create(Backend backend, QWidget *parent)
+{
+#ifdef IMAGE_VIEWER_WEB
+    if (backend == Backend::Web) {
+        return new WebCanvasViewer(parent);
+    }
+#else
+    Q_UNUSED(backend);
+#endif
+    return new RasterViewer(parent);
+}
+
+QSize ImageViewer::displaySize() const
+{
+    return (QSizeF(size()) * 0.95).toSize();
+}
@@ -0,0 +1,75 @@
+﻿#ifndef IMAGEVIEWER_H
+#define IMAGEVIEWER_H
+
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <QWidget>
+#include <functional>
+#include "imageprocessor.h"
+
+// 画布接口: 主窗口只通过它显示图像、提供放大后的分块和接收马赛克落笔
+// 局部修改只发送变化的区域(ImagePatch), 画布原地更新当前帧并只重绘这些区域
+//   Web     QWebEngineView 中的 canvas 页面, 帧通过 qtframe:// 协议传递
+//   Raster  QPainter 直接绘制 QImage 的原生控件, 不启动 Chromium 进程
+// 画布在启动时选择, 以 CONFIG+=no_webengine 构建时只有 Raster
+class ImageViewer : public QWidget
+{
+    Q_OBJECT
+
+public:
+    enum class Backend {
+        Web,
+        Raster
+    };
+
+    // 放大后可请求的金字塔: 原图尺寸、层数与分块边长, 版本变化时旧分块全部失效
+    struct TileSource
+    {
+        quint64 revision = 0;
+        QSize imageSize;
+        int levels = 0;
+        int tileSize = 0;
+
+        bool isValid() const { return levels > 0 && !imageSize.isEmpty(); }
+    };
+
+    // 分块在请求时生成, 版本已过期或分块不可用时返回空图像
+    using TileProvider = std::function<QImage(quint64 revision, int level, int column, int row)>;
+
+    // 命令行 --viewer=web|raster 优先, 其次为环境变量 QT_IMAGE_VIEWER, 默认 Web(可用时)
+    static Backend selectBackend(int argc, char *argv[]);
+    static bool isAvailable(Backend backend);
+    // 需在创建 QApplication 之前调用
+    static void prepare(Backend backend);
+    static ImageViewer *create(Backend backend, QWidget *parent = nullptr);
+
+    // 画布显示区域(占控件的95%), 代理图按此尺寸生成
+    QSize displaySize() const;
+
+    // 显示一帧, 适应窗口时整帧绘制, 放大时作为分块到达前的底图
+    virtual void showImage(const QImage &image) = 0;
+    // 把变化的区域写入当前帧并只重绘这些区域, 区域以当前帧的像素坐标表示; 没有帧时忽略
+    virtual void showPatches(const QVector<ImagePatch> &patches) = 0;
+    virtual void showWelcome() = 0;
+    // 丢弃全部显示状态, 回到初始的欢迎画面
+    virtual void reset() = 0;
+
+    virtual void setTileSource(const TileSource &source) = 0;
+    virtual void setTileProvider(const TileProvider &provider) = 0;
+
+    // 进入或退出马赛克画笔, 实际状态通过 mosaicModeChanged 通知
+    virtual void setMosaicMode(bool enabled) = 0;
+
+signals:
+    // 第一帧图像实际绘制到画布上, 只发出一次, 用于统计冷启动耗时
+    void firstFrameShown();
+    void mosaicModeChanged(bool active);
+    // 应用马赛克时的全部落笔, 以显示图像的宽度为单位
+    void mosaicApplied(const QVector<MosaicDab> &dabs);
+
+protected:
+    explicit ImageViewer(QWidget *parent = nullptr);
+};
+
+#endif // IMAGEVIEWER_H
@@ -1,4 +1,8 @@
 ﻿#include "mainwindow.h"
+#include "imageviewer.h"
+#include "batchprocessor.h"
+#include "startupprofiler.h"
+#include "tracer.h"
 
 #include <QApplication>
 
@@ -13,10 +17,42 @@ int main(int argc, char *argv[])
     // newArgv[argc] = ARG_DISABLE_WEB_SECURITY;
     // newArgv[argc+1] = nullptr;
 
+    // 设置 QT_IMAGE_TRACE=<文件> 时从启动开始记录性能跟踪, 退出时写入该文件
+    const QString tracePath = qEnvironmentVariable("QT_IMAGE_TRACE");
+    if (!tracePath.isEmpty()) {
+        Tracer::setEnabled(true);
+    }
+    StartupProfiler::start();
+
+    // 批处理模式不创建界面, 也不启动 WebEngine
+    if (BatchProcessor::isBatchMode(argc, argv)) {
+        const int result = BatchProcessor::exec(argc, argv);
+        if (!tracePath.isEmpty()) Tracer::writeChromeTrace(tracePath);
+        return result;
+    }
+
+    // 画布在启动时选择: --viewer=raster 或 QT_IMAGE_VIEWER=raster 时不启动 WebEngine
+    // 画布所需的注册必须在创建 QApplication 之前完成
+    const ImageViewer::Backend viewerBackend = ImageViewer::selectBackend(argc, argv);
+    ImageViewer::prepare(viewerBackend);
+
     QApplication a(argc, argv);
-    MainWindow w;
+    StartupProfiler::mark(StartupProfiler::Application);
+
+    MainWindow w(viewerBackend);
+    StartupProfiler::mark(StartupProfiler::WindowCreated);
+
+    // 命令行中的图片在窗口显示后打开, 启动耗时统计到第一帧显示为止
+    QStringList images;
+    const QStringList arguments = a.arguments();
+    for (int i = 1; i < arguments.size(); ++i) {
+        if (!arguments.at(i).startsWith('-')) images.append(arguments.at(i));
+    }
+    w.openImagesAtStartup(images);
     w.setWindowTitle("大智慧图像处理V1.0 249400231徐哲轶");
     w.setWindowIcon(QIcon(":/favicon.ico"));
     w.show();
-    return a.exec();
+    const int result = a.exec();
+    if (!tracePath.isEmpty()) Tracer::writeChromeTrace(tracePath);
+    return result;
 }
@@ -4,12 +4,13 @@
 #include <QTimer>
 #include <QMargins>
 #include <QFileDialog>
+#include <QListWidget>
 #include <QListWidgetItem>
 #include <QDir>
+#include <QFileInfo>
 #include <QIcon>
 #include <QBuffer>
 #include <QByteArray>
-#include <QtWebEngineWidgets>
 #include "toolbar.h"
 #include <QFile>
 #include <QTextStream>
@@ -25,21 +26,56 @@
 #include <QSharedPointer>
 #include <QRegularExpression>
 #include <QCoreApplication>
-#include <QMediaPlayer>
-#include <QVideoSink>
-#include <QVideoFrame>
 #include <QImage>
 #include <QPainter>
 #include <QElapsedTimer>
+#include "imageprocessor.h"
+#include "saveoptionsdialog.h"
+#include "startupprofiler.h"
+#include "tracer.h"
+#ifdef IMAGE_VIDEO
+#include "videosession.h"
+#endif
+#include <QImageReader>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QComboBox>
+#include <QProgressDialog>
 
-MainWindow::MainWindow(QWidget *parent)
+namespace {
+
+// 操作历史中显示的步骤名称
+QString describeOperation(const ImageOperation &operation)
+{
+    switch (operation.type) {
+    case ImageOperation::Grayscale: return QObject::tr("灰度化");
+    case ImageOperation::Binarize: return QObject::tr("二值化 (阈值 %1)").arg(operation.threshold);
+    case ImageOperation::MeanFilter: return QObject::tr("均值滤波 (半径 %1)").arg(operation.radius);
+    case ImageOperation::Gamma: return QObject::tr("伽马变换 (%1)").arg(operation.gamma, 0, 'f', 2);
+    case ImageOperation::EdgeDetection: return QObject::tr("Sobel 边缘检测 (阈值 %1)").arg(operation.threshold);
+    case ImageOperation::Canny:
+        return QObject::tr("Canny 边缘检测 (%1 / %2)").arg(operation.lowThreshold).arg(operation.threshold);
+    case ImageOperation::Mosaic: return QObject::tr("马赛克 (%1 笔)").arg(operation.mosaicDabs.size());
+    case ImageOperation::Levels:
+        return QObject::tr("色阶 (%1-%2)").arg(operation.blackPoint).arg(operation.whitePoint);
+    default: return QString();
+    }
+}
+
+// 有设置窗口可以重新调整参数的步骤
+bool isAdjustable(ImageOperation::Type type)
+{
+    return type == ImageOperation::Binarize || type == ImageOperation::MeanFilter || type == ImageOperation::Gamma
+           || type == ImageOperation::EdgeDetection || type == ImageOperation::Canny;
+}
+
+} // namespace
+
+MainWindow::MainWindow(ImageViewer::Backend viewerBackend, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , toolbarWasVisible(true) // 默认工具栏可见
     , imageListWasVisible(true) // 默认图片列表可见
-    , mediaPlayer(nullptr)
-    , videoSink(nullptr)
-    , returnButton(nullptr)
     , videoProcessingMode(false)
 {
     ui->setupUi(this);
@@ -57,21 +93,39 @@ MainWindow::MainWindow(QWidget *parent)
         central->setLayout(layout);
     }
 
-    // 2. 初始化WebView并添加到中央部件的布局中
-    webView = ui->webView;
-    central->layout()->addWidget(webView);
-
-    // 3. 设置WebView的大小策略为在两个方向上都扩展
-    webView->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    webView->setMinimumSize(QSize(0, 0));
+    // 2. 创建启动时选择的画布并添加到中央部件的布局中, 在两个方向上都扩展
+    viewer = ImageViewer::create(viewerBackend, central);
+    central->layout()->addWidget(viewer);
+    viewer->setVisible(true);
+    connect(viewer, &ImageViewer::mosaicApplied, this, &MainWindow::onMosaicApplied);
+    connect(viewer, &ImageViewer::mosaicModeChanged, this, [this](bool active) { mosaicFlag = active; });
+    connect(viewer, &ImageViewer::firstFrameShown, this, &MainWindow::onFirstFrameShown);
 
-    // 4. 确保WebView可见
-    webView->setVisible(true);
+    // 放大后的显示分块按请求生成, 版本已过期的请求直接失败
+    viewer->setTileProvider([this](quint64 revision, int level, int column, int row) {
+        if (videoProcessingMode || revision != document.revision()) return QImage();
+        requestWholeLevel(level);
+        return document.renderTile(level, column, row);
+    });
+    connect(&levelWatcher, &QFutureWatcher<QImage>::finished, this, &MainWindow::onWholeLevelReady);
+    connect(&pyramidWatcher, &QFutureWatcher<std::shared_ptr<const ImagePyramid>>::finished,
+            this, &MainWindow::onPyramidReady);
 
-    qputenv("QTWEBENGINE_REMOTE_DEBUGGING", "5566");   
+    // 预览在后台线程计算, 结果按代号只显示最新的一次
+    previewScheduler = new PreviewScheduler(this);
+    connect(previewScheduler, &PreviewScheduler::previewReady, this, &MainWindow::onPreviewReady);
+    connect(previewScheduler, &PreviewScheduler::replayFinished, this, &MainWindow::onReplayFinished);
+    connect(&histogramWatcher, &QFutureWatcher<Histogram>::finished, this, &MainWindow::onHistogramReady);
+    imageSaver = new ImageSaver(this);
 
+    // 已解码图像缓存, 图片列表与主窗口共用
+    imageCache = new ImageCache(512LL * 1024 * 1024, this);
+    cacheStatusLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(cacheStatusLabel);
+    connect(imageCache, &ImageCache::statisticsChanged, this, &MainWindow::updateCacheStatus);
+    
     // 创建图片列表
-    imageList = new ImageList(this);
+    imageList = new ImageList(imageCache, this);
     addDockWidget(Qt::BottomDockWidgetArea, imageList->getDockWidget());
     
     // 设置图片列表的初始大小 - 使其更小
@@ -79,10 +133,10 @@ MainWindow::MainWindow(QWidget *parent)
     
     // 连接图片列表信号
     connect(imageList, &ImageList::imageSelected, this, &MainWindow::onImageSelected);
+    connect(imageList, &ImageList::tiledImageSelected, this, &MainWindow::onTiledImageSelected);
     connect(imageList, &ImageList::imageDeleted, this, &MainWindow::onImageDeleted);
     
-    // 初始化Canvas - 不使用定时器
-    initializeCanvas();
+    // 画布在主窗口第一次显示后自行初始化(WebEngine 页面在此时才创建), 构造时不等待
     
     // 创建工具栏
     toolbar = new ToolBar(this);
@@ -93,6 +147,13 @@ MainWindow::MainWindow(QWidget *parent)
     // 将工具栏DockWidget添加到主窗口
     addDockWidget(Qt::LeftDockWidgetArea, toolbar->getDockWidget());   
     
+    // 编辑菜单: 撤销/重做
+    QMenu *editMenu = menuBar()->addMenu(tr("编辑(&E)"));
+    undoAction = editMenu->addAction(tr("撤销(&U)"), QKeySequence::Undo, this, &MainWindow::undoEdit);
+    redoAction = editMenu->addAction(tr("重做(&R)"), QKeySequence("Ctrl+Y"), this, &MainWindow::redoEdit);
+    createHistoryDock();
+    updateEditActions();
+    
     // 创建视图菜单并添加工具栏显示/隐藏选项
     QMenu *viewMenu = menuBar()->addMenu(tr("视图(&V)"));
     toggleToolbarAction = new QAction(tr("工具栏"), this);
@@ -105,6 +166,15 @@ MainWindow::MainWindow(QWidget *parent)
     toggleImageListAction->setCheckable(true);
     toggleImageListAction->setChecked(true);
     viewMenu->addAction(toggleImageListAction);
+    viewMenu->addAction(historyDock->toggleViewAction());
+
+    // 调试菜单: 记录各阶段耗时并导出为 Chrome 跟踪格式
+    QMenu *debugMenu = menuBar()->addMenu(tr("调试(&D)"));
+    traceAction = debugMenu->addAction(tr("记录性能跟踪"));
+    traceAction->setCheckable(true);
+    traceAction->setChecked(Tracer::isEnabled());
+    connect(traceAction, &QAction::toggled, this, &MainWindow::setTracingEnabled);
+    debugMenu->addAction(tr("导出性能跟踪..."), this, &MainWindow::exportTrace);
 
     QMenu *helpMenu = menuBar()->addMenu(tr("帮助(&H)"));
     QAction *aboutAction = new QAction(tr("关于(&A)"), this);
@@ -123,7 +193,12 @@ MainWindow::MainWindow(QWidget *parent)
     connect(toolbar->getDockWidget(), &QDockWidget::dockLocationChanged, toolbar, &ToolBar::adjustLayout);
     
     connect(ui->actionOpen, &QAction::triggered, this, &MainWindow::onActionOpenTriggered);
+#ifdef IMAGE_VIDEO
     connect(ui->actionVideo, &QAction::triggered, this, &MainWindow::onActionOpenVideoTriggered);
+#else
+    // 没有多媒体模块时不提供视频功能
+    ui->actionVideo->setVisible(false);
+#endif
 
     // 立即应用布局，不使用定时器
     toolbar->adjustLayout(Qt::LeftDockWidgetArea);
@@ -138,15 +213,6 @@ MainWindow::~MainWindow()
 {
     cleanupVideoMode();
     
-    // 删除多媒体相关资源
-    if (mediaPlayer) {
-        delete mediaPlayer;
-    }
-    
-    if (videoSink) {
-        delete videoSink;
-    }
-    
     delete ui;
     // toolbar 会作为子对象自动删除
 }
@@ -155,8 +221,14 @@ void MainWindow::showEvent(QShowEvent *event)
 {
     QMainWindow::showEvent(event);
     
+    // 第一次显示后的下一轮事件循环即可响应操作
+    if (!shownOnce) {
+        shownOnce = true;
+        QTimer::singleShot(0, this, &MainWindow::onFirstShown);
+    }
+    
     // 安装事件过滤器
-    webView->installEventFilter(this);
+    viewer->installEventFilter(this);
     
     // 设置工具栏可见性
     toolbar->setVisible(toolbarWasVisible);
@@ -167,6 +239,40 @@ void MainWindow::showEvent(QShowEvent *event)
     toggleImageListAction->setChecked(imageListWasVisible);
 }
 
+void MainWindow::openImagesAtStartup(const QStringList &paths)
+{
+    startupImages = paths;
+}
+
+void MainWindow::onFirstShown()
+{
+    StartupProfiler::mark(StartupProfiler::Interactive);
+    ui->statusbar->showMessage(StartupProfiler::summary(), 5000);
+
+    // 后台预热: 加载图像格式插件并初始化处理内核与线程池, 第一次打开图片时不再承担这部分开销
+    QThreadPool::globalInstance()->start([]() {
+        TRACE_SCOPE("startup", "prewarm");
+        QImageReader::supportedImageFormats();
+        QImage warmup(64, 64, ImageProcessor::WorkingFormat);
+        warmup.fill(Qt::gray);
+        ImageProcessor::apply(warmup, ImageOperation::grayscale());
+    });
+
+    if (!startupImages.isEmpty()) {
+        imageList->addImages(startupImages);
+        startupImages.clear();
+    }
+}
+
+// 第一帧图像显示在画布上, 冷启动到此结束
+void MainWindow::onFirstFrameShown()
+{
+    StartupProfiler::mark(StartupProfiler::FirstFrame);
+    const QString summary = StartupProfiler::summary();
+    ui->statusbar->showMessage(summary, 5000);
+    qInfo().noquote() << summary;
+}
+
 void MainWindow::hideEvent(QHideEvent *event)
 {
     // 保存工具栏的可见性状态
@@ -194,48 +300,158 @@ void MainWindow::changeEvent(QEvent *event)
 
 void MainWindow::initializeCanvas()
 {
-    // 从资源文件加载HTML
-    QFile htmlFile(":/html/canvas_viewer.html");
-    if (!htmlFile.open(QIODevice::ReadOnly)) {
-        qDebug() << "无法打开HTML资源文件";
+    viewer->reset();
+}
+
+void MainWindow::displayImageInCanvas(const QImage &image)
+{
+    if(image.isNull()) return;
+    TRACE_SCOPE("canvas", "displayImageInCanvas");
+    viewer->showImage(image);
+}
+
+void MainWindow::setTracingEnabled(bool enabled)
+{
+    Tracer::setEnabled(enabled);
+    ui->statusbar->showMessage(enabled ? tr("性能跟踪已开启")
+                                       : tr("性能跟踪已停止, 共 %1 个事件").arg(Tracer::eventCount()),
+                               3000);
+}
+
+void MainWindow::exportTrace()
+{
+    if (Tracer::eventCount() == 0) {
+        QMessageBox::information(this, tr("导出性能跟踪"), tr("没有记录到跟踪事件, 请先开启 \"记录性能跟踪\""));
         return;
     }
-    
-    // 读取HTML内容
-    QTextStream stream(&htmlFile);
-    QString htmlContent = stream.readAll();
-    htmlFile.close();
-    
-    // 将HTML内容加载到WebView
-    webView->setHtml(htmlContent);
+    QString fileName = QFileDialog::getSaveFileName(
+        this, tr("导出性能跟踪"), "trace.json", tr("Chrome 跟踪文件 (*.json)"));
+    if (fileName.isEmpty()) return;
+    if (!Tracer::writeChromeTrace(fileName)) {
+        QMessageBox::warning(this, tr("导出性能跟踪"), tr("无法写入文件 %1").arg(fileName));
+    }
 }
 
-void MainWindow::displayImageInCanvas(const QPixmap &pixmap)
+void MainWindow::onImageSelected(const QImage &image, const QString &path)
 {
-    if(pixmap.isNull()) return;
-    
-    QByteArray byteArray;
-    QBuffer buffer(&byteArray);
-    buffer.open(QIODevice::WriteOnly);
-    pixmap.save(&buffer, "PNG");
-    buffer.close();
-    
-    QString imageData = "data:image/png;base64," + QString::fromLatin1(byteArray.toBase64().data());
-    
-    QString script = QString("displayImage('%1')").arg(imageData);
-    webView->page()->runJavaScript(script);
+    TRACE_SCOPE("ui", "onImageSelected");
+    stopEditingStep();
+    document.setImage(image);
+    document.setProxySize(canvasProxySize());
+    buildPyramid(document.masterImage(), nullptr);
+    showPreview();
+}
+
+// 超大图片: 画布只显示概览图, 全分辨率像素留在分块存储中
+void MainWindow::onTiledImageSelected(const std::shared_ptr<TiledImageStore> &store, const QString &path)
+{
+    TRACE_SCOPE("ui", "onTiledImageSelected");
+    stopEditingStep();
+    document.setTiledImage(store);
+    if (document.isNull()) {
+        ui->statusbar->showMessage(tr("无法解码 %1").arg(path), 5000);
+        return;
+    }
+    document.setProxySize(canvasProxySize());
+    buildPyramid(QImage(), store);
+    showPreview();
+    ui->statusbar->showMessage(tr("%1 x %2 按分块方式打开").arg(store->width()).arg(store->height()), 5000);
+}
+
+// 在后台建立金字塔, 之前未完成的建立被取消
+void MainWindow::buildPyramid(const QImage &image, const std::shared_ptr<TiledImageStore> &store)
+{
+    cancelPyramid();
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    pyramidCancel = cancel;
+    pyramidWatcher.setFuture(QtConcurrent::run([image, store, cancel]() {
+        return store ? ImagePyramid::build(store, cancel.get()) : ImagePyramid::build(image, cancel.get());
+    }));
+}
+
+void MainWindow::cancelPyramid()
+{
+    if (pyramidCancel) {
+        pyramidCancel->store(true);
+        pyramidCancel.reset();
+    }
+    updateTileSource();
+}
+
+void MainWindow::onPyramidReady()
+{
+    if (!pyramidCancel || pyramidCancel->load() || pyramidWatcher.isCanceled()) return;
+    const std::shared_ptr<const ImagePyramid> pyramid = pyramidWatcher.result();
+    pyramidCancel.reset();
+    if (!pyramid) return;
+
+    document.setPyramid(pyramid);
+    updateTileSource();
+}
+
+// 只保留最新请求的一层, 之前未完成的计算被取消
+void MainWindow::requestWholeLevel(int level)
+{
+    if (levelCancel && levelRevision == document.revision() && levelIndex == level) return;
+    const ImageDocument::LevelJob job = document.wholeLevelJob(level);
+    if (job.isNull()) return;
+
+    if (levelCancel) {
+        levelCancel->store(true);
+    }
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    levelCancel = cancel;
+    levelRevision = job.revision;
+    levelIndex = job.level;
+    levelWatcher.setFuture(QtConcurrent::run([job, cancel]() {
+        return job.render(cancel.get());
+    }));
+}
+
+void MainWindow::onWholeLevelReady()
+{
+    if (!levelCancel || levelCancel->load() || levelWatcher.isCanceled()) return;
+    levelCancel.reset();
+    const QImage image = levelWatcher.result();
+    if (image.isNull() || levelRevision != document.revision()) return;
+
+    document.setProcessedLevel(levelRevision, levelIndex, image);
+    // 丢弃画布上代替的分块, 重新请求
+    updateTileSource();
 }
 
-void MainWindow::onImageSelected(const QPixmap &pixmap, const QString &path)
+void MainWindow::updateTileSource()
 {
-    currentPixmap = pixmap;
-    displayImageInCanvas(pixmap);
+    const std::shared_ptr<const ImagePyramid> &pyramid = document.pyramid();
+    ImageViewer::TileSource source;
+    if (!videoProcessingMode && pyramid && !document.isNull()) {
+        source.revision = document.revision();
+        source.imageSize = document.imageSize();
+        source.levels = pyramid->levelCount();
+        source.tileSize = ImagePyramid::TileSize;
+    }
+    viewer->setTileSource(source);
+}
+
+// 状态栏显示缓存命中情况与占用内存
+void MainWindow::updateCacheStatus()
+{
+    cacheStatusLabel->setText(tr("缓存 %1 张 %2 MB / %3 MB, 命中 %4, 未命中 %5")
+                                  .arg(imageCache->count())
+                                  .arg(imageCache->residentBytes() / (1024 * 1024))
+                                  .arg(imageCache->byteBudget() / (1024 * 1024))
+                                  .arg(imageCache->hits())
+                                  .arg(imageCache->misses()));
 }
 
 void MainWindow::onImageDeleted(const QString &path)
 {
-    currentPixmap = QPixmap();
-    webView->page()->runJavaScript("drawWelcomeText();");
+    document.clear();
+    cancelPyramid();
+    previewScheduler->cancel();
+    updateEditActions();
+    currentImage = QImage();
+    viewer->showWelcome();
 }
 
 void MainWindow::onActionOpenTriggered()
@@ -271,28 +487,38 @@ void MainWindow::resizeEvent(QResizeEvent *event)
     // 取消之前的定时器，只处理最后一次 resize 事件
     resizeTimer.disconnect();
     connect(&resizeTimer, &QTimer::timeout, this, [this]() {
-        // 只在有图片时更新
-        if (!currentPixmap.isNull()) {
-            displayImageInCanvas(currentPixmap);
+#ifdef IMAGE_VIDEO
+        if (videoProcessingMode) {
+            videoSession->setTargetSize(canvasProxySize());
+        }
+#endif
+        // 只在有图片时按新的显示尺寸重建代理图
+        if (!document.isNull()) {
+            document.setProxySize(canvasProxySize());
+            showPreview();
         }
     });
     
-    // 设置较长的延时，减少触发频率
-    resizeTimer.start(300);
+    // 画布页面先用已有的帧立即重绘; 代理图从金字塔中最接近的一层缩放, 开销只与显示尺寸有关
+    resizeTimer.start(100);
 }
 
 // 修改工具栏按钮点击处理方法
 
 // 成员变量添加
 QDockWidget *thresholdDock = nullptr; // 存储二值化DockWidget指针
-bool mosaicFlag = false;
 void MainWindow::handleToolbarButtonClicked(int index){
     qDebug() << "按钮点击" << index;
+    // 工具栏开始的是新操作, 结束对历史步骤的修改
+    stopEditingStep();
     
     // 关闭其他设置窗口
     if (index != 1 && thresholdDock && thresholdDock->isVisible()) {
         thresholdDock->close();
     }
+    if (index != 2 && meanDock && meanDock->isVisible()) {
+        meanDock->close();
+    }
     if (index != 3 && gammaDock && gammaDock->isVisible()) {
         gammaDock->close();
     }
@@ -300,77 +526,81 @@ void MainWindow::handleToolbarButtonClicked(int index){
         edgeDock->close();
     }
     if(index != 7){
-        mosaicFlag = false;
-        webView->page()->runJavaScript("stopMosaicMode()");
+        viewer->setMosaicMode(false);
+    }
+    
+    // 视频模式下效果作用于播放中的帧, 不修改图像文档
+#ifdef IMAGE_VIDEO
+    if (videoProcessingMode) {
+        switch (index) {
+            case 0:
+                videoSession->setOperation(ImageOperation::grayscale());
+                break;
+            case 1:
+                createThresholdSlider();
+                break;
+            case 2:
+                createMeanFilterSlider();
+                break;
+            case 3:
+                createGammaSlider();
+                break;
+            case 4:
+                createEdgeDetectionSlider();
+                break;
+            case 5:
+                videoSession->setOperation(ImageOperation());
+                break;
+            default:
+                break;
+        }
+        return;
     }
+#endif
+    
     switch (index) {
         case 0:
-            webView->page()->runJavaScript("grayscale()", [this](const QVariant &result) {
-                if (result.isValid() && !result.isNull()) {
-                    // 获取返回的base64数据
-                    QString imageDataUrl = result.toString();
-                    if (!imageDataUrl.isEmpty()) {
-                        // 可以选择保存或更新图片
-                        updateImageWithBase64(imageDataUrl);
-                    }
-                }
-            });
+            if (document.isNull()) return;
+            commitActiveOperationUnless(ImageOperation::Grayscale);
+            document.setActiveOperation(ImageOperation::grayscale());
+            showPreview();
             break;
         case 1:
-            if (currentPixmap.isNull()) return;
+            if (document.isNull()) return;
+            commitActiveOperationUnless(ImageOperation::Binarize);
             createThresholdSlider();
             break;
         case 2:
-            webView->page()->runJavaScript("meanFilter()", [this](const QVariant &result) {
-                if (result.isValid() && !result.isNull()) {
-                    QString imageDataUrl = result.toString();
-                    if (!imageDataUrl.isEmpty()) {
-                        updateImageWithBase64(imageDataUrl);
-                    }
-                }
-            });
+            if (document.isNull()) return;
+            commitActiveOperationUnless(ImageOperation::MeanFilter);
+            createMeanFilterSlider();
             break;
         case 3:
-            if (currentPixmap.isNull()) return;
+            if (document.isNull()) return;
+            commitActiveOperationUnless(ImageOperation::Gamma);
             createGammaSlider();
             break;
         case 4:
-            if (currentPixmap.isNull()) return;
+            if (document.isNull()) return;
+            // 在 Sobel 与 Canny 之间切换仍是同一个未提交的边缘检测
+            if (document.activeOperation().type != ImageOperation::Canny) {
+                commitActiveOperationUnless(ImageOperation::EdgeDetection);
+            }
             createEdgeDetectionSlider();
             break;
         case 5:
-            webView->page()->runJavaScript("resetImage()", [this](const QVariant &result) {
-                if (result.isValid() && !result.isNull()) {
-                    QString imageDataUrl = result.toString();
-                    if (!imageDataUrl.isEmpty()) {
-                        updateImageWithBase64(imageDataUrl);
-                    }
-                }
-            });
+            // 回到原图, 之前的操作仍可重做
+            if (document.isNull()) return;
+            document.revertToOriginal();
+            showPreview();
             break;
         case 6:
             saveImage();
             break;
         case 7:
-            if (currentPixmap.isNull()) return;
-            if(!mosaicFlag){
-                webView->page()->runJavaScript("startMosaicMode()", [this](const QVariant &result) {
-                    if (result.toBool()) {
-                        qDebug() << "已进入马赛克模式";
-
-                        webView->page()->runJavaScript(
-                            "window.onMosaicApplied = function(result) { return result; };",
-                            [this](const QVariant &) {
-                                qDebug() << "马赛克回调设置完成";
-                                mosaicFlag = true;
-                            }
-                            );
-                    }
-                });
-            }else{
-                mosaicFlag = false;
-                webView->page()->runJavaScript("stopMosaicMode()");
-            }
+            if (currentImage.isNull()) return;
+            // 画布进入或退出后通过 mosaicModeChanged 更新 mosaicFlag
+            viewer->setMosaicMode(!mosaicFlag);
 
             break;
         default:
@@ -378,23 +608,216 @@ void MainWindow::handleToolbarButtonClicked(int index){
     }
 }
 
-// 添加一个处理Base64数据的方法
-void MainWindow::updateImageWithBase64(const QString &imageDataUrl){
-    // 移除前缀 "data:image/png;base64,"
-    QString base64Data = imageDataUrl.mid(22);
-    
-    // 转换为QPixmap
-    QByteArray imageData = QByteArray::fromBase64(base64Data.toLatin1());
-    QPixmap processedPixmap;
-    processedPixmap.loadFromData(imageData, "PNG");
-    
-    if (processedPixmap.isNull()) {
-        qDebug() << "处理后的图像无效";
+// 画布上应用的马赛克落笔, 以图像宽度为单位, 可在任意分辨率上重放
+void MainWindow::onMosaicApplied(const QVector<MosaicDab> &dabs){
+    if (dabs.isEmpty() || document.isNull()) return;
+    TRACE_SCOPE("ui", "applyMosaic");
+    stopEditingStep();
+    
+    // 马赛克绘制在当前显示结果上, 因此连同当前操作一起提交
+    document.commitOperation(ImageOperation::mosaic(dabs));
+    showDocumentChange();
+}
+
+void MainWindow::showDocumentChange()
+{
+    // 已提交操作的结果未缓存时交给预览在后台重放
+    if (!document.hasProxyImage()) {
+        showPreview();
+        return;
+    }
+    const QImage proxy = document.proxyImage();
+    const QRect damage = document.lastProxyDamage();
+    const bool previewCurrent = !videoProcessingMode && !document.activeOperation().isValid()
+        && shownGeneration == previewScheduler->latestGeneration()
+        && !currentImage.isNull() && currentImage.size() == proxy.size();
+    if (!previewCurrent || damage == proxy.rect()) {
+        showPreview();
+        return;
+    }
+
+    TRACE_SCOPE("ui", "showDocumentChange");
+    currentImage = proxy;
+    if (!damage.isEmpty()) {
+        viewer->showPatches(ImageProcessor::extractPatches(proxy, { damage }));
+    }
+    updateTileSource();
+    updateEditActions();
+    updateHistogram();
+}
+
+// 请求代理图上的预览, 结果由 onPreviewReady 显示
+void MainWindow::showPreview()
+{
+    previewScheduler->request(document.proxyReplay(), document.activeProxyOperation());
+    updateEditActions();
+    updateHistogram();
+}
+
+void MainWindow::commitActiveOperationUnless(ImageOperation::Type type)
+{
+    if (document.activeOperation().isValid() && document.activeOperation().type != type) {
+        document.commitActiveOperation();
+    }
+}
+
+void MainWindow::undoEdit()
+{
+    stopEditingStep();
+    if (document.undo()) {
+        showDocumentChange();
+    }
+}
+
+void MainWindow::redoEdit()
+{
+    stopEditingStep();
+    if (document.redo()) {
+        showDocumentChange();
+    }
+}
+
+void MainWindow::updateEditActions()
+{
+    undoAction->setEnabled(document.canUndo());
+    redoAction->setEnabled(document.canRedo());
+    updateHistoryList();
+}
+
+void MainWindow::createHistoryDock()
+{
+    historyDock = new QDockWidget(tr("操作历史"), this);
+    historyDock->setObjectName("historyDock");
+    historyDock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+    historyList = new QListWidget(historyDock);
+    historyList->setToolTip(tr("双击步骤修改其参数"));
+    historyDock->setWidget(historyList);
+    addDockWidget(Qt::LeftDockWidgetArea, historyDock);
+
+    connect(historyList, &QListWidget::itemDoubleClicked, this, [this](QListWidgetItem *item) {
+        editHistoryStep(historyList->row(item));
+    });
+}
+
+void MainWindow::updateHistoryList()
+{
+    const QVector<ImageOperation> steps = document.operations();
+    historyList->clear();
+    for (int i = 0; i < steps.size(); ++i) {
+        QListWidgetItem *item = new QListWidgetItem(QString("%1. %2").arg(i + 1).arg(describeOperation(steps.at(i))),
+                                                    historyList);
+        if (!isAdjustable(steps.at(i).type)) {
+            item->setForeground(QColor(0x99, 0x99, 0x99));
+        }
+        if (i == editingStep) {
+            QFont font = item->font();
+            font.setBold(true);
+            item->setFont(font);
+            historyList->setCurrentItem(item);
+        }
+    }
+}
+
+// 打开步骤对应的设置窗口并恢复其参数, 之后窗口中的调整都替换该步骤
+void MainWindow::editHistoryStep(int index)
+{
+    if (videoProcessingMode || document.isNull()) return;
+    const QVector<ImageOperation> steps = document.operations();
+    if (index < 0 || index >= steps.size()) return;
+    const ImageOperation step = steps.at(index);
+    if (!isAdjustable(step.type)) {
+        ui->statusbar->showMessage(tr("%1 没有可调整的参数").arg(describeOperation(step)), 3000);
         return;
     }
+
+    // 正在调整的操作先提交, 它排在所有已提交步骤之后, 不影响步骤的序号
+    editingStep = -1;
+    document.commitActiveOperation();
+    viewer->setMosaicMode(false);
+
+    QDockWidget *target = nullptr;
+    switch (step.type) {
+    case ImageOperation::Binarize: target = thresholdDock; break;
+    case ImageOperation::MeanFilter: target = meanDock; break;
+    case ImageOperation::Gamma: target = gammaDock; break;
+    default: target = edgeDock; break;
+    }
+    for (QDockWidget *dock : { thresholdDock, meanDock, gammaDock, edgeDock }) {
+        if (dock && dock != target && dock->isVisible()) {
+            dock->close();
+        }
+    }
+
+    reopeningStep = true;
+    switch (step.type) {
+    case ImageOperation::Binarize:
+        createThresholdSlider();
+        thresholdSlider->setValue(step.threshold);
+        break;
+    case ImageOperation::MeanFilter:
+        createMeanFilterSlider();
+        meanSlider->setValue(step.radius);
+        break;
+    case ImageOperation::Gamma:
+        createGammaSlider();
+        gammaSlider->setValue(qRound(step.gamma * 100));
+        break;
+    case ImageOperation::EdgeDetection:
+        createEdgeDetectionSlider();
+        edgeModeCombo->setCurrentIndex(0);
+        edgeSlider->setValue(step.threshold);
+        break;
+    case ImageOperation::Canny:
+        createEdgeDetectionSlider();
+        edgeModeCombo->setCurrentIndex(1);
+        // 先设高阈值, 低阈值随后不会被带动
+        cannyHighSlider->setValue(step.threshold);
+        cannyLowSlider->setValue(step.lowThreshold);
+        break;
+    default:
+        break;
+    }
+    reopeningStep = false;
+
+    editingStep = index;
+    document.setEditingStep(index);
+    updateEditActions();
+    ui->statusbar->showMessage(tr("正在修改第 %1 步: %2").arg(index + 1).arg(describeOperation(step)), 5000);
+    showPreview();
+}
+
+void MainWindow::stopEditingStep()
+{
+    if (editingStep < 0) return;
+    editingStep = -1;
+    document.setEditingStep(-1);
+    updateHistoryList();
+}
+
+// 显示最新一次请求的预览结果
+void MainWindow::onPreviewReady(const QImage &image, quint64 generation)
+{
+    if (image.isNull()) return;
     
-    // 更新当前图像
-    currentPixmap = processedPixmap;
+    currentImage = image;
+    shownGeneration = generation;
+    displayImageInCanvas(currentImage);
+    if (!videoProcessingMode) {
+        updateTileSource();
+    }
+}
+
+// 后台重放的已提交操作结果保存到编辑栈, 之后的预览与撤销从这里开始
+void MainWindow::onReplayFinished(const EditStack::Replay &replay, const QImage &result, const QImage &kept)
+{
+    document.storeProxyReplay(replay, result, kept);
+    updateHistogram();
+}
+
+// 显示区域的尺寸(画布占容器的95%)
+QSize MainWindow::canvasProxySize() const
+{
+    return viewer->displaySize();
 }
 
 
@@ -402,15 +825,17 @@ void MainWindow::updateImageWithBase64(const QString &imageDataUrl){
 void MainWindow::createThresholdSlider() {
     // 如果已存在二值化设置窗口且可见，则不再创建新窗口
     if (thresholdDock && thresholdDock->isVisible()) {
-        applyBinarization(128);
+        applyBinarization(thresholdSlider->value());
+        updateHistogram();
         thresholdDock->setFocus(); // 设置焦点到已有窗口
         return;
     }
     
-    // 如果窗口存在但不可见，则显示它
+    // 如果窗口存在但不可见，则显示它, 沿用上次的阈值
     if (thresholdDock) {
-        applyBinarization(128);
+        applyBinarization(thresholdSlider->value());
         thresholdDock->show();
+        updateHistogram();
         return;
     }
     
@@ -425,18 +850,30 @@ void MainWindow::createThresholdSlider() {
     // 创建滑块
     QSlider *slider = new QSlider(Qt::Horizontal, content);
     slider->setRange(0, 255);
-    slider->setValue(128);
+    slider->setValue(currentThreshold);
     slider->setTickPosition(QSlider::TicksBelow);
     slider->setTickInterval(32);
     
     // 创建标签
-    QLabel *label = new QLabel("128", content);
+    QLabel *label = new QLabel(QString::number(currentThreshold), content);
     label->setAlignment(Qt::AlignCenter);
     
+    // 二值化输入的直方图, 统计完成前自动阈值不可用
+    histogramWidget = new HistogramWidget(content);
+    histogramWidget->setThreshold(currentThreshold);
+    histogramLabel = new QLabel(content);
+    histogramLabel->setAlignment(Qt::AlignCenter);
+    otsuButton = new QPushButton(tr("自动 (Otsu)"), content);
+    otsuButton->setEnabled(false);
+    otsuButton->setToolTip(tr("按直方图选择使前景与背景区分最明显的阈值"));
+    
     // 添加到布局
+    layout->addWidget(histogramWidget);
+    layout->addWidget(histogramLabel);
     layout->addWidget(new QLabel(tr("调整阈值:"), content));
     layout->addWidget(slider);
     layout->addWidget(label);
+    layout->addWidget(otsuButton);
     layout->addStretch();
     
     // 设置内容控件
@@ -449,8 +886,12 @@ void MainWindow::createThresholdSlider() {
     // 连接信号
     connect(slider, &QSlider::valueChanged, [label, this](int value) {
         label->setText(QString::number(value));
+        currentThreshold = value;
+        histogramWidget->setThreshold(value);
+        updateThresholdStats();
         applyBinarization(value);
     });
+    connect(otsuButton, &QPushButton::clicked, this, &MainWindow::applyOtsuThreshold);
     
     // 保存引用
     thresholdSlider = slider;
@@ -458,23 +899,203 @@ void MainWindow::createThresholdSlider() {
     sliderContainer = content;
     
     // 应用初始阈值
-    applyBinarization(128);
+    applyBinarization(currentThreshold);
+    updateHistogram();
+}
+
+// 统计二值化输入(已提交操作的结果)的直方图
+// 以图像的 cacheKey 判断是否变化, 编辑栈中的同一节点只统计一次, 撤销/重做后自动跟随
+void MainWindow::updateHistogram()
+{
+    if (!thresholdDock || !thresholdDock->isVisible()) return;
+
+    // 视频模式下每帧都在变化, 不统计; 已提交操作的结果还在后台重放时, 重放完成后再统计
+    if (!videoProcessingMode && !document.isNull() && !document.hasProxyImage()) return;
+    const QImage input = videoProcessingMode ? QImage() : document.proxyImage();
+    if (input.isNull()) {
+        histogramKey = 0;
+        histogram = Histogram();
+        histogramWatcher.cancel();
+        onHistogramReady();
+        return;
+    }
+    if (input.cacheKey() == histogramKey) return;
+    histogramKey = input.cacheKey();
+
+    // 撤销/重做回到已统计的节点时直接使用保存的直方图, 局部操作(马赛克)只重新统计改变的区域
+    const Histogram known = document.proxyHistogram();
+    QImage previous;
+    Histogram previousHistogram;
+    QRect damage;
+    const bool incremental = known.isEmpty() && document.proxyHistogramBase(&previous, &previousHistogram, &damage);
+
+    // 旧的统计仍在进行时直接替换, 其结果不会再发出
+    histogramWatcher.setFuture(QtConcurrent::run([input, known, incremental, previous, previousHistogram, damage]() {
+        if (!known.isEmpty()) return known;
+        return incremental ? Histogram::updated(previousHistogram, previous, input, damage)
+                           : Histogram::compute(input);
+    }));
+}
+
+void MainWindow::onHistogramReady()
+{
+    if (histogramWatcher.isFinished() && !histogramWatcher.isCanceled() && histogramKey != 0) {
+        histogram = histogramWatcher.result();
+        // 统计期间编辑节点未变时保存到该节点
+        if (!histogram.isEmpty() && document.hasProxyImage() && document.proxyImage().cacheKey() == histogramKey) {
+            document.setProxyHistogram(histogram);
+        }
+    }
+    if (!histogramWidget) return;
+
+    histogramWidget->setHistogram(histogram);
+    otsuButton->setEnabled(!histogram.isEmpty());
+    updateThresholdStats();
+}
+
+// 阈值两侧的像素比例, 由累计直方图直接得到
+void MainWindow::updateThresholdStats()
+{
+    if (!histogramLabel) return;
+    if (histogram.isEmpty()) {
+        histogramLabel->clear();
+        return;
+    }
+    const double black = 100.0 * histogram.lumaAtMost(currentThreshold) / histogram.pixelCount();
+    histogramLabel->setText(tr("黑 %1% / 白 %2%").arg(black, 0, 'f', 1).arg(100.0 - black, 0, 'f', 1));
+}
+
+void MainWindow::applyOtsuThreshold()
+{
+    if (histogram.isEmpty()) return;
+    thresholdSlider->setValue(histogram.otsuThreshold());
+}
+
+// 设置当前正在调整的操作: 视频模式下作用于视频帧, 否则在图像上预览
+void MainWindow::applyOperation(const ImageOperation &operation)
+{
+    if (reopeningStep) return;
+#ifdef IMAGE_VIDEO
+    if (videoProcessingMode) {
+        videoSession->setOperation(operation);
+        return;
+    }
+#endif
+    // 修改历史步骤: 替换该步骤, 编辑栈只从这一步开始重新计算
+    // Sobel 与 Canny 在同一窗口中切换, 仍替换同一步骤
+    if (editingStep >= 0 && !document.isNull()) {
+        const QVector<ImageOperation> steps = document.operations();
+        const auto isEdge = [](ImageOperation::Type type) {
+            return type == ImageOperation::EdgeDetection || type == ImageOperation::Canny;
+        };
+        if (editingStep < steps.size()
+            && (steps.at(editingStep).type == operation.type
+                || (isEdge(steps.at(editingStep).type) && isEdge(operation.type)))) {
+            document.replaceOperation(editingStep, operation);
+            updateHistoryList();
+            showPreview();
+            return;
+        }
+        stopEditingStep();
+    }
+    if (!document.isNull()) {
+        document.setActiveOperation(operation);
+        showPreview();
+    }
 }
 
 void MainWindow::applyBinarization(int threshold)
 {
-    if (!currentPixmap.isNull()) {
-        // 调用JavaScript的二值化函数
-        QString script = QString("binarizeImage(%1)").arg(threshold);
-        webView->page()->runJavaScript(script, [this](const QVariant &result) {
-            if (result.isValid() && !result.toString().isEmpty()) {
-                // 更新图像
-                updateImageWithBase64(result.toString());
-            }
-        });
+    TRACE_SCOPE("ui", "applyBinarization");
+    applyOperation(ImageOperation::binarize(threshold));
+}
+
+
+// 创建均值滤波半径滑块
+void MainWindow::createMeanFilterSlider() {
+    // 如果已存在均值滤波设置窗口且可见，则不再创建新窗口
+    if (meanDock && meanDock->isVisible()) {
+        applyMeanFilter(meanSlider->value());
+        meanDock->setFocus();     // 设置焦点到已有窗口
+        return;
     }
+    
+    // 如果窗口存在但不可见，则显示它
+    if (meanDock) {
+        applyMeanFilter(meanSlider->value());
+        meanDock->show();
+        return;
+    }
+    
+    // 创建新的均值滤波设置窗口
+    meanDock = new QDockWidget(tr("均值滤波"), this);
+    meanDock->setAllowedAreas(Qt::RightDockWidgetArea);
+    meanDock->setFeatures(QDockWidget::DockWidgetClosable);
+    
+    // 创建内容控件
+    QWidget *content = new QWidget(meanDock);
+    QVBoxLayout *layout = new QVBoxLayout(content);
+    
+    // 创建标题标签
+    QLabel *titleLabel = new QLabel(tr("滤波半径:"), content);
+    titleLabel->setAlignment(Qt::AlignCenter);
+    titleLabel->setStyleSheet("font-weight: bold;");
+    
+    // 创建滑块 - 半径1对应3x3窗口
+    meanSlider = new QSlider(Qt::Horizontal, content);
+    meanSlider->setRange(1, ImageProcessor::MaxMeanRadius);
+    meanSlider->setValue(1);
+    meanSlider->setTickPosition(QSlider::TicksBelow);
+    meanSlider->setTickInterval(10);
+    
+    // 创建显示当前半径的标签
+    meanLabel = new QLabel("1 (3x3)", content);
+    meanLabel->setAlignment(Qt::AlignCenter);
+    
+    // 添加一个水平布局用于显示最小值和最大值
+    QHBoxLayout *rangeLayout = new QHBoxLayout();
+    QLabel *minLabel = new QLabel("1", content);
+    QLabel *maxLabel = new QLabel(QString::number(ImageProcessor::MaxMeanRadius), content);
+    rangeLayout->addWidget(minLabel);
+    rangeLayout->addStretch();
+    rangeLayout->addWidget(maxLabel);
+    
+    // 添加到布局
+    layout->addWidget(titleLabel);
+    layout->addWidget(meanSlider);
+    layout->addWidget(meanLabel);
+    layout->addLayout(rangeLayout);
+    layout->addStretch();
+    
+    // 设置内容控件
+    content->setLayout(layout);
+    meanDock->setWidget(content);
+    meanDock->setMinimumWidth(200);
+    
+    // 添加到主窗口
+    addDockWidget(Qt::RightDockWidgetArea, meanDock);
+    
+    // 连接信号
+    connect(meanSlider, &QSlider::valueChanged, [this](int value) {
+        const int size = 2 * value + 1;
+        meanLabel->setText(QString("%1 (%2x%3)").arg(value).arg(size).arg(size));
+        applyMeanFilter(value);
+    });
+    
+    // 连接关闭信号
+    connect(meanDock, &QDockWidget::visibilityChanged, this, [this](bool visible) {
+        meanVisible = visible;
+    });
+    
+    // 应用初始半径
+    applyMeanFilter(1);
 }
 
+// 应用均值滤波
+void MainWindow::applyMeanFilter(int radius) {
+    TRACE_SCOPE("ui", "applyMeanFilter");
+    applyOperation(ImageOperation::meanFilter(radius));
+}
 
 // 创建伽马调整滑块
 void MainWindow::createGammaSlider() {
@@ -565,30 +1186,22 @@ void MainWindow::createGammaSlider() {
 
 // 应用伽马变换
 void MainWindow::applyGammaTransform(float gamma) {
-    if (!currentPixmap.isNull()) {
-        // 调用JavaScript的伽马变换函数
-        QString script = QString("gammaTransform(%1)").arg(gamma);
-        webView->page()->runJavaScript(script, [this](const QVariant &result) {
-            if (result.isValid() && !result.toString().isEmpty()) {
-                // 更新图像
-                updateImageWithBase64(result.toString());
-            }
-        });
-    }
+    TRACE_SCOPE("ui", "applyGammaTransform");
+    applyOperation(ImageOperation::gammaTransform(gamma));
 }
 
 // 创建边缘检测滑块
 void MainWindow::createEdgeDetectionSlider() {
     // 如果已存在边缘检测设置窗口且可见，则不再创建新窗口
     if (edgeDock && edgeDock->isVisible()) {
-        applyEdgeDetection(30);  // 默认值30
+        applyEdgeSettings();
         edgeDock->setFocus();    // 设置焦点到已有窗口
         return;
     }
     
     // 如果窗口存在但不可见，则显示它
     if (edgeDock) {
-        applyEdgeDetection(30);
+        applyEdgeSettings();
         edgeDock->show();
         return;
     }
@@ -602,41 +1215,79 @@ void MainWindow::createEdgeDetectionSlider() {
     QWidget *content = new QWidget(edgeDock);
     QVBoxLayout *layout = new QVBoxLayout(content);
     
+    // 检测方式
+    edgeModeCombo = new QComboBox(content);
+    edgeModeCombo->addItem(tr("Sobel"));
+    edgeModeCombo->addItem(tr("Canny"));
+    layout->addWidget(edgeModeCombo);
+    
+    // Sobel: 单一阈值
+    sobelPanel = new QWidget(content);
+    QVBoxLayout *sobelLayout = new QVBoxLayout(sobelPanel);
+    sobelLayout->setContentsMargins(0, 0, 0, 0);
+    
     // 创建标题标签
-    QLabel *titleLabel = new QLabel(tr("阈值调整:"), content);
+    QLabel *titleLabel = new QLabel(tr("阈值调整:"), sobelPanel);
     titleLabel->setAlignment(Qt::AlignCenter);
     titleLabel->setStyleSheet("font-weight: bold;");
     
     // 创建滑块 - 边缘检测阈值范围从0到100
-    edgeSlider = new QSlider(Qt::Horizontal, content);
+    edgeSlider = new QSlider(Qt::Horizontal, sobelPanel);
     edgeSlider->setRange(0, 100);  // 阈值范围0-100
     edgeSlider->setValue(30);      // 默认值30
     edgeSlider->setTickPosition(QSlider::TicksBelow);
     edgeSlider->setTickInterval(5); // 每5个单位一个刻度
     
     // 创建显示当前阈值的标签
-    edgeLabel = new QLabel("30", content);
+    edgeLabel = new QLabel("30", sobelPanel);
     edgeLabel->setAlignment(Qt::AlignCenter);
     
     // 添加一个水平布局用于显示最小值和最大值
     QHBoxLayout *rangeLayout = new QHBoxLayout();
-    QLabel *minLabel = new QLabel("0", content);
-    QLabel *maxLabel = new QLabel("100", content);
+    QLabel *minLabel = new QLabel("0", sobelPanel);
+    QLabel *maxLabel = new QLabel("100", sobelPanel);
     rangeLayout->addWidget(minLabel);
     rangeLayout->addStretch();
     rangeLayout->addWidget(maxLabel);
     
     // 添加到布局
-    layout->addWidget(titleLabel);
-    layout->addWidget(edgeSlider);
-    layout->addWidget(edgeLabel);
-    layout->addLayout(rangeLayout);
+    sobelLayout->addWidget(titleLabel);
+    sobelLayout->addWidget(edgeSlider);
+    sobelLayout->addWidget(edgeLabel);
+    sobelLayout->addLayout(rangeLayout);
     
     // 添加说明文字
-    QLabel *infoLabel = new QLabel(tr("较低的值: 检测更多边缘\n较高的值: 仅检测明显边缘"), content);
+    QLabel *infoLabel = new QLabel(tr("较低的值: 检测更多边缘\n较高的值: 仅检测明显边缘"), sobelPanel);
     infoLabel->setAlignment(Qt::AlignCenter);
     infoLabel->setStyleSheet("color: #666; font-size: 12px;");
-    layout->addWidget(infoLabel);
+    sobelLayout->addWidget(infoLabel);
+    layout->addWidget(sobelPanel);
+    
+    // Canny: 高低两个阈值, 范围0-255
+    cannyPanel = new QWidget(content);
+    QVBoxLayout *cannyLayout = new QVBoxLayout(cannyPanel);
+    cannyLayout->setContentsMargins(0, 0, 0, 0);
+    
+    cannyHighLabel = new QLabel(tr("高阈值: 100"), cannyPanel);
+    cannyHighSlider = new QSlider(Qt::Horizontal, cannyPanel);
+    cannyHighSlider->setRange(0, 255);
+    cannyHighSlider->setValue(100);
+    cannyLowLabel = new QLabel(tr("低阈值: 40"), cannyPanel);
+    cannyLowSlider = new QSlider(Qt::Horizontal, cannyPanel);
+    cannyLowSlider->setRange(0, 255);
+    cannyLowSlider->setValue(40);
+    
+    cannyLayout->addWidget(cannyHighLabel);
+    cannyLayout->addWidget(cannyHighSlider);
+    cannyLayout->addWidget(cannyLowLabel);
+    cannyLayout->addWidget(cannyLowSlider);
+    
+    QLabel *cannyInfoLabel = new QLabel(tr("高于高阈值的为边缘\n高于低阈值且与边缘相连的也保留"), cannyPanel);
+    cannyInfoLabel->setAlignment(Qt::AlignCenter);
+    cannyInfoLabel->setStyleSheet("color: #666; font-size: 12px;");
+    cannyLayout->addWidget(cannyInfoLabel);
+    cannyPanel->hide();
+    layout->addWidget(cannyPanel);
     
     layout->addStretch();
     
@@ -653,6 +1304,28 @@ void MainWindow::createEdgeDetectionSlider() {
         edgeLabel->setText(QString::number(value));
         applyEdgeDetection(value);
     });
+    connect(edgeModeCombo, &QComboBox::currentIndexChanged, this, [this](int index) {
+        sobelPanel->setVisible(index == 0);
+        cannyPanel->setVisible(index == 1);
+        applyEdgeSettings();
+    });
+    // 低阈值不超过高阈值: 拖动其中一个越过另一个时带着另一个一起移动
+    connect(cannyHighSlider, &QSlider::valueChanged, this, [this](int value) {
+        cannyHighLabel->setText(tr("高阈值: %1").arg(value));
+        if (cannyLowSlider->value() > value) {
+            cannyLowSlider->setValue(value);    // 由低阈值的槽应用
+            return;
+        }
+        applyEdgeSettings();
+    });
+    connect(cannyLowSlider, &QSlider::valueChanged, this, [this](int value) {
+        cannyLowLabel->setText(tr("低阈值: %1").arg(value));
+        if (cannyHighSlider->value() < value) {
+            cannyHighSlider->setValue(value);
+            return;
+        }
+        applyEdgeSettings();
+    });
     
     // 连接关闭信号
     connect(edgeDock, &QDockWidget::visibilityChanged, this, [this](bool visible) {
@@ -660,32 +1333,86 @@ void MainWindow::createEdgeDetectionSlider() {
     });
     
     // 应用初始阈值
-    applyEdgeDetection(30);
+    applyEdgeSettings();
 }
 
 // 应用边缘检测
 void MainWindow::applyEdgeDetection(int threshold) {
-    if (!currentPixmap.isNull()) {
-        // 调用JavaScript的边缘检测函数
-        QString script = QString("edgeDetection(%1)").arg(threshold);
-        webView->page()->runJavaScript(script, [this](const QVariant &result) {
-            if (result.isValid() && !result.toString().isEmpty()) {
-                // 更新图像
-                updateImageWithBase64(result.toString());
-            }
-        });
+    TRACE_SCOPE("ui", "applyEdgeDetection");
+    applyOperation(ImageOperation::edgeDetection(threshold));
+}
+
+// 应用 Canny 边缘检测, 同一图像上只改变阈值时复用已算好的梯度
+void MainWindow::applyCanny(int lowThreshold, int highThreshold) {
+    TRACE_SCOPE("ui", "applyCanny");
+    applyOperation(ImageOperation::canny(lowThreshold, highThreshold));
+}
+
+// 按边缘检测窗口当前的方式和阈值应用
+void MainWindow::applyEdgeSettings() {
+    if (edgeModeCombo && edgeModeCombo->currentIndex() == 1) {
+        applyCanny(cannyLowSlider->value(), cannyHighSlider->value());
+    } else {
+        applyEdgeDetection(edgeSlider ? edgeSlider->value() : 30);
     }
 }
 
 void MainWindow::saveImage() {
-    if (!currentPixmap.isNull()) {
-        // 使用QFileDialog保存图片
-        QString fileName = QFileDialog::getSaveFileName(
-            this,  tr("Save Image"), "", tr("Images (*.png *.jpg *.bmp)"));
-        if (!fileName.isEmpty()) {
-            // 保存图片
-            currentPixmap.save(fileName);
+    if (document.isNull()) return;
+    if (imageSaver->isRunning()) {
+        ui->statusbar->showMessage(tr("正在保存上一张图片, 请稍候"), 3000);
+        return;
+    }
+
+    // 使用QFileDialog保存图片
+    QString fileName = QFileDialog::getSaveFileName(
+        this,  tr("Save Image"), "", tr("Images (*.png *.jpg *.jpeg *.bmp *.webp *.tif *.tiff)"));
+    if (fileName.isEmpty()) return;
+    if (QFileInfo(fileName).suffix().isEmpty()) {
+        fileName += ".png";
+    }
+    const QByteArray format = ImageSaver::formatForFile(fileName);
+    if (format.isEmpty()) {
+        QMessageBox::warning(this, tr("保存图片"), tr("不支持的文件格式: %1").arg(QFileInfo(fileName).suffix()));
+        return;
+    }
+
+    SaveOptionsDialog optionsDialog(format, lastSaveOptions, this);
+    if (optionsDialog.exec() != QDialog::Accepted) return;
+    ImageSaver::Options options = optionsDialog.options();
+    options.fileName = fileName;
+    lastSaveOptions = options;
+
+    // 在全分辨率主图上重放操作链后编码, 都在后台线程进行; 对话框不阻塞主窗口, 保存期间可以继续编辑
+    TRACE_SCOPE("ui", "saveImage");
+    QProgressDialog *progressDialog = new QProgressDialog(tr("正在计算全分辨率结果..."), tr("取消"), 0, 0, this);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+    progressDialog->setWindowModality(Qt::NonModal);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(500);
+    connect(progressDialog, &QProgressDialog::canceled, imageSaver, &ImageSaver::cancel);
+    connect(imageSaver, &ImageSaver::progress, progressDialog,
+            [progressDialog](ImageSaver::Stage stage, qint64 bytesWritten) {
+        if (stage == ImageSaver::Stage::Rendering) {
+            progressDialog->setLabelText(tr("正在计算全分辨率结果..."));
+        } else {
+            progressDialog->setLabelText(tr("正在编码, 已写出 %1 MB").arg(bytesWritten / (1024.0 * 1024.0), 0, 'f', 1));
+        }
+    });
+    connect(imageSaver, &ImageSaver::finished, progressDialog,
+            [this, progressDialog](bool success, const QString &message) {
+        const bool canceled = progressDialog->wasCanceled();
+        progressDialog->close();
+        if (success) {
+            ui->statusbar->showMessage(message, 5000);
+        } else if (!canceled) {
+            QMessageBox::warning(this, tr("保存图片"), message);
         }
+    });
+
+    if (!imageSaver->start(document.fullResolutionJob(), options)) {
+        progressDialog->close();
     }
 }
 
@@ -699,6 +1426,7 @@ void MainWindow::showAboutDialog()
 }
 
 void MainWindow::onActionOpenVideoTriggered() {
+#ifdef IMAGE_VIDEO
     // 打开文件对话框选择视频文件
     QString videoPath = QFileDialog::getOpenFileName(
         this,
@@ -709,133 +1437,45 @@ void MainWindow::onActionOpenVideoTriggered() {
     
     if(videoPath.isEmpty()) return;
     
-    // 先创建媒体播放器，但暂不播放
-    if (!mediaPlayer) {
-        mediaPlayer = new QMediaPlayer(this);
-    }
-    
-    // 创建视频接收器 (Qt 6特有)
-    if (!videoSink) {
-        videoSink = new QVideoSink(this);
-        connect(videoSink, &QVideoSink::videoFrameChanged, this, &MainWindow::onVideoFrameChanged);
-    }
-    
-    // 设置视频输出
-    mediaPlayer->setVideoSink(videoSink);
-    
-    // 设置视频源
-    mediaPlayer->setSource(QUrl::fromLocalFile(videoPath));
-    
-    // 在JavaScript函数初始化成功后，添加控制按钮并开始播放
-    QWidget *controlPanel = new QWidget(this);
-    QHBoxLayout *controlLayout = new QHBoxLayout(controlPanel);
-    
-    QPushButton *playButton = new QPushButton(tr("播放"), controlPanel);
-    QPushButton *pauseButton = new QPushButton(tr("暂停"), controlPanel);
-    QPushButton *stopButton = new QPushButton(tr("停止"), controlPanel);
-    
-    controlLayout->addWidget(playButton);
-    controlLayout->addWidget(pauseButton);
-    controlLayout->addWidget(stopButton);
-    
-    // 添加返回按钮
-    returnButton = new QPushButton(tr("返回图像编辑"), controlPanel);
-    controlLayout->addWidget(returnButton);
-    
-    controlPanel->setLayout(controlLayout);
-    
-    // 添加到布局
-    QVBoxLayout *layout = qobject_cast<QVBoxLayout*>(centralWidget()->layout());
-    if (layout) {
-        layout->addWidget(controlPanel);
+    // 视频组件在第一次打开视频时创建
+    if (!videoSession) {
+        videoSession = new VideoSession(this);
+        connect(videoSession, &VideoSession::frameReady, this, &MainWindow::displayImageInCanvas);
+        connect(videoSession, &VideoSession::closeRequested, this, &MainWindow::cleanupVideoMode);
     }
     
-    // 连接按钮信号
-    connect(playButton, &QPushButton::clicked, mediaPlayer, &QMediaPlayer::play);
-    connect(pauseButton, &QPushButton::clicked, mediaPlayer, &QMediaPlayer::pause);
-    connect(stopButton, &QPushButton::clicked, mediaPlayer, &QMediaPlayer::stop);
-    connect(returnButton, &QPushButton::clicked, this, &MainWindow::cleanupVideoMode);
-    
     // 设置标志
     videoProcessingMode = true;
+    updateTileSource();
+    
+    // 开始播放, 帧缩放到画布显示尺寸
+    videoSession->open(videoPath, canvasProxySize());
     
     // 隐藏图像列表
     if (imageList && imageList->isVisible()) {
         imageList->setVisible(false);
         toggleImageListAction->setChecked(false);
     }
-    
-    // 开始播放
-    mediaPlayer->play();
-}
-
-void MainWindow::onVideoFrameChanged(const QVideoFrame &frame) {
-    if (!videoProcessingMode || !frame.isValid()) {
-        return;
-    }
-    
-    // 限制帧率，避免过多处理
-    static QElapsedTimer fpsTimer;
-    if (!fpsTimer.isValid() || fpsTimer.elapsed() > 100) { // 约10fps
-        fpsTimer.restart();
-        
-        // 将视频帧转换为图像
-        QImage image = frame.toImage();
-        if (image.isNull()) {
-            qDebug() << "无法转换视频帧为图像";
-            return;
-        }
-        
-        // 可选：调整大小以提高性能
-        if (image.width() > 800) {
-            image = image.scaledToWidth(800, Qt::SmoothTransformation);
-        }
-        
-        // 转换为Base64
-        QByteArray byteArray;
-        QBuffer buffer(&byteArray);
-        buffer.open(QIODevice::WriteOnly);
-        image.save(&buffer, "PNG", 80); // 质量80%
-        buffer.close();
-        
-        // 直接调用displayImage函数
-        QString base64Data = QString::fromLatin1(byteArray.toBase64().data());
-        QString imgData = "data:image/png;base64," + base64Data;
-        
-        webView->page()->runJavaScript(
-            QString("displayImage('%1')").arg(imgData)
-        );
-    }
+#endif
 }
 
 void MainWindow::cleanupVideoMode() {
+    if (!videoProcessingMode) return;
+    
     // 停止视频处理
     videoProcessingMode = false;
-    
-    // 停止播放器
-    if (mediaPlayer) {
-        mediaPlayer->stop();
-    }
-    
-    // 移除控制面板
-    QVBoxLayout *layout = qobject_cast<QVBoxLayout*>(centralWidget()->layout());
-    if (layout) {
-        QLayoutItem *item = layout->takeAt(layout->count() - 1);
-        if (item) {
-            if (item->widget()) {
-                item->widget()->deleteLater();
-            }
-            delete item;
-        }
-    }
+#ifdef IMAGE_VIDEO
+    videoSession->close();
+#endif
     
     // 重新初始化Canvas
     initializeCanvas();
     
     // 恢复图像显示
-    if (!currentPixmap.isNull()) {
-        QTimer::singleShot(200, [this](){
-            displayImageInCanvas(currentPixmap);
+    if (!currentImage.isNull()) {
+        QTimer::singleShot(200, this, [this](){
+            displayImageInCanvas(currentImage);
+            updateTileSource();
         });
     }
     
@@ -4,34 +4,46 @@
 #include <QMainWindow>
 #include <QDockWidget>
 #include <QPushButton>
+#include <QListWidget>
 #include <QListWidgetItem>
 #include <QMenu>
 #include <QPixmap>
-#include <QWebEngineView>
 #include <QAction>
 #include "toolbar.h" // 引入新的工具栏类
 #include "imagelist.h"
+#include "imagedocument.h"
+#include "imagesaver.h"
+#include "imageviewer.h"
+#include "previewscheduler.h"
+#include "histogram.h"
+#include "histogramwidget.h"
+#include <QComboBox>
 #include <QLabel>
 #include <QTcpServer>
 #include <QFile>
-#include <QMediaPlayer>
-#include <QVideoSink>
-#include <QVideoFrame>
 #include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
+class VideoSession;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    explicit MainWindow(ImageViewer::Backend viewerBackend, QWidget *parent = nullptr);
     ~MainWindow();
 
+    // 启动参数中的图片, 在主窗口第一次显示后打开
+    void openImagesAtStartup(const QStringList &paths);
+
 protected:
     void showEvent(QShowEvent *event) override;
     void hideEvent(QHideEvent *event) override;
@@ -43,49 +55,101 @@ private slots:
     void onActionOpenTriggered();
     void initializeCanvas();
     void handleToolbarButtonClicked(int index);
-    void onImageSelected(const QPixmap &pixmap, const QString &path);
+    void onImageSelected(const QImage &image, const QString &path);
+    void onTiledImageSelected(const std::shared_ptr<TiledImageStore> &store, const QString &path);
+    void updateCacheStatus();
     void onImageDeleted(const QString &path);
-    void displayImageInCanvas(const QPixmap &pixmap);
-    void updateImageWithBase64(const QString &imageDataUrl);
+    void displayImageInCanvas(const QImage &image);
+    void onMosaicApplied(const QVector<MosaicDab> &dabs);
+    void showPreview();
+    void onPreviewReady(const QImage &image, quint64 generation);
+    void onReplayFinished(const EditStack::Replay &replay, const QImage &result, const QImage &kept);
+    void onPyramidReady();
+    void onWholeLevelReady();
+    void onFirstShown();
+    void onFirstFrameShown();
+    void undoEdit();
+    void redoEdit();
+    void setTracingEnabled(bool enabled);
+    void exportTrace();
 
     void createThresholdSlider();
     void applyBinarization(int threshold);
+    void onHistogramReady();
+    void applyOtsuThreshold();
+
+    void createMeanFilterSlider();
+    void applyMeanFilter(int radius);
 
     void createGammaSlider();
     void applyGammaTransform(float gamma);
 
     void createEdgeDetectionSlider();
     void applyEdgeDetection(int threshold);
+    void applyCanny(int lowThreshold, int highThreshold);
+    void applyEdgeSettings();
 
     void saveImage();
 
     void showAboutDialog();
     void onActionOpenVideoTriggered();
-    void onVideoFrameChanged(const QVideoFrame &frame);
-    // void applyEffectToAllFrames(const QString &effectName, const QVariant &params = QVariant());
-    // void saveProcessedFrames();
-    // void captureAllFrames(const QString &videoPath);
-    // void showFrameAtIndex(int index);
 
 private:
     Ui::MainWindow *ui;
     bool toolbarWasVisible;
     ToolBar *toolbar; // 使用新的工具栏类
     QAction *toggleToolbarAction;
-    QPixmap currentPixmap;  // 当前显示的图片
-
-    // 使用WebView替代QLabel
-    QWebEngineView *webView;
+    ImageDocument document; // 全分辨率主图与显示代理图
+    // 后台建立的多分辨率金字塔, 更换图像时取消正在进行的建立
+    QFutureWatcher<std::shared_ptr<const ImagePyramid>> pyramidWatcher;
+    std::shared_ptr<std::atomic<bool>> pyramidCancel;
+    void buildPyramid(const QImage &image, const std::shared_ptr<TiledImageStore> &store);
+    void cancelPyramid();
+    // 放大时需要整幅图像的操作链(马赛克与 Canny)在后台对整层执行, 按版本与层识别
+    // 完成前分块由较低一层代替或显示底图
+    QFutureWatcher<QImage> levelWatcher;
+    std::shared_ptr<std::atomic<bool>> levelCancel;
+    quint64 levelRevision = 0;
+    int levelIndex = -1;
+    void requestWholeLevel(int level);
+    // 把当前金字塔和文档版本告知画布页面, 画布放大后按此请求分块
+    void updateTileSource();
+    PreviewScheduler *previewScheduler; // 合并滑块请求, 只显示最新参数的预览
+    QImage currentImage;    // 当前显示的预览图
+    quint64 shownGeneration = 0;        // currentImage 对应的预览请求代号
+    // 提交、撤销或重做之后更新画布: 显示的已是最新预览且只有局部变化时只发送变化的区域
+    void showDocumentChange();
+
+    // 启动时选择的画布: WebEngine 页面或原生绘制
+    ImageViewer *viewer;
+    bool mosaicFlag = false;        // 画布是否处于马赛克画笔模式
+    bool shownOnce = false;
+    QStringList startupImages;
 
     QAction *toggleImageListAction;
     bool imageListWasVisible;
     ImageList *imageList;
+    ImageCache *imageCache;         // 已解码图像缓存
+    QLabel *cacheStatusLabel;       // 状态栏中的缓存统计
 
     QSlider *thresholdSlider;       // 阈值滑块
     QLabel *thresholdLabel;         // 显示当前阈值的标签
     QWidget *sliderContainer;       // 包含滑块和标签的容器
     int currentThreshold = 128;     // 当前阈值
     bool sliderVisible = false; // 阈值滑块是否可见
+    HistogramWidget *histogramWidget = nullptr;
+    QLabel *histogramLabel = nullptr;   // 阈值两侧的像素比例
+    QPushButton *otsuButton = nullptr;
+    Histogram histogram;                // 二值化输入的直方图
+    qint64 histogramKey = 0;            // 统计所用图像的 cacheKey
+    QFutureWatcher<Histogram> histogramWatcher;
+    void updateHistogram();
+    void updateThresholdStats();
+
+    QDockWidget *meanDock = nullptr;
+    QSlider *meanSlider = nullptr;
+    QLabel *meanLabel = nullptr;
+    bool meanVisible = false;
 
     QDockWidget *gammaDock = nullptr;
     QSlider *gammaSlider = nullptr;
@@ -95,19 +159,44 @@ private:
     QDockWidget *edgeDock = nullptr;
     QSlider *edgeSlider = nullptr;
     QLabel *edgeLabel = nullptr;
+    QComboBox *edgeModeCombo = nullptr;     // Sobel / Canny
+    QWidget *sobelPanel = nullptr;
+    QWidget *cannyPanel = nullptr;
+    QSlider *cannyLowSlider = nullptr;
+    QSlider *cannyHighSlider = nullptr;
+    QLabel *cannyLowLabel = nullptr;
+    QLabel *cannyHighLabel = nullptr;
     bool edgeVisible = false;
 
-    QMediaPlayer *mediaPlayer = nullptr;
-    QVideoSink *videoSink = nullptr;
-    QPushButton *returnButton = nullptr;
+    // 视频播放与处理, 第一次打开视频时创建; 以 CONFIG+=no_multimedia 构建时始终为空
+    VideoSession *videoSession = nullptr;
     bool videoProcessingMode = false;
 
-    void setupVideoFrameProcessing();
+    QSize canvasProxySize() const;
+
+    QAction *undoAction;
+    QAction *redoAction;
+    void updateEditActions();
+
+    // 操作历史: 列出已提交的操作, 双击参数可调的步骤时打开对应的设置窗口修改该步骤
+    // 修改期间设置窗口的变化替换该步骤, 只从该步骤开始重新计算
+    QDockWidget *historyDock = nullptr;
+    QListWidget *historyList = nullptr;
+    int editingStep = -1;           // 正在修改的步骤, -1 表示设置窗口调整的是新操作
+    bool reopeningStep = false;     // 打开设置窗口并恢复步骤参数期间不应用操作
+    void createHistoryDock();
+    void updateHistoryList();
+    void editHistoryStep(int index);
+    void stopEditingStep();
+    void applyOperation(const ImageOperation &operation);
+    // 切换到另一种操作时, 先把正在调整的操作提交到编辑栈
+    void commitActiveOperationUnless(ImageOperation::Type type);
+
+    QAction *traceAction;
+
     void cleanupVideoMode();
 
-    QVector<QImage> capturedFrames;
-    bool isCapturingFrames = false;
-    int currentFrameIndex = 0;
-    QString currentVideoPath;
+    ImageSaver *imageSaver;         // 在后台线程保存全分辨率结果
+    ImageSaver::Options lastSaveOptions;    // 上一次保存的选项, 作为下一次的初始值
 };
 #endif // MAINWINDOW_H
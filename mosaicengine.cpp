@@ -0,0 +1,158 @@
+﻿#include "mosaicengine.h"
+#include <cmath>
+
+MosaicEngine::MosaicEngine(const QImage &source)
+{
+    setSource(source);
+}
+
+void MosaicEngine::setSource(const QImage &source)
+{
+    input = ImageProcessor::toWorkingFormat(source);
+    output = input;
+    columns = (input.width() + TileSize - 1) / TileSize;
+    rows = (input.height() + TileSize - 1) / TileSize;
+    tables.clear();
+    tables.resize(size_t(columns) * rows);
+    filledBlocks.clear();
+    dirty = QRect();
+}
+
+void MosaicEngine::clear()
+{
+    if (!filledBlocks.isEmpty()) {
+        dirty = dirty.united(output.rect());
+    }
+    output = input;
+    filledBlocks.clear();
+}
+
+QRect MosaicEngine::dabBounds(const MosaicDab &dab, const QSize &size)
+{
+    if (size.isEmpty()) return QRect();
+    const qreal scale = size.width();
+    const int block = qMax(1, qRound(dab.blockSize * scale));
+    const qreal cx = dab.center.x() * scale;
+    const qreal cy = dab.center.y() * scale;
+    const qreal radius = dab.radius * scale;
+
+    const int bx0 = qMax(0, int(std::floor((cx - radius) / block)));
+    const int by0 = qMax(0, int(std::floor((cy - radius) / block)));
+    const int bx1 = qMin((size.width() - 1) / block, int(std::floor((cx + radius) / block)));
+    const int by1 = qMin((size.height() - 1) / block, int(std::floor((cy + radius) / block)));
+    if (bx1 < bx0 || by1 < by0) return QRect();
+
+    return QRect(QPoint(bx0 * block, by0 * block),
+                 QPoint(qMin(size.width(), (bx1 + 1) * block) - 1, qMin(size.height(), (by1 + 1) * block) - 1));
+}
+
+QRect MosaicEngine::takeDirtyRect()
+{
+    const QRect taken = dirty;
+    dirty = QRect();
+    return taken;
+}
+
+const quint32 *MosaicEngine::tileTable(int column, int row)
+{
+    std::unique_ptr<quint32[]> &table = tables[size_t(row) * columns + column];
+    if (table) return table.get();
+
+    const int x0 = column * TileSize;
+    const int y0 = row * TileSize;
+    const int width = qMin(TileSize, input.width() - x0);
+    const int height = qMin(TileSize, input.height() - y0);
+    const int stride = (width + 1) * 3;
+
+    table.reset(new quint32[size_t(stride) * (height + 1)]());
+    quint32 *bits = table.get();
+    for (int y = 0; y < height; ++y) {
+        const uchar *line = input.constScanLine(y0 + y) + x0 * 4;
+        const quint32 *above = bits + size_t(y) * stride;
+        quint32 *current = bits + size_t(y + 1) * stride;
+        quint32 rowSum[3] = { 0, 0, 0 };
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                rowSum[c] += line[x * 4 + c];
+                current[(x + 1) * 3 + c] = above[(x + 1) * 3 + c] + rowSum[c];
+            }
+        }
+    }
+    return bits;
+}
+
+void MosaicEngine::blockSum(int x0, int y0, int x1, int y1, quint64 sum[3])
+{
+    sum[0] = sum[1] = sum[2] = 0;
+    // 块可能跨越分块边界, 分别取各分块内的部分
+    for (int row = y0 / TileSize; row <= (y1 - 1) / TileSize; ++row) {
+        const int top = qMax(y0, row * TileSize) - row * TileSize;
+        const int bottom = qMin(y1, (row + 1) * TileSize) - row * TileSize;
+        for (int column = x0 / TileSize; column <= (x1 - 1) / TileSize; ++column) {
+            const int left = qMax(x0, column * TileSize) - column * TileSize;
+            const int right = qMin(x1, (column + 1) * TileSize) - column * TileSize;
+            const quint32 *table = tileTable(column, row);
+            const int stride = (qMin(TileSize, input.width() - column * TileSize) + 1) * 3;
+            const quint32 *upper = table + size_t(top) * stride;
+            const quint32 *lower = table + size_t(bottom) * stride;
+            for (int c = 0; c < 3; ++c) {
+                sum[c] += lower[right * 3 + c] - lower[left * 3 + c] - upper[right * 3 + c] + upper[left * 3 + c];
+            }
+        }
+    }
+}
+
+QRect MosaicEngine::paint(const MosaicDab &dab)
+{
+    if (input.isNull()) return QRect();
+
+    const int width = input.width();
+    const int height = input.height();
+    const qreal scale = width;
+    const int block = qMax(1, qRound(dab.blockSize * scale));
+    const qreal cx = dab.center.x() * scale;
+    const qreal cy = dab.center.y() * scale;
+    const qreal radius = dab.radius * scale;
+
+    const int bx0 = qMax(0, int(std::floor((cx - radius) / block)));
+    const int by0 = qMax(0, int(std::floor((cy - radius) / block)));
+    const int bx1 = qMin((width - 1) / block, int(std::floor((cx + radius) / block)));
+    const int by1 = qMin((height - 1) / block, int(std::floor((cy + radius) / block)));
+
+    QRect changed;
+    for (int by = by0; by <= by1; ++by) {
+        for (int bx = bx0; bx <= bx1; ++bx) {
+            const int x0 = bx * block, y0 = by * block;
+            const int x1 = qMin(width, x0 + block), y1 = qMin(height, y0 + block);
+
+            // 块内离画笔中心最近的点在半径内才填充
+            const qreal nx = qBound(qreal(x0), cx, qreal(x1 - 1)) - cx;
+            const qreal ny = qBound(qreal(y0), cy, qreal(y1 - 1)) - cy;
+            if (nx * nx + ny * ny > radius * radius) continue;
+
+            const quint64 key = (quint64(block) << 48) | (quint64(by) << 24) | quint64(bx);
+            if (filledBlocks.contains(key)) continue;
+            filledBlocks.insert(key);
+
+            quint64 sum[3];
+            blockSum(x0, y0, x1, y1, sum);
+            const quint64 count = quint64(x1 - x0) * (y1 - y0);
+            const uchar r = uchar(sum[0] / count);
+            const uchar g = uchar(sum[1] / count);
+            const uchar b = uchar(sum[2] / count);
+
+            for (int y = y0; y < y1; ++y) {
+                uchar *line = output.scanLine(y);
+                for (int x = x0; x < x1; ++x) {
+                    line[x * 4] = r;
+                    line[x * 4 + 1] = g;
+                    line[x * 4 + 2] = b;
+                    line[x * 4 + 3] = 255;
+                }
+            }
+            changed = changed.united(QRect(x0, y0, x1 - x0, y1 - y0));
+        }
+    }
+    dirty = dirty.united(changed);
+    return changed;
+}
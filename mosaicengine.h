@@ -0,0 +1,55 @@
+﻿#ifndef MOSAICENGINE_H
+#define MOSAICENGINE_H
+
+#include <QImage>
+#include <QRect>
+#include <QSet>
+#include <memory>
+#include <vector>
+#include "imageprocessor.h"
+
+// 马赛克画笔引擎: 块平均色由积分图(summed-area table)以 O(1) 求得, 与块的大小无关
+// 每次落笔只改写画笔下新覆盖的块, 并返回改写的矩形, 显示端只需重绘这一部分
+// 积分图按 TileSize 分块, 在分块第一次被用到时建立; 大图上只为画过的区域付出时间和内存
+// 块网格、取整方式与落笔顺序的处理和 ImageProcessor::mosaic 相同(后者即由本引擎实现)
+class MosaicEngine
+{
+public:
+    static constexpr int TileSize = 256;
+
+    explicit MosaicEngine(const QImage &source = QImage());
+
+    // 更换原图, 清除之前的落笔
+    void setSource(const QImage &source);
+    bool isNull() const { return input.isNull(); }
+
+    // 落笔坐标与尺寸以图像宽度为单位; 返回本次改写的矩形, 没有新覆盖的块时为空矩形
+    QRect paint(const MosaicDab &dab);
+    // 落笔在 size 大小的图像上可能填充的块的范围
+    static QRect dabBounds(const MosaicDab &dab, const QSize &size);
+    // 清除全部落笔, 结果恢复为原图
+    void clear();
+
+    // 原图叠加全部落笔的结果(工作格式)
+    const QImage &result() const { return output; }
+    // 自上次调用以来改写过的区域
+    QRect takeDirtyRect();
+
+private:
+    // [x0, x1) x [y0, y1) 内 R、G、B 各自之和
+    void blockSum(int x0, int y0, int x1, int y1, quint64 sum[3]);
+    // 分块的积分图: (宽 + 1) x (高 + 1) 个 RGB 三元组, 首行首列为 0
+    // 分块内的和不超过 256 * 256 * 255, 以 32 位保存
+    const quint32 *tileTable(int column, int row);
+
+    QImage input;
+    QImage output;
+    int columns = 0;
+    int rows = 0;
+    std::vector<std::unique_ptr<quint32[]>> tables;
+    // 已填充的块, 同一块只计算一次; 键为 (块大小, 块行, 块列)
+    QSet<quint64> filledBlocks;
+    QRect dirty;
+};
+
+#endif // MOSAICENGINE_H
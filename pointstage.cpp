@@ -0,0 +1,143 @@
+﻿#include "pointstage.h"
+#include "imagekernels.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+#include <QDebug>
+#include <cmath>
+
+PointStage::PointStage()
+{
+    for (int i = 0; i < 256; ++i) {
+        preLut[i] = uchar(i);
+        postLut[i] = uchar(i);
+    }
+}
+
+bool PointStage::isPointOperation(const ImageOperation &operation)
+{
+    switch (operation.type) {
+    case ImageOperation::Grayscale:
+    case ImageOperation::Binarize:
+    case ImageOperation::Gamma:
+    case ImageOperation::Levels:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool PointStage::buildLut(const ImageOperation &operation, uchar *lut)
+{
+    if (operation.type == ImageOperation::Gamma) {
+        if (!(operation.gamma > 0.0f)) {
+            qDebug() << "伽马值必须大于0";
+            return false;
+        }
+        for (int i = 0; i < 256; ++i) {
+            const double value = std::floor(255.0 * std::pow(i / 255.0, 1.0 / operation.gamma) + 0.5);
+            lut[i] = uchar(qMin(255.0, value));
+        }
+        return true;
+    }
+
+    if (operation.type == ImageOperation::Levels) {
+        if (!(operation.gamma > 0.0f)) {
+            qDebug() << "伽马值必须大于0";
+            return false;
+        }
+        // 输入色阶 [black, white] 拉伸到 [0, 255], 中间调按伽马调整
+        const int black = qBound(0, operation.blackPoint, 254);
+        const int white = qBound(black + 1, operation.whitePoint, 255);
+        for (int i = 0; i < 256; ++i) {
+            const double t = qBound(0.0, double(i - black) / (white - black), 1.0);
+            const double value = std::floor(255.0 * std::pow(t, 1.0 / operation.gamma) + 0.5);
+            lut[i] = uchar(qMin(255.0, value));
+        }
+        return true;
+    }
+
+    if (operation.type == ImageOperation::Binarize) {
+        for (int i = 0; i < 256; ++i) {
+            lut[i] = i > operation.threshold ? 255 : 0;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool PointStage::append(const ImageOperation &operation)
+{
+    switch (operation.type) {
+    case ImageOperation::Grayscale:
+        // 已是灰度时再次灰度化不改变结果
+        gray = true;
+        identity = false;
+        return true;
+    case ImageOperation::Binarize: {
+        // 二值化 = 灰度化 + 阶跃曲线
+        uchar lut[256];
+        buildLut(operation, lut);
+        gray = true;
+        appendLut(lut);
+        return true;
+    }
+    case ImageOperation::Gamma:
+    case ImageOperation::Levels: {
+        uchar lut[256];
+        if (!buildLut(operation, lut)) return false;
+        appendLut(lut);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+void PointStage::appendLut(const uchar *lut)
+{
+    uchar *target = gray ? postLut : preLut;
+    for (int i = 0; i < 256; ++i) {
+        target[i] = lut[target[i]];
+    }
+    identity = false;
+}
+
+void PointStage::applyRow(const uchar *src, uchar *dst, int count) const
+{
+    const ImageKernels::KernelTable &k = ImageKernels::kernels();
+    if (gray) {
+        k.grayLut(src, dst, count, preLut, postLut);
+    } else {
+        k.applyLut(src, dst, count, preLut);
+    }
+}
+
+void PointStage::applyRect(uchar *bits, qsizetype stride, const QRect &rect) const
+{
+    if (identity) return;
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        uchar *row = bits + y * stride + rect.left() * 4;
+        applyRow(row, row, rect.width());
+    }
+}
+
+QImage PointStage::run(const QImage &src, const std::atomic<bool> *cancel) const
+{
+    TRACE_SCOPE("kernel", "pointStage");
+    const QImage input = ImageProcessor::toWorkingFormat(src);
+    if (input.isNull() || identity) return input;
+
+    QImage output(input.size(), ImageProcessor::WorkingFormat);
+    const uchar *srcBits = input.constBits();
+    const qsizetype srcStride = input.bytesPerLine();
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+
+    const bool finished = TileScheduler::run(input.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            applyRow(srcBits + y * srcStride + tile.left() * 4,
+                     dstBits + y * dstStride + tile.left() * 4, tile.width());
+        }
+    }, cancel);
+    return finished ? output : QImage();
+}
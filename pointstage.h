@@ -0,0 +1,43 @@
+﻿#ifndef POINTSTAGE_H
+#define POINTSTAGE_H
+
+#include <QImage>
+#include <QRect>
+#include <atomic>
+#include "imageprocessor.h"
+
+// 融合的点运算阶段: 把连续的点运算合成为一次遍历
+// 伽马、色阶等逐通道曲线合成为一张 256 项查找表; 灰度化与二值化把三个通道合为灰度,
+// 其后的曲线再合成到第二张表上, 即 v = post[(pre[c0] + pre[c1] + pre[c2] + 1) / 3]
+// 合成结果与逐个执行完全一致
+class PointStage
+{
+public:
+    PointStage();
+
+    // 是否为可融合的点运算
+    static bool isPointOperation(const ImageOperation &operation);
+    // 生成逐通道曲线操作的查找表, 参数无效时返回 false
+    static bool buildLut(const ImageOperation &operation, uchar *lut);
+
+    // 追加一个点运算, 参数无效时返回 false
+    bool append(const ImageOperation &operation);
+    bool isIdentity() const { return identity; }
+
+    // 处理一行中连续的 count 个像素, src 与 dst 可以相同
+    void applyRow(const uchar *src, uchar *dst, int count) const;
+    // 原地处理图像中的一个矩形区域
+    void applyRect(uchar *bits, qsizetype stride, const QRect &rect) const;
+    // 分块并行处理整幅图像
+    QImage run(const QImage &src, const std::atomic<bool> *cancel = nullptr) const;
+
+private:
+    void appendLut(const uchar *lut);
+
+    uchar preLut[256];
+    uchar postLut[256];
+    bool gray = false;
+    bool identity = true;
+};
+
+#endif // POINTSTAGE_H
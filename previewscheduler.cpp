@@ -0,0 +1,134 @@
+﻿#include "previewscheduler.h"
+#include "tracer.h"
+#include <QtConcurrent/QtConcurrentRun>
+
+PreviewScheduler::PreviewScheduler(QObject *parent)
+    : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<Result>::finished, this, &PreviewScheduler::onJobFinished);
+}
+
+PreviewScheduler::~PreviewScheduler()
+{
+    // 等待后台任务结束, 任务只访问自己持有的数据
+    cancel();
+    watcher.waitForFinished();
+}
+
+quint64 PreviewScheduler::request(const EditStack::Replay &replay, const ImageOperation &operation)
+{
+    ++generation;
+
+    // 没有操作且无需重放时直接显示底图, 不需要后台计算; 正在执行的任务结果已无意义
+    const QImage &base = replay.base;
+    if ((!operation.isValid() && replay.chain.isEmpty()) || base.isNull()) {
+        hasPending = false;
+        pending = Job();
+        if (running) {
+            runningCancel->store(true, std::memory_order_relaxed);
+        }
+        publishedGeneration = generation;
+        emit previewReady(base, generation);
+        return generation;
+    }
+
+    Job job;
+    job.replay = replay;
+    job.operation = operation;
+    job.generation = generation;
+    job.requestedNs = Tracer::isEnabled() ? Tracer::now() : 0;
+
+    if (running) {
+        // 覆盖等待中的请求, 当前任务结束后再开始
+        // 拖动滑块时当前任务继续执行, 其结果作为中间画面显示
+        if (!continuesRunning(job)) {
+            runningCancel->store(true, std::memory_order_relaxed);
+        }
+        pending = job;
+        hasPending = true;
+    } else {
+        start(job);
+    }
+    return generation;
+}
+
+void PreviewScheduler::cancel()
+{
+    ++generation;
+    publishedGeneration = generation;
+    hasPending = false;
+    pending = Job();
+    if (running) {
+        runningCancel->store(true, std::memory_order_relaxed);
+    }
+}
+
+void PreviewScheduler::start(const Job &job)
+{
+    running = true;
+    runningGeneration = job.generation;
+    runningRequestedNs = job.requestedNs;
+    runningReplay = job.replay;
+    runningSignature = signature(job);
+    runningCancel = std::make_shared<std::atomic<bool>>(false);
+
+    const std::shared_ptr<std::atomic<bool>> cancelFlag = runningCancel;
+    watcher.setFuture(QtConcurrent::run([job, cancelFlag]() {
+        TRACE_SCOPE("preview", "preview.compute");
+        Result result;
+        result.node = job.replay.chain.isEmpty() ? job.replay.base
+                                                 : job.replay.run(&result.kept, cancelFlag.get());
+        if (result.node.isNull()) return result;
+        result.image = job.operation.isValid()
+            ? ImageProcessor::applyPreview(result.node, job.operation, cancelFlag.get())
+            : result.node;
+        return result;
+    }));
+}
+
+bool PreviewScheduler::continuesRunning(const Job &job) const
+{
+    return job.replay.base.cacheKey() == runningReplay.base.cacheKey() && signature(job) == runningSignature;
+}
+
+QVector<ImageOperation::Type> PreviewScheduler::signature(const Job &job)
+{
+    QVector<ImageOperation::Type> types;
+    for (const ImageOperation &operation : job.replay.chain) {
+        types.append(operation.type);
+    }
+    types.append(job.operation.type);
+    return types;
+}
+
+void PreviewScheduler::onJobFinished()
+{
+    running = false;
+    const Result finished = watcher.result();
+    const QImage &result = finished.image;
+    const quint64 finishedGeneration = runningGeneration;
+
+    // 重放的结果不随预览过期, 编辑栈按版本判断是否仍然有效
+    if (!runningReplay.chain.isEmpty() && !finished.node.isNull()) {
+        emit replayFinished(runningReplay, finished.node, finished.kept);
+    }
+    runningReplay = EditStack::Replay();
+
+    // 被取消的结果为空; 比已发出的结果旧的直接丢弃, 画面不会回退
+    if (finishedGeneration > publishedGeneration && !result.isNull()) {
+        publishedGeneration = finishedGeneration;
+        // 从请求到结果可用的总延迟, 包括排队等待前一个任务的时间
+        if (runningRequestedNs > 0) {
+            Tracer::addComplete("preview", "preview.latency", runningRequestedNs,
+                                Tracer::now() - runningRequestedNs);
+        }
+        emit previewReady(result, finishedGeneration);
+    }
+
+    if (hasPending) {
+        hasPending = false;
+        const Job job = pending;
+        pending = Job();
+        start(job);
+    }
+}
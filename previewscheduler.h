@@ -0,0 +1,78 @@
+﻿#ifndef PREVIEWSCHEDULER_H
+#define PREVIEWSCHEDULER_H
+
+#include <QObject>
+#include <QImage>
+#include <QFutureWatcher>
+#include <atomic>
+#include <memory>
+#include "editstack.h"
+#include "imageprocessor.h"
+
+// 预览调度器: 滑块拖动时合并请求, 只计算最新的参数
+// 已提交操作的结果未缓存时(修改历史步骤、代理图重建后), 先在同一任务中从最近的已缓存节点重放
+// 同一时间最多一个任务在后台线程执行、一个请求等待; 新请求覆盖等待中的请求
+// 拖动滑块(底图与操作种类不变)时正在执行的任务不取消, 完成后照常发出结果, 再开始等待中的请求,
+// 因此拖动过程中画面持续更新, 从请求到显示不超过两次计算的时间
+// 底图或操作种类改变时正在执行的结果已无意义, 直接取消
+// 每个请求带递增的代号, 发出的结果代号递增, 比已发出的结果旧的不再发出
+class PreviewScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PreviewScheduler(QObject *parent = nullptr);
+    ~PreviewScheduler();
+
+    // 请求重放 replay 并在其结果上预览 operation, 返回请求代号
+    quint64 request(const EditStack::Replay &replay, const ImageOperation &operation);
+    // 取消所有请求, 之前的结果都不会再发出
+    void cancel();
+
+    quint64 latestGeneration() const { return generation; }
+
+signals:
+    void previewReady(const QImage &image, quint64 generation);
+    // 重放完成(即使预览已过期), 结果可保存到编辑栈
+    void replayFinished(const EditStack::Replay &replay, const QImage &result, const QImage &kept);
+
+private slots:
+    void onJobFinished();
+
+private:
+    struct Job
+    {
+        EditStack::Replay replay;
+        ImageOperation operation;
+        quint64 generation = 0;
+        qint64 requestedNs = 0;    // 请求时刻, 用于跟踪预览延迟
+    };
+
+    struct Result
+    {
+        QImage image;       // 预览结果
+        QImage node;        // 重放得到的已提交操作结果
+        QImage kept;
+    };
+
+    void start(const Job &job);
+    // job 是正在执行的任务的后续参数: 同一底图上的同一种操作
+    bool continuesRunning(const Job &job) const;
+    static QVector<ImageOperation::Type> signature(const Job &job);
+
+    QFutureWatcher<Result> watcher;
+    std::shared_ptr<std::atomic<bool>> runningCancel;
+    quint64 runningGeneration = 0;
+    qint64 runningRequestedNs = 0;
+    EditStack::Replay runningReplay;
+    QVector<ImageOperation::Type> runningSignature;
+    bool running = false;
+
+    Job pending;
+    bool hasPending = false;
+
+    quint64 generation = 0;
+    quint64 publishedGeneration = 0;    // 已发出的最新结果(或 cancel 时的代号), 更旧的结果丢弃
+};
+
+#endif // PREVIEWSCHEDULER_H
@@ -1,6 +1,5 @@
 QT       += core gui
-QT       += webenginewidgets
-QT       += multimedia multimediawidgets
+QT       += concurrent
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
@@ -10,16 +9,74 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    batchprocessor.cpp \
+    editstack.cpp \
+    histogramwidget.cpp \
+    imagecache.cpp \
+    imagedocument.cpp \
     imagelist.cpp \
+    imagesaver.cpp \
+    imageviewer.cpp \
     main.cpp \
     mainwindow.cpp \
+    previewscheduler.cpp \
+    rasterviewer.cpp \
+    saveoptionsdialog.cpp \
+    startupprofiler.cpp \
+    thumbnailloader.cpp \
     toolbar.cpp
 
 HEADERS += \
+    batchprocessor.h \
+    boundedqueue.h \
+    editstack.h \
+    histogramwidget.h \
+    imagecache.h \
+    imagedocument.h \
     imagelist.h \
+    imagesaver.h \
+    imageviewer.h \
     mainwindow.h \
+    previewscheduler.h \
+    rasterviewer.h \
+    saveoptionsdialog.h \
+    startupprofiler.h \
+    thumbnailloader.h \
     toolbar.h
 
+include(imageengine.pri)
+
+# WebEngine 画布; qmake CONFIG+=no_webengine 构建时只有原生画布, 不依赖 Chromium
+!no_webengine {
+    QT += webenginewidgets
+    DEFINES += IMAGE_VIEWER_WEB
+
+    SOURCES += \
+        frameschemehandler.cpp \
+        webcanvasviewer.cpp
+
+    HEADERS += \
+        frameschemehandler.h \
+        webcanvasviewer.h
+}
+
+# 视频播放、处理与导出; qmake CONFIG+=no_multimedia 构建时没有视频功能, 不依赖 Qt Multimedia
+!no_multimedia {
+    QT += multimedia
+    DEFINES += IMAGE_VIDEO
+
+    SOURCES += \
+        videoexporter.cpp \
+        videopipeline.cpp \
+        videosession.cpp
+
+    HEADERS += \
+        framequeue.h \
+        videoexporter.h \
+        videopipeline.h \
+        videosession.h
+}
+
 FORMS += \
     mainwindow.ui
 
@@ -0,0 +1,441 @@
+﻿#include "rasterviewer.h"
+#include "tracer.h"
+#include <QFrame>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPushButton>
+#include <QSlider>
+#include <QTimer>
+#include <QWheelEvent>
+#include <cmath>
+
+namespace {
+
+quint64 tileKey(int level, int column, int row)
+{
+    return (quint64(level) << 56) | (quint64(column) << 28) | quint64(row);
+}
+
+// 绘制时不再逐次转换格式
+QImage toDisplayFormat(const QImage &image)
+{
+    return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+} // namespace
+
+RasterViewer::RasterViewer(QWidget *parent)
+    : ImageViewer(parent)
+    , tiles(MaxCachedTiles)
+{
+    tileTimer = new QTimer(this);
+    tileTimer->setSingleShot(true);
+    tileTimer->setInterval(0);
+    connect(tileTimer, &QTimer::timeout, this, &RasterViewer::loadNextTile);
+
+    createMosaicControls();
+}
+
+void RasterViewer::showImage(const QImage &image)
+{
+    if (image.isNull()) return;
+    TRACE_SCOPE("canvas", "raster.showImage");
+    frame = toDisplayFormat(image);
+    restartMosaic();
+    update();
+}
+
+void RasterViewer::showPatches(const QVector<ImagePatch> &patches)
+{
+    if (frame.isNull() || patches.isEmpty()) return;
+    TRACE_SCOPE("canvas", "raster.showPatches");
+
+    // 帧只由本控件持有, 原地写入不会复制整帧
+    QPainter painter(&frame);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (const ImagePatch &patch : patches) {
+        painter.drawImage(patch.rect.topLeft(), patch.pixels);
+    }
+    painter.end();
+
+    if (mosaicMode) {
+        restartMosaic();
+        update();
+        return;
+    }
+    for (const ImagePatch &patch : patches) {
+        update(widgetRect(patch.rect));
+    }
+}
+
+void RasterViewer::showWelcome()
+{
+    frame = QImage();
+    clearMosaic();
+    update();
+}
+
+void RasterViewer::reset()
+{
+    setMosaicMode(false);
+    setTileSource(TileSource());
+    showWelcome();
+}
+
+void RasterViewer::setTileSource(const TileSource &source)
+{
+    const bool sameImage = source.isValid() && tileSource.isValid() && source.imageSize == tileSource.imageSize;
+    tiles.clear();
+    pendingTiles.clear();
+    failedTiles.clear();
+    tileSource = source;
+    if (!sameImage) {
+        resetView();
+    }
+    update();
+}
+
+void RasterViewer::setTileProvider(const TileProvider &provider)
+{
+    tileProvider = provider;
+}
+
+void RasterViewer::setMosaicMode(bool enabled)
+{
+    if (enabled == mosaicMode) return;
+    if (enabled && frame.isNull()) {
+        emit mosaicModeChanged(false);
+        return;
+    }
+
+    // 马赛克在适应窗口的画面上绘制
+    mosaicMode = enabled;
+    painting = false;
+    dragging = false;
+    resetView();
+    mosaicEngine.setSource(enabled ? frame : QImage());
+    clearMosaic();
+    mosaicControls->setVisible(enabled);
+    mosaicControls->raise();
+    emit mosaicModeChanged(enabled);
+}
+
+QRectF RasterViewer::canvasRect() const
+{
+    const QSizeF size = displaySize();
+    return QRectF(QPointF((width() - size.width()) / 2, (height() - size.height()) / 2), size);
+}
+
+qreal RasterViewer::fitScale() const
+{
+    if (!tileSource.isValid()) return 1;
+    const QRectF canvas = canvasRect();
+    return qMin(canvas.width() / tileSource.imageSize.width(), canvas.height() / tileSource.imageSize.height());
+}
+
+QRect RasterViewer::widgetRect(const QRect &frameRect) const
+{
+    const QRectF target = imageRect();
+    if (target.isEmpty() || frame.isNull()) return QRect();
+    const qreal scale = target.width() / frame.width();
+    const QRectF area(target.left() + frameRect.left() * scale, target.top() + frameRect.top() * scale,
+                      frameRect.width() * scale, frameRect.height() * scale);
+    // 平滑缩放会影响相邻的一个像素
+    return area.toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+bool RasterViewer::isZoomed() const
+{
+    return zoom > 1 && tileSource.isValid();
+}
+
+void RasterViewer::resetView()
+{
+    zoom = 1;
+    if (tileSource.isValid()) {
+        center = QPointF(tileSource.imageSize.width() / 2.0, tileSource.imageSize.height() / 2.0);
+    }
+    update();
+}
+
+QRectF RasterViewer::imageRect() const
+{
+    const QRectF canvas = canvasRect();
+    if (isZoomed()) {
+        const qreal scale = fitScale() * zoom;
+        const QSizeF size = QSizeF(tileSource.imageSize) * scale;
+        return QRectF(canvas.center() - center * scale, size);
+    }
+    if (frame.isNull()) return QRectF();
+
+    const qreal scale = qMin(canvas.width() / frame.width(), canvas.height() / frame.height());
+    const QSizeF size = QSizeF(frame.size()) * scale;
+    return QRectF(canvas.center() - QPointF(size.width() / 2, size.height() / 2), size);
+}
+
+void RasterViewer::paintEvent(QPaintEvent *)
+{
+    TRACE_SCOPE("canvas", "raster.paint");
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(0xf0, 0xf0, 0xf0));
+    const QRectF canvas = canvasRect();
+    painter.fillRect(canvas, Qt::white);
+
+    if (frame.isNull()) {
+        painter.setPen(QColor(0x66, 0x66, 0x66));
+        painter.setFont(QFont("Arial", 18));
+        painter.drawText(canvas, Qt::AlignCenter, tr("选择图片以在此查看"));
+        return;
+    }
+
+    // 放大后先绘制放大的帧作为底图, 再绘制可见的清晰分块
+    painter.setClipRect(canvas);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    const QRectF target = imageRect();
+    painter.drawImage(target, mosaicPreview.isNull() ? frame : mosaicPreview);
+    if (isZoomed()) {
+        drawTiles(painter, target);
+    }
+    if (!firstFrameReported) {
+        firstFrameReported = true;
+        QTimer::singleShot(0, this, &RasterViewer::firstFrameShown);
+    }
+}
+
+void RasterViewer::drawTiles(QPainter &painter, const QRectF &target)
+{
+    // 每个层像素不小于一个屏幕像素的最小一层; 每层尺寸为上一层的一半并向上取整
+    const QSize imageSize = tileSource.imageSize;
+    const qreal scale = target.width() / imageSize.width();
+    const int level = qBound(0, int(std::floor(std::log2(1 / scale))), tileSource.levels - 1);
+    const int levelWidth = int((qint64(imageSize.width()) + (1LL << level) - 1) >> level);
+    const int levelHeight = int((qint64(imageSize.height()) + (1LL << level) - 1) >> level);
+    const qreal levelToScreen = target.width() / levelWidth;
+    const int size = tileSource.tileSize;
+
+    const QRectF visible = canvasRect().intersected(target);
+    const int firstColumn = qMax(0, int((visible.left() - target.left()) / levelToScreen / size));
+    const int lastColumn = qMin((levelWidth - 1) / size, int((visible.right() - target.left()) / levelToScreen / size));
+    const int firstRow = qMax(0, int((visible.top() - target.top()) / levelToScreen / size));
+    const int lastRow = qMin((levelHeight - 1) / size, int((visible.bottom() - target.top()) / levelToScreen / size));
+
+    // 只请求当前可见而缺少的分块, 之前视图中未请求的分块不再需要
+    pendingTiles.clear();
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const quint64 key = tileKey(level, column, row);
+            if (const QImage *tile = tiles.object(key)) {
+                const QPointF topLeft = target.topLeft() + QPointF(column, row) * size * levelToScreen;
+                painter.drawImage(QRectF(topLeft, QSizeF(tile->size()) * levelToScreen), *tile);
+            } else if (!failedTiles.contains(key)) {
+                pendingTiles.append(key);
+            }
+        }
+    }
+    if (!pendingTiles.isEmpty() && !tileTimer->isActive()) {
+        tileTimer->start();
+    }
+}
+
+void RasterViewer::loadNextTile()
+{
+    if (pendingTiles.isEmpty() || !tileProvider || !tileSource.isValid()) return;
+    const quint64 key = pendingTiles.takeFirst();
+    const int level = int(key >> 56);
+    const int column = int((key >> 28) & 0xFFFFFFF);
+    const int row = int(key & 0xFFFFFFF);
+
+    const QImage tile = tileProvider(tileSource.revision, level, column, row);
+    if (tile.isNull()) {
+        failedTiles.insert(key);
+    } else {
+        tiles.insert(key, new QImage(toDisplayFormat(tile)));
+    }
+    // 重绘时重新计算可见范围内仍缺少的分块
+    update();
+}
+
+void RasterViewer::resizeEvent(QResizeEvent *event)
+{
+    ImageViewer::resizeEvent(event);
+    // 立即按新的尺寸重绘已有的帧, 清晰的图像由主窗口稍后发送
+    mosaicControls->adjustSize();
+    mosaicControls->move((width() - mosaicControls->width()) / 2, height() - mosaicControls->height() - 10);
+}
+
+// 滚轮以光标为中心缩放, 最小为适应窗口
+void RasterViewer::wheelEvent(QWheelEvent *event)
+{
+    if (frame.isNull() || !tileSource.isValid() || mosaicMode) {
+        event->ignore();
+        return;
+    }
+    const QPointF offset = event->position() - canvasRect().center();
+    const QPointF imagePoint = center + offset / (fitScale() * zoom);
+
+    const qreal maxZoom = qMax(qreal(1), MaxScale / fitScale());
+    zoom = qBound(qreal(1), zoom * std::pow(1.0015, event->angleDelta().y()), maxZoom);
+    if (zoom <= 1) {
+        resetView();
+    } else {
+        center = imagePoint - offset / (fitScale() * zoom);
+        update();
+    }
+    event->accept();
+}
+
+void RasterViewer::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) return;
+    if (mosaicMode) {
+        if (canvasRect().contains(event->position())) {
+            painting = true;
+            addDab(event->position());
+        }
+        return;
+    }
+    if (isZoomed()) {
+        dragging = true;
+        lastMousePosition = event->position();
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void RasterViewer::mouseMoveEvent(QMouseEvent *event)
+{
+    if (painting) {
+        addDab(event->position());
+        return;
+    }
+    if (!dragging) return;
+
+    // 放大后拖动平移
+    const qreal scale = fitScale() * zoom;
+    const QPointF delta = (event->position() - lastMousePosition) / scale;
+    lastMousePosition = event->position();
+    center = QPointF(qBound(0.0, center.x() - delta.x(), qreal(tileSource.imageSize.width())),
+                     qBound(0.0, center.y() - delta.y(), qreal(tileSource.imageSize.height())));
+    update();
+}
+
+void RasterViewer::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) return;
+    painting = false;
+    if (dragging) {
+        dragging = false;
+        unsetCursor();
+    }
+}
+
+// 双击恢复适应窗口
+void RasterViewer::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton || mosaicMode || !isZoomed()) return;
+    resetView();
+}
+
+void RasterViewer::createMosaicControls()
+{
+    mosaicControls = new QFrame(this);
+    mosaicControls->setObjectName("mosaicControls");
+    mosaicControls->setStyleSheet(
+        "#mosaicControls { background: rgba(255, 255, 255, 230); border-radius: 8px; }"
+        "QPushButton { padding: 5px 10px; border: none; border-radius: 4px; background: #2196F3; color: white; }"
+        "QPushButton:hover { background: #0b7dda; }");
+
+    QHBoxLayout *layout = new QHBoxLayout(mosaicControls);
+    layout->setContentsMargins(10, 10, 10, 10);
+
+    auto addSlider = [&](const QString &title, int minimum, int maximum, int value) {
+        QSlider *slider = new QSlider(Qt::Horizontal, mosaicControls);
+        slider->setRange(minimum, maximum);
+        slider->setValue(value);
+        slider->setFixedWidth(120);
+        QLabel *valueLabel = new QLabel(QString::number(value), mosaicControls);
+        connect(slider, &QSlider::valueChanged, valueLabel, [valueLabel](int size) {
+            valueLabel->setText(QString::number(size));
+        });
+        layout->addWidget(new QLabel(title, mosaicControls));
+        layout->addWidget(slider);
+        layout->addWidget(valueLabel);
+        return slider;
+    };
+    brushSizeSlider = addSlider(tr("画笔大小: "), 5, 50, 20);
+    pixelSizeSlider = addSlider(tr("马赛克像素: "), 1, 20, 5);
+
+    QPushButton *clearButton = new QPushButton(tr("清除马赛克"), mosaicControls);
+    QPushButton *applyButton = new QPushButton(tr("应用"), mosaicControls);
+    QPushButton *exitButton = new QPushButton(tr("退出"), mosaicControls);
+    layout->addWidget(clearButton);
+    layout->addWidget(applyButton);
+    layout->addWidget(exitButton);
+    connect(clearButton, &QPushButton::clicked, this, [this]() {
+        clearMosaic();
+        update();
+    });
+    connect(applyButton, &QPushButton::clicked, this, &RasterViewer::applyMosaic);
+    connect(exitButton, &QPushButton::clicked, this, [this]() { setMosaicMode(false); });
+
+    mosaicControls->setVisible(false);
+}
+
+// 落笔以显示图像的宽度为单位, 画笔与马赛克块的大小为屏幕像素
+void RasterViewer::addDab(const QPointF &position)
+{
+    const QRectF target = imageRect();
+    if (target.isEmpty()) return;
+
+    MosaicDab dab;
+    dab.center = (position - target.topLeft()) / target.width();
+    dab.radius = brushSizeSlider->value() / target.width();
+    dab.blockSize = pixelSizeSlider->value() / target.width();
+    dabs.append(dab);
+
+    // 只有新覆盖的块需要计算, 预览与重绘也只涉及这些块
+    const QRect changed = mosaicEngine.paint(dab);
+    if (changed.isEmpty()) return;
+    if (mosaicPreview.isNull()) {
+        mosaicPreview = frame.copy();
+    }
+    QPainter painter(&mosaicPreview);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(changed.topLeft(), mosaicEngine.result(), changed);
+    painter.end();
+
+    update(widgetRect(changed));
+}
+
+void RasterViewer::restartMosaic()
+{
+    mosaicPreview = QImage();
+    if (!mosaicMode) return;
+    mosaicEngine.setSource(frame);
+    for (const MosaicDab &dab : dabs) {
+        mosaicEngine.paint(dab);
+    }
+    if (!dabs.isEmpty()) {
+        mosaicPreview = toDisplayFormat(mosaicEngine.result());
+    }
+}
+
+void RasterViewer::clearMosaic()
+{
+    dabs.clear();
+    mosaicPreview = QImage();
+    mosaicEngine.clear();
+}
+
+// 预览结果留在画面上, 落笔交给主窗口在全分辨率原图上重放
+void RasterViewer::applyMosaic()
+{
+    if (dabs.isEmpty()) return;
+    const QVector<MosaicDab> applied = dabs;
+    frame = mosaicPreview;
+    mosaicEngine.setSource(frame);
+    clearMosaic();
+    update();
+    emit mosaicApplied(applied);
+}
@@ -0,0 +1,97 @@
+﻿#ifndef RASTERVIEWER_H
+#define RASTERVIEWER_H
+
+#include <QCache>
+#include <QList>
+#include <QSet>
+#include "imageviewer.h"
+#include "mosaicengine.h"
+
+class QFrame;
+class QLabel;
+class QSlider;
+class QTimer;
+
+// 原生画布: 用 QPainter 直接绘制 QImage, 不经过 Chromium 和 runJavaScript
+// 适应窗口、滚轮缩放、拖动平移、双击复位与马赛克画笔的行为与 canvas 页面一致
+// 放大后的分块在界面线程空闲时逐个向提供者请求, 每次只生成一个, 不阻塞绘制
+class RasterViewer : public ImageViewer
+{
+    Q_OBJECT
+
+public:
+    explicit RasterViewer(QWidget *parent = nullptr);
+
+    void showImage(const QImage &image) override;
+    void showPatches(const QVector<ImagePatch> &patches) override;
+    void showWelcome() override;
+    void reset() override;
+    void setTileSource(const TileSource &source) override;
+    void setTileProvider(const TileProvider &provider) override;
+    void setMosaicMode(bool enabled) override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    static constexpr qreal MaxScale = 8;        // 放大上限: 每个原图像素对应的屏幕像素
+    static constexpr int MaxCachedTiles = 512;
+
+    // 画布区域, 与页面一样占控件的95%并居中
+    QRectF canvasRect() const;
+    // 当前帧在控件中的绘制区域: 适应窗口, 或放大后整幅原图对应的区域
+    QRectF imageRect() const;
+    qreal fitScale() const;
+    bool isZoomed() const;
+    void resetView();
+
+    // 绘制可见分块, 缺少的分块记入待请求列表
+    void drawTiles(QPainter &painter, const QRectF &target);
+    void loadNextTile();
+
+    // 帧上的像素区域在控件中的位置, 包含平滑缩放影响的相邻像素
+    QRect widgetRect(const QRect &frameRect) const;
+
+    void createMosaicControls();
+    // 在当前帧上重新开始马赛克预览并重放已有的落笔
+    void restartMosaic();
+    void addDab(const QPointF &position);
+    void clearMosaic();
+    void applyMosaic();
+
+    QImage frame;
+    bool firstFrameReported = false;
+    TileSource tileSource;
+    TileProvider tileProvider;
+
+    // 缩放与平移: zoom 为相对适应窗口的倍数, center 为视图中心在原图上的坐标
+    qreal zoom = 1;
+    QPointF center;
+    bool dragging = false;
+    QPointF lastMousePosition;
+
+    // 当前版本的分块, 键为 (层, 列, 行)
+    QCache<quint64, QImage> tiles;
+    QList<quint64> pendingTiles;
+    QSet<quint64> failedTiles;
+    QTimer *tileTimer;
+
+    // 马赛克: 落笔以显示图像的宽度为单位, 预览为当前帧上重放全部落笔的结果
+    // 引擎只在马赛克模式下持有当前帧, 每次落笔只把改写的区域复制到预览并重绘
+    bool mosaicMode = false;
+    bool painting = false;
+    QVector<MosaicDab> dabs;
+    MosaicEngine mosaicEngine;
+    QImage mosaicPreview;
+    QFrame *mosaicControls = nullptr;
+    QSlider *brushSizeSlider = nullptr;
+    QSlider *pixelSizeSlider = nullptr;
+};
+
+#endif // RASTERVIEWER_H
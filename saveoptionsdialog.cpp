@@ -0,0 +1,90 @@
+﻿#include "saveoptionsdialog.h"
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QSlider>
+#include <QSpinBox>
+#include <QVBoxLayout>
+
+namespace {
+
+constexpr int DefaultQuality = 90;
+constexpr int DefaultPngCompression = 6;     // zlib 默认级别
+
+} // namespace
+
+SaveOptionsDialog::SaveOptionsDialog(const QByteArray &format, const ImageSaver::Options &initial, QWidget *parent)
+    : QDialog(parent)
+    , result(initial)
+{
+    setWindowTitle(tr("保存选项 - %1").arg(QString::fromLatin1(format.toUpper())));
+    // PNG 与 TIFF 的压缩级别含义不同, 换了格式时不沿用上一次的压缩级别
+    const int initialCompression = initial.format == format ? initial.compression : -1;
+    result.format = format;
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QFormLayout *form = new QFormLayout;
+    layout->addLayout(form);
+
+    if (ImageSaver::supportsQuality(format)) {
+        QWidget *qualityRow = new QWidget(this);
+        QHBoxLayout *qualityLayout = new QHBoxLayout(qualityRow);
+        qualityLayout->setContentsMargins(0, 0, 0, 0);
+        qualitySlider = new QSlider(Qt::Horizontal, qualityRow);
+        qualitySlider->setRange(0, 100);
+        qualitySlider->setValue(initial.quality >= 0 ? initial.quality : DefaultQuality);
+        QLabel *qualityLabel = new QLabel(QString::number(qualitySlider->value()), qualityRow);
+        qualityLabel->setMinimumWidth(30);
+        connect(qualitySlider, &QSlider::valueChanged, qualityLabel,
+                [qualityLabel](int value) { qualityLabel->setText(QString::number(value)); });
+        qualityLayout->addWidget(qualitySlider);
+        qualityLayout->addWidget(qualityLabel);
+        form->addRow(tr("质量:"), qualityRow);
+    }
+
+    if (ImageSaver::supportsCompression(format)) {
+        compressionSpin = new QSpinBox(this);
+        if (format == "png") {
+            compressionSpin->setRange(0, 9);
+            compressionSpin->setValue(initialCompression >= 0 ? qMin(initialCompression, 9) : DefaultPngCompression);
+            compressionSpin->setToolTip(tr("0 不压缩, 9 文件最小但最慢"));
+        } else {
+            compressionSpin->setRange(0, 1);
+            compressionSpin->setValue(initialCompression != 0 ? 1 : 0);
+            compressionSpin->setToolTip(tr("0 不压缩, 1 LZW"));
+        }
+        form->addRow(tr("压缩级别:"), compressionSpin);
+
+        // 快速草稿使用最低压缩级别, 此时压缩级别不起作用
+        fastCheck = new QCheckBox(tr("快速草稿(文件较大)"), this);
+        fastCheck->setChecked(initial.fast);
+        compressionSpin->setEnabled(!initial.fast);
+        connect(fastCheck, &QCheckBox::toggled, compressionSpin, &QSpinBox::setDisabled);
+        form->addRow(QString(), fastCheck);
+    }
+
+    stripMetadataCheck = new QCheckBox(tr("去除元数据(文字信息、色彩空间、分辨率)"), this);
+    stripMetadataCheck->setChecked(initial.stripMetadata);
+    form->addRow(QString(), stripMetadataCheck);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    layout->addWidget(buttons);
+}
+
+ImageSaver::Options SaveOptionsDialog::options() const
+{
+    ImageSaver::Options options = result;
+    if (qualitySlider) {
+        options.quality = qualitySlider->value();
+    }
+    if (compressionSpin) {
+        options.compression = compressionSpin->value();
+    }
+    options.fast = fastCheck && fastCheck->isChecked();
+    options.stripMetadata = stripMetadataCheck->isChecked();
+    return options;
+}
@@ -0,0 +1,32 @@
+﻿#ifndef SAVEOPTIONSDIALOG_H
+#define SAVEOPTIONSDIALOG_H
+
+#include <QDialog>
+#include "imagesaver.h"
+
+class QCheckBox;
+class QLabel;
+class QSlider;
+class QSpinBox;
+
+// 保存选项: 只显示所选格式支持的设置(JPEG/WebP 质量, PNG/TIFF 压缩), 以及去除元数据和快速草稿
+class SaveOptionsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    // initial 中的设置作为初始值, 通常为上一次保存的选项
+    SaveOptionsDialog(const QByteArray &format, const ImageSaver::Options &initial, QWidget *parent = nullptr);
+
+    // 对话框中的设置, 文件名与格式不变
+    ImageSaver::Options options() const;
+
+private:
+    ImageSaver::Options result;
+    QSlider *qualitySlider = nullptr;
+    QSpinBox *compressionSpin = nullptr;
+    QCheckBox *stripMetadataCheck = nullptr;
+    QCheckBox *fastCheck = nullptr;
+};
+
+#endif // SAVEOPTIONSDIALOG_H
@@ -0,0 +1,70 @@
+﻿#include "startupprofiler.h"
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <algorithm>
+
+namespace {
+
+qint64 startNs = -1;
+qint64 stageNs[StartupProfiler::StageCount] = { -1, -1, -1, -1 };
+
+const char *const StageNames[StartupProfiler::StageCount] = {
+    "startup.application",
+    "startup.window",
+    "startup.interactive",
+    "startup.firstFrame"
+};
+
+} // namespace
+
+void StartupProfiler::start()
+{
+    startNs = Tracer::now();
+    std::fill(std::begin(stageNs), std::end(stageNs), -1);
+}
+
+void StartupProfiler::mark(Stage stage)
+{
+    if (startNs < 0 || stageNs[stage] >= 0) return;
+    const qint64 now = Tracer::now();
+    stageNs[stage] = now;
+
+    // 阶段从上一个已记录的阶段结束时开始
+    if (Tracer::isEnabled()) {
+        qint64 begin = startNs;
+        for (int i = 0; i < stage; ++i) {
+            begin = qMax(begin, stageNs[i]);
+        }
+        Tracer::addComplete("startup", QByteArray(StageNames[stage]), begin, now - begin,
+                            Tracer::virtualTrack(QCoreApplication::translate("StartupProfiler", "启动")));
+    }
+}
+
+bool StartupProfiler::isMarked(Stage stage)
+{
+    return stageNs[stage] >= 0;
+}
+
+qint64 StartupProfiler::elapsedMs(Stage stage)
+{
+    if (startNs < 0 || stageNs[stage] < 0) return -1;
+    return (stageNs[stage] - startNs) / 1000000;
+}
+
+QString StartupProfiler::summary()
+{
+    static const char *const labels[StageCount] = {
+        QT_TRANSLATE_NOOP("StartupProfiler", "QApplication"),
+        QT_TRANSLATE_NOOP("StartupProfiler", "主窗口"),
+        QT_TRANSLATE_NOOP("StartupProfiler", "可交互"),
+        QT_TRANSLATE_NOOP("StartupProfiler", "首帧")
+    };
+    QStringList parts;
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const qint64 ms = elapsedMs(Stage(stage));
+        if (ms < 0) continue;
+        parts.append(QString("%1 %2 ms").arg(QCoreApplication::translate("StartupProfiler", labels[stage])).arg(ms));
+    }
+    return QCoreApplication::translate("StartupProfiler", "启动耗时: %1").arg(parts.join(", "));
+}
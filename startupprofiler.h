@@ -0,0 +1,31 @@
+﻿#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QString>
+#include <QtGlobal>
+
+// 冷启动耗时: 从进入 main 开始计时, 依次记下各阶段完成的时刻, 直到第一帧图像显示在画布上
+// 时间使用跟踪时钟; 跟踪开启时各阶段同时记录为 "启动" 轨道上的事件
+class StartupProfiler
+{
+public:
+    enum Stage {
+        Application,        // QApplication 创建完成
+        WindowCreated,      // 主窗口构造完成
+        Interactive,        // 主窗口第一次显示后事件循环开始响应
+        FirstFrame,         // 第一帧图像显示在画布上
+        StageCount
+    };
+
+    // 在 main 开头调用
+    static void start();
+    // 每个阶段只记录第一次
+    static void mark(Stage stage);
+    static bool isMarked(Stage stage);
+    // 从启动到该阶段的毫秒数, 未记录时为 -1
+    static qint64 elapsedMs(Stage stage);
+    // 已记录阶段的摘要, 用于状态栏和日志
+    static QString summary();
+};
+
+#endif // STARTUPPROFILER_H
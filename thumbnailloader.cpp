@@ -0,0 +1,195 @@
+﻿#include "thumbnailloader.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTransform>
+
+namespace {
+
+// 读取 JPEG 的 APP1 段时最多读取的文件头长度
+const qint64 MaxExifHeaderBytes = 128 * 1024;
+
+class ExifReader
+{
+public:
+    ExifReader(const QByteArray &tiff)
+        : data(tiff)
+    {
+        littleEndian = data.startsWith("II");
+    }
+
+    bool isValid() const
+    {
+        return data.size() >= 8 && (data.startsWith("II") || data.startsWith("MM")) && u16(2) == 42;
+    }
+
+    quint16 u16(qint64 offset) const
+    {
+        if (offset < 0 || offset + 2 > data.size()) return 0;
+        const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + offset;
+        return littleEndian ? quint16(p[0] | p[1] << 8) : quint16(p[0] << 8 | p[1]);
+    }
+
+    quint32 u32(qint64 offset) const
+    {
+        if (offset < 0 || offset + 4 > data.size()) return 0;
+        const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + offset;
+        return littleEndian ? quint32(p[0] | p[1] << 8 | p[2] << 16 | quint32(p[3]) << 24)
+                            : quint32(quint32(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+    }
+
+    // 在 IFD 中查找标签的值(SHORT 或 LONG), 找不到返回 0
+    quint32 tagValue(quint32 ifd, quint16 tag) const
+    {
+        const int entries = u16(ifd);
+        for (int i = 0; i < entries; ++i) {
+            const qint64 entry = qint64(ifd) + 2 + i * 12;
+            if (u16(entry) != tag) continue;
+            return u16(entry + 2) == 3 ? u16(entry + 8) : u32(entry + 8);
+        }
+        return 0;
+    }
+
+    // 下一个 IFD 的偏移
+    quint32 nextIfd(quint32 ifd) const
+    {
+        return u32(qint64(ifd) + 2 + qint64(u16(ifd)) * 12);
+    }
+
+    QByteArray data;
+    bool littleEndian = true;
+};
+
+// 按 EXIF 方向标签旋转/镜像
+QImage applyOrientation(const QImage &image, quint32 orientation)
+{
+    switch (orientation) {
+    case 2: return image.mirrored(true, false);
+    case 3: return image.transformed(QTransform().rotate(180));
+    case 4: return image.mirrored(false, true);
+    case 5: return image.transformed(QTransform().rotate(90)).mirrored(true, false);
+    case 6: return image.transformed(QTransform().rotate(90));
+    case 7: return image.transformed(QTransform().rotate(270)).mirrored(true, false);
+    case 8: return image.transformed(QTransform().rotate(270));
+    default: return image;
+    }
+}
+
+// 读取 JPEG 中 EXIF IFD1 内嵌的缩略图
+QImage readExifThumbnail(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QImage();
+    const QByteArray head = file.read(MaxExifHeaderBytes);
+    const uchar *p = reinterpret_cast<const uchar *>(head.constData());
+    if (head.size() < 4 || p[0] != 0xFF || p[1] != 0xD8) return QImage();
+
+    qint64 pos = 2;
+    while (pos + 4 <= head.size() && p[pos] == 0xFF) {
+        const uchar marker = p[pos + 1];
+        const int length = p[pos + 2] << 8 | p[pos + 3];
+        // 到达图像数据, 不再有 APP 段
+        if (marker == 0xDA || marker == 0xD9) break;
+
+        if (marker == 0xE1 && length > 8 && head.mid(pos + 4, 6) == QByteArray("Exif\0\0", 6)) {
+            const ExifReader exif(head.mid(pos + 10, length - 8));
+            if (!exif.isValid()) return QImage();
+
+            const quint32 ifd0 = exif.u32(4);
+            const quint32 orientation = exif.tagValue(ifd0, 0x0112);
+            const quint32 ifd1 = exif.nextIfd(ifd0);
+            if (ifd1 == 0) return QImage();
+
+            const quint32 offset = exif.tagValue(ifd1, 0x0201);
+            const quint32 size = exif.tagValue(ifd1, 0x0202);
+            if (offset == 0 || size == 0 || qint64(offset) + size > exif.data.size()) return QImage();
+
+            const QImage thumbnail = QImage::fromData(exif.data.mid(offset, size), "JPEG");
+            return applyOrientation(thumbnail, orientation);
+        }
+        pos += 2 + length;
+    }
+    return QImage();
+}
+
+} // namespace
+
+ThumbnailLoader::ThumbnailLoader(const QSize &thumbnailSize, QObject *parent)
+    : QObject(parent)
+    , size(thumbnailSize)
+{
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+    QDir().mkpath(cacheDir);
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+void ThumbnailLoader::request(const QString &path)
+{
+    pool.start([this, path]() {
+        const QImage image = load(path);
+        QMetaObject::invokeMethod(this, [this, path, image]() {
+            emit thumbnailReady(path, image);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ThumbnailLoader::cancelPending()
+{
+    pool.clear();
+}
+
+QString ThumbnailLoader::cacheFilePath(const QString &path) const
+{
+    const QFileInfo info(path);
+    const QByteArray key = info.absoluteFilePath().toUtf8() + '|' +
+                           QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + '|' +
+                           QByteArray::number(info.size()) + '|' +
+                           QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+    const QByteArray hash = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+    return cacheDir + '/' + QString::fromLatin1(hash) + ".png";
+}
+
+QImage ThumbnailLoader::load(const QString &path) const
+{
+    const QString cachePath = cacheFilePath(path);
+    QImage thumbnail(cachePath);
+    if (!thumbnail.isNull()) {
+        return thumbnail;
+    }
+
+    // 内嵌缩略图足够大时直接使用, 不必解码原图
+    const QImage exifThumbnail = readExifThumbnail(path);
+    if (!exifThumbnail.isNull() &&
+        (exifThumbnail.width() >= size.width() || exifThumbnail.height() >= size.height())) {
+        thumbnail = exifThumbnail.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    } else {
+        QImageReader reader(path);
+        reader.setAutoTransform(true);
+        const QSize imageSize = reader.size();
+        if (imageSize.isValid() &&
+            (imageSize.width() > size.width() || imageSize.height() > size.height())) {
+            reader.setScaledSize(imageSize.scaled(size, Qt::KeepAspectRatio));
+        }
+        thumbnail = reader.read();
+    }
+    if (thumbnail.isNull()) {
+        return QImage();
+    }
+
+    // 写入磁盘缓存, 失败不影响显示
+    QSaveFile cacheFile(cachePath);
+    if (cacheFile.open(QIODevice::WriteOnly) && thumbnail.save(&cacheFile, "PNG")) {
+        cacheFile.commit();
+    }
+    return thumbnail;
+}
@@ -0,0 +1,41 @@
+﻿#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+
+// 缩略图加载器: 在线程池中解码缩略图, 完成后通过 thumbnailReady 通知
+// 依次尝试磁盘缓存、JPEG 内嵌的 EXIF 缩略图、按目标尺寸缩放解码(JPEG 可在 DCT 阶段缩小)
+// 磁盘缓存以 路径 + 修改时间 + 文件大小 为键, 再次打开同一文件夹时无需解码
+class ThumbnailLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ThumbnailLoader(const QSize &thumbnailSize, QObject *parent = nullptr);
+    ~ThumbnailLoader();
+
+    // 请求一张缩略图, 结果在 GUI 线程通过信号返回
+    void request(const QString &path);
+    // 丢弃尚未开始的请求
+    void cancelPending();
+
+    QSize thumbnailSize() const { return size; }
+
+signals:
+    // image 为空表示无法解码
+    void thumbnailReady(const QString &path, const QImage &image);
+
+private:
+    QImage load(const QString &path) const;
+    QString cacheFilePath(const QString &path) const;
+
+    QSize size;
+    QString cacheDir;
+    QThreadPool pool;
+};
+
+#endif // THUMBNAILLOADER_H
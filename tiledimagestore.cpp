@@ -0,0 +1,378 @@
+﻿#include "tiledimagestore.h"
+#include "tilescheduler.h"
+#include "tracer.h"
+#include <QDebug>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// 一次解码或流式处理读取的最大字节数, 与按分块方式打开的阈值相同
+constexpr qint64 ChunkBudget = TiledImageStore::LargeImagePixels * 4;
+
+// 临时放宽 QImageReader 的分配上限(全局设置), 离开作用域时恢复
+class AllocationLimitGuard
+{
+public:
+    explicit AllocationLimitGuard(int megabytes)
+        : previous(QImageReader::allocationLimit())
+    {
+        if (previous != 0 && previous < megabytes) {
+            QImageReader::setAllocationLimit(megabytes);
+        }
+    }
+    ~AllocationLimitGuard() { QImageReader::setAllocationLimit(previous); }
+
+    AllocationLimitGuard(const AllocationLimitGuard &) = delete;
+    AllocationLimitGuard &operator=(const AllocationLimitGuard &) = delete;
+
+private:
+    const int previous;
+};
+
+} // namespace
+
+QImage TiledImageStore::createMappedImage(const QSize &size, QImage::Format format)
+{
+    const int depth = QImage::toPixelFormat(format).bitsPerPixel();
+    const qsizetype stride = (qsizetype(size.width()) * depth + 31) / 32 * 4;
+    const qint64 bytes = qint64(stride) * size.height();
+    auto *file = new QTemporaryFile;
+    uchar *bits = nullptr;
+    if (bytes > 0 && file->open() && file->resize(bytes)) {
+        bits = file->map(0, bytes);
+    }
+    if (!bits) {
+        delete file;
+        return QImage();
+    }
+    return QImage(bits, size.width(), size.height(), stride, format,
+                  [](void *info) { delete static_cast<QTemporaryFile *>(info); }, file);
+}
+
+TiledImageStore::~TiledImageStore()
+{
+    if (mapped) {
+        backing.unmap(mapped);
+    }
+}
+
+bool TiledImageStore::isLargeImage(const QString &path)
+{
+    const QSize size = QImageReader(path).size();
+    return size.isValid() && qint64(size.width()) * size.height() > LargeImagePixels;
+}
+
+std::shared_ptr<TiledImageStore> TiledImageStore::open(const QString &path, QString *error)
+{
+    TRACE_SCOPE("tiles", "open");
+    QImageReader reader(path);
+    QSize size = reader.size();
+    if (!size.isValid()) {
+        if (error) *error = reader.errorString();
+        return nullptr;
+    }
+
+    // 需要旋转的图片裁剪区域与方向不对应, 改为整图解码
+    const QImageIOHandler::Transformations transformation = reader.transformation();
+    if (transformation & QImageIOHandler::TransformationRotate90) {
+        size.transpose();
+    }
+
+    std::shared_ptr<TiledImageStore> store(new TiledImageStore);
+    store->filePath = path;
+    store->imageSize = size;
+    store->columns = (size.width() + TileSize - 1) / TileSize;
+    store->rows = (size.height() + TileSize - 1) / TileSize;
+    store->clipDecoding = reader.supportsOption(QImageIOHandler::ClipRect)
+        && transformation == QImageIOHandler::TransformationNone;
+    store->decoded = std::make_unique<std::atomic<bool>[]>(store->rows);
+    store->metadata = QImage(1, 1, ImageProcessor::WorkingFormat);
+    const QStringList keys = reader.textKeys();
+    for (const QString &key : keys) {
+        store->metadata.setText(key, reader.text(key));
+    }
+
+    // 分块文件只预留空间, 实际写入的页才占用磁盘
+    const qint64 bytes = qint64(store->columns) * store->rows * TileSize * TileSize * 4;
+    if (!store->backing.open() || !store->backing.resize(bytes)
+        || !(store->mapped = store->backing.map(0, bytes))) {
+        if (error) *error = QString("无法创建分块文件: %1").arg(store->backing.errorString());
+        return nullptr;
+    }
+    return store;
+}
+
+int TiledImageStore::decodedBandCount() const
+{
+    int count = 0;
+    for (int band = 0; band < rows; ++band) {
+        count += decoded[band].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+QImage TiledImageStore::region(const QRect &rect, const std::atomic<bool> *cancel)
+{
+    const QRect area = rect & QRect(QPoint(0, 0), imageSize);
+    if (area.isEmpty()) return QImage();
+    if (!ensureBands(area.top() / TileSize, area.bottom() / TileSize)) return QImage();
+
+    QImage output(area.size(), ImageProcessor::WorkingFormat);
+    if (output.isNull()) return QImage();
+    uchar *dstBits = output.bits();
+    const qsizetype dstStride = output.bytesPerLine();
+    const bool finished = TileScheduler::run(output.rect(), 4, [&](const QRect &tile) {
+        for (int y = tile.top(); y <= tile.bottom(); ++y) {
+            const int sy = area.top() + y;
+            uchar *dst = dstBits + y * dstStride;
+            // 按分块边界切成若干段复制
+            for (int x = tile.left(); x <= tile.right();) {
+                const int sx = area.left() + x;
+                const int count = qMin(TileSize - sx % TileSize, tile.right() + 1 - x);
+                const uchar *src = tileBits(sx / TileSize, sy / TileSize)
+                    + (qsizetype(sy % TileSize) * TileSize + sx % TileSize) * 4;
+                std::memcpy(dst + x * 4, src, size_t(count) * 4);
+                x += count;
+            }
+        }
+    }, cancel);
+    return finished ? output : QImage();
+}
+
+QImage TiledImageStore::overview(const QSize &maxSize, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("tiles", "overview");
+    if (maxSize.isEmpty()) return QImage();
+    QSize target = imageSize;
+    if (target.width() > maxSize.width() || target.height() > maxSize.height()) {
+        target = target.scaled(maxSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    }
+
+    // JPEG 解码器可在 DCT 域直接缩小, 不需要解码全分辨率像素
+    if (clipDecoding) {
+        QImageReader reader(filePath);
+        if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+            reader.setScaledSize(target);
+            const QImage image = reader.read();
+            if (!image.isNull()) return ImageProcessor::toWorkingFormat(image);
+        }
+    }
+
+    // 逐带按整数倍做盒式缩小, 最后再平滑缩放到目标尺寸
+    if (!decodeAll()) return QImage();
+    const int factor = qMax(1, qMin(width() / target.width(), height() / target.height()));
+    const QSize reduced(width() / factor, height() / factor);
+    QImage small(reduced, ImageProcessor::WorkingFormat);
+    if (small.isNull()) return QImage();
+    uchar *smallBits = small.bits();
+    const qsizetype smallStride = small.bytesPerLine();
+    const int rowsPerRead = qMax(1, int(ChunkBudget / (qint64(width()) * 4 * factor)));
+
+    for (int top = 0; top < reduced.height(); top += rowsPerRead) {
+        const int count = qMin(rowsPerRead, reduced.height() - top);
+        const QImage source = region(QRect(0, top * factor, reduced.width() * factor, count * factor), cancel);
+        if (source.isNull()) return QImage();
+
+        const uchar *srcBits = source.constBits();
+        const qsizetype srcStride = source.bytesPerLine();
+        const quint32 area = quint32(factor) * factor;
+        const bool finished = TileScheduler::run(QRect(0, 0, reduced.width(), count), 4, [&](const QRect &tile) {
+            std::vector<quint32> sums(size_t(tile.width()) * 4);
+            for (int y = tile.top(); y <= tile.bottom(); ++y) {
+                std::fill(sums.begin(), sums.end(), 0u);
+                for (int sy = y * factor; sy < (y + 1) * factor; ++sy) {
+                    const uchar *src = srcBits + sy * srcStride + qsizetype(tile.left()) * factor * 4;
+                    for (int x = 0; x < tile.width(); ++x) {
+                        quint32 *sum = sums.data() + x * 4;
+                        for (int sx = 0; sx < factor; ++sx, src += 4) {
+                            sum[0] += src[0];
+                            sum[1] += src[1];
+                            sum[2] += src[2];
+                            sum[3] += src[3];
+                        }
+                    }
+                }
+                uchar *dst = smallBits + (top + y) * smallStride + tile.left() * 4;
+                for (int i = 0; i < tile.width() * 4; ++i) {
+                    dst[i] = uchar((sums[i] + area / 2) / area);
+                }
+            }
+        }, cancel);
+        if (!finished) return QImage();
+    }
+
+    if (small.size() == target) return small;
+    return ImageProcessor::toWorkingFormat(small.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+}
+
+void TiledImageStore::copyMetadata(QImage &target)
+{
+    QMutexLocker locker(&decodeMutex);
+    ImageProcessor::copyMetadata(metadata, target);
+}
+
+QImage TiledImageStore::mappedImage(const std::atomic<bool> *cancel)
+{
+    return applyChain(QVector<ImageOperation>(), cancel);
+}
+
+bool TiledImageStore::canStream(const QVector<ImageOperation> &operations)
+{
+    for (const ImageOperation &operation : operations) {
+        if (ImageProcessor::neighbourhoodRadius(operation) < 0) return false;
+    }
+    return true;
+}
+
+QImage TiledImageStore::applyChain(const QVector<ImageOperation> &operations, const std::atomic<bool> *cancel)
+{
+    TRACE_SCOPE("tiles", "applyChain");
+    if (!canStream(operations)) return QImage();
+
+    // 每个邻域操作都会让有效区域再缩小一个半径, 操作链的邻域为各半径之和
+    int halo = 0;
+    for (const ImageOperation &operation : operations) {
+        halo += ImageProcessor::neighbourhoodRadius(operation);
+    }
+
+    if (!decodeAll()) return QImage();
+    QImage output = createMappedImage(imageSize);
+    if (output.isNull()) return QImage();
+    uchar *outBits = output.bits();
+    const qsizetype outStride = output.bytesPerLine();
+    const qsizetype rowBytes = qsizetype(width()) * 4;
+    const int chunkRows = qMax(1, int(ChunkBudget / (qint64(width()) * 4 * TileSize))) * TileSize;
+
+    for (int top = 0; top < height(); top += chunkRows) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return QImage();
+        const int bottom = qMin(height(), top + chunkRows);
+        const int readTop = qMax(0, top - halo);
+        const int readBottom = qMin(height(), bottom + halo);
+
+        const QImage input = region(QRect(0, readTop, width(), readBottom - readTop), cancel);
+        if (input.isNull()) return QImage();
+        const QImage result = operations.isEmpty() ? input : ImageProcessor::applyChain(input, operations, cancel);
+        if (result.isNull()) return QImage();
+
+        for (int y = top; y < bottom; ++y) {
+            std::memcpy(outBits + y * outStride, result.constScanLine(y - readTop), size_t(rowBytes));
+        }
+    }
+    return output;
+}
+
+bool TiledImageStore::decodeAll()
+{
+    if (decodedBandCount() == rows) return true;
+    QMutexLocker locker(&decodeMutex);
+    return decodeWhole();
+}
+
+bool TiledImageStore::ensureBands(int firstBand, int lastBand)
+{
+    bool ready = true;
+    for (int band = firstBand; band <= lastBand && ready; ++band) {
+        ready = decoded[band].load(std::memory_order_acquire);
+    }
+    if (ready) return true;
+
+    QMutexLocker locker(&decodeMutex);
+    if (!clipDecoding) return decodeWhole();
+
+    // 连续的未解码带合并为一次读取, 每次读取不超过预算
+    const int bandsPerRead = qMax(1, int(ChunkBudget / (qint64(width()) * 4 * TileSize)));
+    for (int band = firstBand; band <= lastBand;) {
+        if (decoded[band].load(std::memory_order_relaxed)) {
+            ++band;
+            continue;
+        }
+        int last = band;
+        while (last < lastBand && last - band + 1 < bandsPerRead
+               && !decoded[last + 1].load(std::memory_order_relaxed)) {
+            ++last;
+        }
+        if (!decodeClipped(band, last)) return false;
+        band = last + 1;
+    }
+    return true;
+}
+
+bool TiledImageStore::decodeClipped(int firstBand, int lastBand)
+{
+    TRACE_SCOPE("tiles", "decodeClipped");
+    const int top = firstBand * TileSize;
+    const int bottom = qMin(height(), (lastBand + 1) * TileSize);
+
+    QImageReader reader(filePath);
+    reader.setClipRect(QRect(0, top, width(), bottom - top));
+    const QImage pixels = reader.read();
+    if (pixels.isNull() || pixels.width() != width() || pixels.height() != bottom - top) {
+        qWarning() << "分块解码失败:" << filePath << reader.errorString();
+        return false;
+    }
+
+    storeRows(top, pixels);
+    for (int band = firstBand; band <= lastBand; ++band) {
+        decoded[band].store(true, std::memory_order_release);
+    }
+    return true;
+}
+
+bool TiledImageStore::decodeWhole()
+{
+    if (decodedBandCount() == rows) return true;
+    TRACE_SCOPE("tiles", "decodeWhole");
+
+    // 整图解码一次; 按解码器可能的最大格式(每像素 8 字节)临时放宽分配上限
+    const int neededMegabytes = int(qint64(width()) * height() * 8 / (1024 * 1024)) + 1;
+    const AllocationLimitGuard limit(neededMegabytes);
+
+    // 尺寸与格式相符时解码器直接写入传入的图像, 解码结果因此也在内存映射文件中而不占用堆内存
+    QImageReader reader(filePath);
+    reader.setAutoTransform(true);
+    QImage pixels = createMappedImage(reader.size(), reader.imageFormat());
+    if (!reader.read(&pixels) || pixels.size() != imageSize) {
+        qWarning() << "分块解码失败:" << filePath << reader.errorString();
+        return false;
+    }
+
+    storeRows(0, pixels);
+    for (int band = 0; band < rows; ++band) {
+        decoded[band].store(true, std::memory_order_release);
+    }
+    return true;
+}
+
+void TiledImageStore::storeRows(int top, const QImage &pixels)
+{
+    ImageProcessor::copyMetadata(pixels, metadata);
+    const qsizetype tileStride = qsizetype(TileSize) * 4;
+    for (int first = 0; first < pixels.height(); first += TileSize) {
+        // 其他线程可能正在读取已解码的带, 不再覆盖
+        const int row = (top + first) / TileSize;
+        if (decoded[row].load(std::memory_order_relaxed)) continue;
+
+        // 每次只把一带转换为工作格式, 已是工作格式时直接引用原数据
+        const int count = qMin(TileSize, pixels.height() - first);
+        QImage band(pixels.constScanLine(first), pixels.width(), count, pixels.bytesPerLine(), pixels.format());
+        band.setColorTable(pixels.colorTable());
+        band = ImageProcessor::toWorkingFormat(band);
+
+        for (int y = 0; y < count; ++y) {
+            const uchar *src = band.constScanLine(y);
+            for (int column = 0; column < columns; ++column) {
+                const int x = column * TileSize;
+                std::memcpy(tileBits(column, row) + y * tileStride, src + qsizetype(x) * 4,
+                            size_t(qMin(TileSize, width() - x)) * 4);
+            }
+        }
+    }
+}
+
+uchar *TiledImageStore::tileBits(int column, int row) const
+{
+    return mapped + (qsizetype(row) * columns + column) * TileSize * TileSize * 4;
+}
@@ -0,0 +1,87 @@
+﻿#ifndef TILEDIMAGESTORE_H
+#define TILEDIMAGESTORE_H
+
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QString>
+#include <QTemporaryFile>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "imageprocessor.h"
+
+// 超大图像的分块存储: 全分辨率像素按 TileSize x TileSize 分块保存在内存映射的临时文件中,
+// 常驻内存的只是最近访问的分块, 由操作系统按需换入换出
+// 像素在第一次被访问时按带(一行分块)解码: 解码器支持裁剪区域(JPEG)时只解码用到的带,
+// 否则第一次访问时整图解码一次, 写入分块文件后立即释放
+// 每次裁剪读取都要从文件头重新解码到裁剪区域, 按带顺序读取整幅图像的操作先用 decodeAll 一次解码
+// 处理操作按带流式执行, 每次只有一带及其邻域在内存中
+class TiledImageStore
+{
+public:
+    static constexpr int TileSize = 256;
+    // 超过该像素数(RGBA 256 MB, 与 QImageReader 默认的分配上限一致)的图片按分块方式打开
+    static constexpr qint64 LargeImagePixels = 64 * 1024 * 1024;
+
+    ~TiledImageStore();
+
+    // 只读取文件头判断尺寸
+    static bool isLargeImage(const QString &path);
+    // 打开图片并创建分块文件, 此时不解码像素; 失败时返回空指针并填写 error
+    static std::shared_ptr<TiledImageStore> open(const QString &path, QString *error = nullptr);
+
+    QString path() const { return filePath; }
+    QSize size() const { return imageSize; }
+    int width() const { return imageSize.width(); }
+    int height() const { return imageSize.height(); }
+    // 已解码的带数 / 总带数
+    int decodedBandCount() const;
+    int bandCount() const { return rows; }
+    // 用一个解码器顺序解码所有尚未解码的带, 解码结果先写入内存映射的临时图像; 失败时返回 false
+    bool decodeAll();
+
+    // 以下函数可在多个线程同时调用, 解码失败或被取消时返回空图像
+    // 区域像素(工作格式), 区域先与图像求交
+    QImage region(const QRect &rect, const std::atomic<bool> *cancel = nullptr);
+    // 缩小到 maxSize 以内的整幅图像, 只保留每带缩小后的结果
+    QImage overview(const QSize &maxSize, const std::atomic<bool> *cancel = nullptr);
+    // 整幅图像, 像素在内存映射的临时文件中, 最后一个副本释放时删除文件
+    QImage mappedImage(const std::atomic<bool> *cancel = nullptr);
+    // 空白图像(默认为工作格式), 像素同样在内存映射的临时文件中, 创建失败时返回空图像
+    static QImage createMappedImage(const QSize &size, QImage::Format format = ImageProcessor::WorkingFormat);
+    // 把原图的色彩空间、分辨率与文字信息复制到 target; 色彩空间与分辨率在第一次解码后才可用
+    void copyMetadata(QImage &target);
+
+    // 操作链中的操作都只读取有限邻域时才能按带执行
+    static bool canStream(const QVector<ImageOperation> &operations);
+    // 按带流式执行操作链, 每带多读取上下邻域, 结果与整图执行相同, 同样为内存映射的图像
+    // 不能按带执行时返回空图像, 由调用方改为在 mappedImage 上整图执行
+    QImage applyChain(const QVector<ImageOperation> &operations, const std::atomic<bool> *cancel = nullptr);
+
+private:
+    TiledImageStore() = default;
+
+    // 保证 [firstBand, lastBand] 已解码
+    bool ensureBands(int firstBand, int lastBand);
+    bool decodeClipped(int firstBand, int lastBand);
+    bool decodeWhole();
+    // 把从 top 行开始的整行像素写入分块, 已解码的带保持不变
+    void storeRows(int top, const QImage &pixels);
+    uchar *tileBits(int column, int row) const;
+
+    QString filePath;
+    QSize imageSize;
+    int columns = 0;
+    int rows = 0;
+    bool clipDecoding = false;
+
+    QTemporaryFile backing;
+    uchar *mapped = nullptr;
+
+    QMutex decodeMutex;                         // 同一时刻只有一个线程解码
+    QImage metadata;                            // 1x1 图像, 只用来保存原图的元数据, 由 decodeMutex 保护
+    std::unique_ptr<std::atomic<bool>[]> decoded;  // 每带是否已解码
+};
+
+#endif // TILEDIMAGESTORE_H
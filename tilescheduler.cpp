@@ -0,0 +1,209 @@
+﻿#include "tilescheduler.h"
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+#include <memory>
+
+namespace {
+
+// 单个分块的目标字节数(输入), 输出同样大小, 合计约占 L2 的一半
+const int TileBytes = 128 * 1024;
+// 分块的最大宽度(像素), 宽图按列切分, 保证分块足够多
+const int MaxTileWidth = 512;
+
+int initialThreadCount()
+{
+    bool ok = false;
+    const int count = qEnvironmentVariableIntValue("QT_IMAGE_THREADS", &ok);
+    return ok && count > 0 ? count : qMax(1, QThread::idealThreadCount());
+}
+
+std::atomic<int> currentThreadCount{initialThreadCount()};
+
+// 调度器专用线程池, 不与预览、解码等任务共用, 避免嵌套等待
+QThreadPool *workerPool()
+{
+    static QThreadPool *pool = [] {
+        QThreadPool *p = new QThreadPool;
+        p->setMaxThreadCount(qMax(QThread::idealThreadCount(), currentThreadCount.load() - 1));
+        p->setExpiryTimeout(30000);
+        return p;
+    }();
+    return pool;
+}
+
+// 每个线程的分块区间 [begin, end), 打包为一个 64 位整数以便无锁修改
+struct alignas(64) TileRange
+{
+    std::atomic<quint64> packed{0};
+
+    static quint64 pack(quint32 begin, quint32 end) { return quint64(end) << 32 | begin; }
+    static quint32 beginOf(quint64 value) { return quint32(value); }
+    static quint32 endOf(quint64 value) { return quint32(value >> 32); }
+
+    // 从前端取出一个分块
+    int popFront()
+    {
+        quint64 value = packed.load(std::memory_order_acquire);
+        for (;;) {
+            const quint32 begin = beginOf(value), end = endOf(value);
+            if (begin >= end) return -1;
+            if (packed.compare_exchange_weak(value, pack(begin + 1, end), std::memory_order_acq_rel)) {
+                return int(begin);
+            }
+        }
+    }
+
+    // 窃取后一半, 成功时返回窃得的区间
+    bool stealHalf(quint32 &stolenBegin, quint32 &stolenEnd)
+    {
+        quint64 value = packed.load(std::memory_order_acquire);
+        for (;;) {
+            const quint32 begin = beginOf(value), end = endOf(value);
+            if (begin >= end) return false;
+            const quint32 middle = begin + (end - begin) / 2;
+            if (packed.compare_exchange_weak(value, pack(begin, middle), std::memory_order_acq_rel)) {
+                stolenBegin = middle;
+                stolenEnd = end;
+                return true;
+            }
+        }
+    }
+};
+
+struct TileJob
+{
+    QVector<QRect> tiles;
+    std::unique_ptr<TileRange[]> ranges;
+    int workerCount = 0;
+    TileScheduler::TileFunction function;
+    const std::atomic<bool> *cancel = nullptr;
+    std::atomic<bool> canceled{false};
+
+    QMutex mutex;
+    QWaitCondition idle;
+    int activeHelpers = 0;
+    bool closed = false;
+
+    bool isCanceled()
+    {
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            canceled.store(true, std::memory_order_relaxed);
+        }
+        return canceled.load(std::memory_order_relaxed);
+    }
+
+    // 线程 worker 的主循环: 先做自己的分块, 再依次向其他线程窃取
+    void work(int worker)
+    {
+        TileRange &own = ranges[worker];
+        for (;;) {
+            int index;
+            while ((index = own.popFront()) >= 0) {
+                if (isCanceled()) return;
+                function(tiles.at(index));
+            }
+
+            bool stolen = false;
+            for (int i = 1; i < workerCount && !stolen; ++i) {
+                quint32 begin, end;
+                if (ranges[(worker + i) % workerCount].stealHalf(begin, end)) {
+                    own.packed.store(TileRange::pack(begin, end), std::memory_order_release);
+                    stolen = true;
+                }
+            }
+            if (!stolen) return;
+        }
+    }
+};
+
+} // namespace
+
+int TileScheduler::threadCount()
+{
+    return currentThreadCount.load(std::memory_order_relaxed);
+}
+
+void TileScheduler::setThreadCount(int count)
+{
+    currentThreadCount.store(qMax(1, count), std::memory_order_relaxed);
+    workerPool()->setMaxThreadCount(qMax(workerPool()->maxThreadCount(), count - 1));
+}
+
+QSize TileScheduler::tileSize(const QRect &area, int bytesPerPixel)
+{
+    const int width = qMax(1, qMin(area.width(), MaxTileWidth));
+    const int height = qMax(1, TileBytes / (width * qMax(1, bytesPerPixel)));
+    return QSize(width, height);
+}
+
+bool TileScheduler::run(const QRect &area, int bytesPerPixel, const TileFunction &function,
+                        const std::atomic<bool> *cancel)
+{
+    return run(area, tileSize(area, bytesPerPixel), function, cancel);
+}
+
+bool TileScheduler::run(const QRect &area, const QSize &tileSize, const TileFunction &function,
+                        const std::atomic<bool> *cancel)
+{
+    if (area.isEmpty()) return true;
+
+    // 按行优先切分, 相邻分块在内存中也相邻
+    auto job = std::make_shared<TileJob>();
+    const QSize size(qMax(1, tileSize.width()), qMax(1, tileSize.height()));
+    for (int y = area.top(); y <= area.bottom(); y += size.height()) {
+        for (int x = area.left(); x <= area.right(); x += size.width()) {
+            job->tiles.append(QRect(x, y, size.width(), size.height()).intersected(area));
+        }
+    }
+
+    const int tileCount = job->tiles.size();
+    job->workerCount = qMax(1, qMin(threadCount(), tileCount));
+    job->function = function;
+    job->cancel = cancel;
+
+    // 单线程时直接按顺序执行
+    if (job->workerCount == 1) {
+        for (const QRect &tile : std::as_const(job->tiles)) {
+            if (job->isCanceled()) return false;
+            function(tile);
+        }
+        return true;
+    }
+
+    // 初始时每个线程分得一段连续分块
+    job->ranges.reset(new TileRange[job->workerCount]);
+    for (int i = 0; i < job->workerCount; ++i) {
+        const quint32 begin = quint32(qint64(tileCount) * i / job->workerCount);
+        const quint32 end = quint32(qint64(tileCount) * (i + 1) / job->workerCount);
+        job->ranges[i].packed.store(TileRange::pack(begin, end), std::memory_order_relaxed);
+    }
+
+    // 辅助线程开始时若任务已结束则直接退出, 因此调用线程不必等待未启动的辅助线程
+    for (int i = 1; i < job->workerCount; ++i) {
+        workerPool()->start([job, i]() {
+            {
+                QMutexLocker locker(&job->mutex);
+                if (job->closed) return;
+                ++job->activeHelpers;
+            }
+            job->work(i);
+            QMutexLocker locker(&job->mutex);
+            if (--job->activeHelpers == 0) {
+                job->idle.wakeAll();
+            }
+        });
+    }
+
+    // 调用线程处理 0 号区间, 并窃取到没有剩余分块为止
+    job->work(0);
+
+    QMutexLocker locker(&job->mutex);
+    job->closed = true;
+    while (job->activeHelpers > 0) {
+        job->idle.wait(&job->mutex);
+    }
+    return !job->isCanceled();
+}
@@ -0,0 +1,34 @@
+﻿#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <QRect>
+#include <QSize>
+#include <atomic>
+#include <functional>
+
+// 分块并行调度器: 把区域切成适合缓存大小的分块, 在多个线程上执行同一内核
+// 每个线程先处理自己的一段连续分块, 做完后从其他线程的剩余分块中窃取一半
+// 内核只写自己分块内的输出, 读取输入时可越过分块边界(邻域操作的 halo 直接读共享输入),
+// 因此结果与单线程逐行执行完全一致
+class TileScheduler
+{
+public:
+    using TileFunction = std::function<void(const QRect &tile)>;
+
+    // 在 area 上并行执行 function, 调用线程也参与计算, 返回时所有分块已完成
+    // cancel 不为空时每个分块开始前检查, 置位后不再开始新的分块; 返回 false 表示被取消
+    static bool run(const QRect &area, int bytesPerPixel, const TileFunction &function,
+                    const std::atomic<bool> *cancel = nullptr);
+    // 指定分块尺寸, 用于每个分块有固定启动开销的内核
+    static bool run(const QRect &area, const QSize &tileSize, const TileFunction &function,
+                    const std::atomic<bool> *cancel = nullptr);
+
+    // 线程数, 默认为 CPU 逻辑核数, 可用环境变量 QT_IMAGE_THREADS 指定
+    static int threadCount();
+    static void setThreadCount(int count);
+
+    // 按每像素字节数计算分块尺寸, 使一个分块的输入与输出能同时放入 L2 缓存
+    static QSize tileSize(const QRect &area, int bytesPerPixel);
+};
+
+#endif // TILESCHEDULER_H
@@ -0,0 +1,204 @@
+﻿#include "tracer.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <vector>
+
+namespace {
+
+// 事件数上限, 约 40MB, 超出后丢弃新事件
+const int MaxEvents = 1 << 20;
+
+struct TraceEvent {
+    const char *category;
+    QByteArray name;
+    qint64 startNs;
+    qint64 durationNs;
+    int threadId;
+};
+
+struct TraceState {
+    QMutex mutex;
+    std::vector<TraceEvent> events;
+    QHash<int, QString> threadNames;
+    QHash<QString, int> virtualTracks;
+    int dropped = 0;
+};
+
+TraceState &state()
+{
+    static TraceState instance;
+    return instance;
+}
+
+const QElapsedTimer &traceClock()
+{
+    static const QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock;
+}
+
+std::atomic<int> nextThreadId{1};
+thread_local int currentThreadId = 0;
+
+// 调用方持有 state().mutex
+int threadIdLocked(TraceState &s)
+{
+    if (currentThreadId == 0) {
+        currentThreadId = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+        QThread *thread = QThread::currentThread();
+        QString name = thread ? thread->objectName() : QString();
+        if (name.isEmpty()) {
+            const bool isMain = QCoreApplication::instance() &&
+                                thread == QCoreApplication::instance()->thread();
+            name = isMain ? QStringLiteral("主线程") : QString("线程 %1").arg(currentThreadId);
+        }
+        s.threadNames.insert(currentThreadId, name);
+    }
+    return currentThreadId;
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::enabled{false};
+
+void Tracer::setEnabled(bool on)
+{
+    if (on && !isEnabled()) {
+        clear();
+    }
+    traceClock();
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+void Tracer::clear()
+{
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+    s.events.clear();
+    s.dropped = 0;
+}
+
+qint64 Tracer::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+void Tracer::addComplete(const char *category, const char *name, qint64 startNs, qint64 durationNs)
+{
+    addComplete(category, QByteArray::fromRawData(name, qstrlen(name)), startNs, durationNs);
+}
+
+void Tracer::addComplete(const char *category, const QByteArray &name, qint64 startNs, qint64 durationNs,
+                         int track)
+{
+    if (!isEnabled()) return;
+
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+    if (int(s.events.size()) >= MaxEvents) {
+        ++s.dropped;
+        return;
+    }
+    s.events.push_back({category, name, startNs, qMax<qint64>(0, durationNs),
+                        track != 0 ? track : threadIdLocked(s)});
+}
+
+int Tracer::virtualTrack(const QString &name)
+{
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+    const auto it = s.virtualTracks.constFind(name);
+    if (it != s.virtualTracks.constEnd()) return it.value();
+
+    const int track = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    s.virtualTracks.insert(name, track);
+    s.threadNames.insert(track, name);
+    return track;
+}
+
+void Tracer::setThreadName(const QString &name)
+{
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+    s.threadNames.insert(threadIdLocked(s), name);
+}
+
+int Tracer::eventCount()
+{
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+    return int(s.events.size());
+}
+
+int Tracer::droppedCount()
+{
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+    return s.dropped;
+}
+
+QByteArray Tracer::toChromeTrace()
+{
+    TraceState &s = state();
+    QMutexLocker locker(&s.mutex);
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray traceEvents;
+
+    // 元数据事件: 进程名与线程名
+    QJsonObject processName;
+    processName["name"] = "process_name";
+    processName["ph"] = "M";
+    processName["pid"] = pid;
+    processName["args"] = QJsonObject{{"name", QCoreApplication::applicationName()}};
+    traceEvents.append(processName);
+    for (auto it = s.threadNames.constBegin(); it != s.threadNames.constEnd(); ++it) {
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = pid;
+        threadName["tid"] = it.key();
+        threadName["args"] = QJsonObject{{"name", it.value()}};
+        traceEvents.append(threadName);
+    }
+
+    // 完整事件, 时间单位为微秒
+    for (const TraceEvent &event : s.events) {
+        QJsonObject json;
+        json["name"] = QString::fromUtf8(event.name);
+        json["cat"] = QString::fromLatin1(event.category);
+        json["ph"] = "X";
+        json["ts"] = event.startNs / 1000.0;
+        json["dur"] = event.durationNs / 1000.0;
+        json["pid"] = pid;
+        json["tid"] = event.threadId;
+        traceEvents.append(json);
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = traceEvents;
+    root["displayTimeUnit"] = "ms";
+    if (s.dropped > 0) {
+        root["otherData"] = QJsonObject{{"droppedEvents", s.dropped}};
+    }
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::writeChromeTrace(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(toChromeTrace()) >= 0;
+}
@@ -0,0 +1,80 @@
+﻿#ifndef TRACER_H
+#define TRACER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// 轻量的分段耗时跟踪, 导出为 Chrome 跟踪格式(about:tracing / Perfetto 可直接打开)
+// 关闭时每个跟踪点只有一次原子读取; 开启后事件记录在内存中, 由 writeChromeTrace 导出
+// 定义 QT_IMAGE_NO_TRACE 时 TRACE_SCOPE 展开为空
+class Tracer
+{
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    // 开启时清空之前的记录
+    static void setEnabled(bool on);
+    static void clear();
+
+    // 跟踪时钟, 纳秒, 所有线程共用同一起点
+    static qint64 now();
+
+    // 记录一个已完成的阶段; name 与 category 为字符串字面量时不复制
+    // track 为 0 时记录在当前线程上, 否则记录在 virtualTrack 返回的轨道上
+    static void addComplete(const char *category, const char *name, qint64 startNs, qint64 durationNs);
+    static void addComplete(const char *category, const QByteArray &name, qint64 startNs, qint64 durationNs,
+                            int track = 0);
+
+    // 不对应本进程线程的轨道(例如页面中的阶段), 同名轨道返回同一编号
+    static int virtualTrack(const QString &name);
+
+    // 为当前线程命名, 显示在跟踪视图的线程标题上
+    static void setThreadName(const QString &name);
+
+    static int eventCount();
+    // 超出缓冲区上限而丢弃的事件数
+    static int droppedCount();
+
+    static QByteArray toChromeTrace();
+    static bool writeChromeTrace(const QString &path);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+// 作用域跟踪点: 构造时记下开始时间, 析构时记录一个完整阶段
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name)
+        : category(category), name(name), startNs(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (startNs >= 0) {
+            Tracer::addComplete(category, name, startNs, Tracer::now() - startNs);
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *category;
+    const char *name;
+    qint64 startNs;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#ifdef QT_IMAGE_NO_TRACE
+#define TRACE_SCOPE(category, name) do {} while (false)
+#else
+#define TRACE_SCOPE(category, name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(category, name)
+#endif
+
+#endif // TRACER_H
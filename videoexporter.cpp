@@ -0,0 +1,317 @@
+﻿#include "videoexporter.h"
+#include "tracer.h"
+#include "videopipeline.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QMediaCaptureSession>
+#include <QMediaFormat>
+#include <QMediaMetaData>
+#include <QUrl>
+#include <QVideoFrameInput>
+#include <QVideoSink>
+
+namespace {
+
+// 按扩展名选择容器格式, 编码器由 QMediaRecorder 按容器选择默认值
+QMediaFormat::FileFormat containerForSuffix(const QString &suffix)
+{
+    const QString lower = suffix.toLower();
+    if (lower == "mkv") return QMediaFormat::Matroska;
+    if (lower == "webm") return QMediaFormat::WebM;
+    if (lower == "avi") return QMediaFormat::AVI;
+    if (lower == "mov") return QMediaFormat::QuickTime;
+    return QMediaFormat::MPEG4;
+}
+
+} // namespace
+
+VideoExporter::VideoExporter(QObject *parent)
+    : QObject(parent)
+{
+}
+
+VideoExporter::~VideoExporter()
+{
+    cancel();
+}
+
+bool VideoExporter::start(const Options &exportOptions)
+{
+    if (running) return false;
+
+    options = exportOptions;
+    running = true;
+    paused = false;
+    framesWritten = 0;
+    lastStartTime = -1;
+    lastEndTime = -1;
+    framesSkipped = 0;
+    recordingStarted = false;
+    recordingStopping = false;
+    pendingFrame.reset();
+    decoded.emplace(DecodeCapacity);
+    processed.emplace(EncodeCapacity);
+    wallClock.start();
+
+    // 编码端: 视频文件由 QMediaRecorder 在界面线程驱动, 图像序列在独立线程写文件
+    if (options.kind == OutputKind::VideoFile) {
+        session = new QMediaCaptureSession(this);
+        frameInput = new QVideoFrameInput(this);
+        recorder = new QMediaRecorder(this);
+        session->setVideoFrameInput(frameInput);
+        session->setRecorder(recorder);
+        recorder->setOutputLocation(QUrl::fromLocalFile(options.output));
+        recorder->setMediaFormat(QMediaFormat(containerForSuffix(QFileInfo(options.output).suffix())));
+        recorder->setQuality(QMediaRecorder::HighQuality);
+        connect(frameInput, &QVideoFrameInput::readyToSendVideoFrame, this, &VideoExporter::sendVideoFrames);
+        connect(recorder, &QMediaRecorder::errorOccurred, this, [this](QMediaRecorder::Error, const QString &message) {
+            finish(false, tr("编码失败: %1").arg(message));
+        });
+        connect(recorder, &QMediaRecorder::recorderStateChanged, this, [this](QMediaRecorder::RecorderState state) {
+            if (state == QMediaRecorder::StoppedState && running && recordingStopping) {
+                finish(true, QString());
+            }
+        });
+    } else {
+        writeThread = QThread::create([this]() { writeImageSequence(); });
+        writeThread->setObjectName("导出写文件");
+        writeThread->start();
+    }
+
+    processThread = QThread::create([this]() { processFrames(); });
+    processThread->setObjectName("导出处理");
+    processThread->start();
+
+    // 解码端: 不接音频输出, 帧在 QVideoSink 的发出线程上直接入队
+    player = new QMediaPlayer(this);
+    sink = new QVideoSink(this);
+    player->setVideoSink(sink);
+    connect(sink, &QVideoSink::videoFrameChanged, this, &VideoExporter::onFrameDecoded, Qt::DirectConnection);
+    connect(player, &QMediaPlayer::mediaStatusChanged, this, &VideoExporter::onMediaStatusChanged);
+    connect(player, &QMediaPlayer::errorOccurred, this, [this](QMediaPlayer::Error, const QString &message) {
+        finish(false, tr("解码失败: %1").arg(message));
+    });
+    player->setSource(QUrl::fromLocalFile(options.source));
+    player->play();
+    return true;
+}
+
+void VideoExporter::cancel()
+{
+    if (!running) return;
+    finish(false, tr("导出已取消"));
+}
+
+// QVideoSink 的发出线程
+void VideoExporter::onFrameDecoded(const QVideoFrame &frame)
+{
+    if (!frame.isValid() || !decoded) return;
+
+    // 暂停后恢复播放时可能再次发出当前帧, 按时间戳去重
+    if (frame.startTime() >= 0) {
+        if (frame.startTime() <= lastStartTime) return;
+        lastStartTime = frame.startTime();
+
+        // 与上一帧之间的空隙超过半帧时长, 说明播放管线跳过了帧
+        const qint64 frameDuration = frame.endTime() - frame.startTime();
+        if (lastEndTime >= 0 && frameDuration > 0) {
+            const qint64 gap = frame.startTime() - lastEndTime;
+            if (gap * 2 >= frameDuration) {
+                framesSkipped += int((gap + frameDuration / 2) / frameDuration);
+            }
+        }
+        lastEndTime = frame.endTime();
+    }
+    if (!decoded->push(frame)) return;
+
+    // 处理跟不上时暂停播放, 处理线程消化积压后恢复
+    if (decoded->size() >= PauseAbove && !paused.exchange(true)) {
+        QMetaObject::invokeMethod(this, [this]() {
+            if (running && player) player->pause();
+        }, Qt::QueuedConnection);
+    }
+}
+
+void VideoExporter::onMediaStatusChanged(QMediaPlayer::MediaStatus status)
+{
+    if (status == QMediaPlayer::EndOfMedia) {
+        // 之后处理线程取完剩余帧即结束
+        decoded->close();
+    } else if (status == QMediaPlayer::InvalidMedia) {
+        finish(false, tr("无法打开视频: %1").arg(player->errorString()));
+    }
+}
+
+// 处理线程
+void VideoExporter::processFrames()
+{
+    Tracer::setThreadName("导出处理");
+
+    while (std::optional<QVideoFrame> frame = decoded->pop()) {
+        if (paused.load() && decoded->size() <= ResumeBelow && paused.exchange(false)) {
+            QMetaObject::invokeMethod(this, [this]() {
+                if (running && player) player->play();
+            }, Qt::QueuedConnection);
+        }
+
+        TRACE_SCOPE("export", "export.process");
+        ProcessedFrame result;
+        result.startTime = frame->startTime();
+        result.endTime = frame->endTime();
+        // 操作链以亮度操作开头时它直接作用于 Y 平面, 否则只做颜色转换, 操作链整体在 RGBA 上执行
+        const bool lumaFirst = !options.operations.isEmpty()
+            && ImageProcessor::isLumaOperation(options.operations.first());
+        const QImage image = VideoPipeline::applyToFrame(
+            *frame, lumaFirst ? options.operations.first() : ImageOperation());
+        result.image = ImageProcessor::applyChain(image, options.operations.mid(lumaFirst ? 1 : 0));
+        frame.reset();
+        if (result.image.isNull()) continue;
+
+        if (!processed->push(std::move(result))) break;
+        if (options.kind == OutputKind::VideoFile) {
+            QMetaObject::invokeMethod(this, &VideoExporter::sendVideoFrames, Qt::QueuedConnection);
+        }
+    }
+
+    processed->close();
+    if (options.kind == OutputKind::VideoFile) {
+        QMetaObject::invokeMethod(this, &VideoExporter::sendVideoFrames, Qt::QueuedConnection);
+    }
+}
+
+// 写文件线程
+void VideoExporter::writeImageSequence()
+{
+    Tracer::setThreadName("导出写文件");
+
+    const QFileInfo info(options.output);
+    const QString suffix = info.suffix().isEmpty() ? QStringLiteral("png") : info.suffix();
+    const QDir dir = info.absoluteDir();
+    int index = 0;
+
+    while (std::optional<ProcessedFrame> frame = processed->pop()) {
+        TRACE_SCOPE("export", "export.write");
+        const QString path = dir.filePath(QString("%1_%2.%3")
+                                              .arg(info.completeBaseName())
+                                              .arg(++index, 6, 10, QLatin1Char('0'))
+                                              .arg(suffix));
+        QImageWriter writer(path);
+        writer.setQuality(options.quality);
+        if (!writer.write(frame->image)) {
+            const QString message = tr("无法写入 %1: %2").arg(path, writer.errorString());
+            QMetaObject::invokeMethod(this, [this, message]() { finish(false, message); }, Qt::QueuedConnection);
+            return;
+        }
+        const qint64 startTime = frame->startTime;
+        QMetaObject::invokeMethod(this, [this, startTime]() { onFrameWritten(startTime); }, Qt::QueuedConnection);
+    }
+
+    QMetaObject::invokeMethod(this, [this]() {
+        if (running) finish(true, QString());
+    }, Qt::QueuedConnection);
+}
+
+// 界面线程: 把处理好的帧交给 QVideoFrameInput, 它暂不接收时等待 readyToSendVideoFrame
+void VideoExporter::sendVideoFrames()
+{
+    if (!running || !frameInput) return;
+
+    for (;;) {
+        if (!pendingFrame) {
+            pendingFrame = processed->tryPop();
+        }
+        if (!pendingFrame) break;
+
+        QVideoFrame frame(pendingFrame->image);
+        frame.setStartTime(pendingFrame->startTime);
+        frame.setEndTime(pendingFrame->endTime);
+
+        // 第一帧确定了编码尺寸与帧率后再开始录制
+        if (!recordingStarted) {
+            recordingStarted = true;
+            const qreal frameRate = player->metaData().value(QMediaMetaData::VideoFrameRate).toReal();
+            if (frameRate > 0) {
+                recorder->setVideoFrameRate(frameRate);
+            }
+            recorder->setVideoResolution(pendingFrame->image.size());
+            recorder->record();
+        }
+
+        if (!frameInput->sendVideoFrame(frame)) return;
+        const qint64 startTime = pendingFrame->startTime;
+        pendingFrame.reset();
+        onFrameWritten(startTime);
+    }
+
+    // 所有帧已交给编码器, 停止录制后在 StoppedState 中结束
+    if (!processed->isDrained() || recordingStopping) return;
+    if (recordingStarted) {
+        recordingStopping = true;
+        recorder->stop();
+    } else {
+        finish(false, tr("视频中没有可导出的帧"));
+    }
+}
+
+void VideoExporter::onFrameWritten(qint64 startTime)
+{
+    if (!running) return;
+
+    ++framesWritten;
+    const qint64 duration = player ? player->duration() : 0;
+    const qint64 position = qMax<qint64>(0, startTime / 1000);
+    qint64 remaining = -1;
+    if (position > 0 && duration > 0) {
+        remaining = wallClock.elapsed() * qMax<qint64>(0, duration - position) / position;
+    }
+    emit progress(framesWritten, position, duration, remaining);
+}
+
+void VideoExporter::finish(bool success, const QString &message)
+{
+    if (!running) return;
+    running = false;
+
+    if (player) {
+        player->stop();
+    }
+    stopThreads();
+    if (recorder && recorder->recorderState() != QMediaRecorder::StoppedState) {
+        recorder->stop();
+    }
+
+    // 信号发出线程可能仍持有 sink, 对象延迟到事件循环中释放
+    for (QObject *object : {static_cast<QObject *>(player), static_cast<QObject *>(sink),
+                            static_cast<QObject *>(recorder), static_cast<QObject *>(frameInput),
+                            static_cast<QObject *>(session)}) {
+        if (object) {
+            object->disconnect(this);
+            object->deleteLater();
+        }
+    }
+    player = nullptr;
+    sink = nullptr;
+    recorder = nullptr;
+    frameInput = nullptr;
+    session = nullptr;
+    pendingFrame.reset();
+
+    const int skipped = framesSkipped.load();
+    emit finished(success, success && skipped > 0 ? tr("解码跟不上播放, 约跳过 %1 帧").arg(skipped) : message);
+}
+
+void VideoExporter::stopThreads()
+{
+    // 关闭队列后阻塞中的生产者与消费者都会返回
+    if (decoded) decoded->abort();
+    if (processed) processed->abort();
+    for (QThread *thread : {processThread, writeThread}) {
+        if (thread) {
+            thread->wait();
+            delete thread;
+        }
+    }
+    processThread = nullptr;
+    writeThread = nullptr;
+}
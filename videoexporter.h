@@ -0,0 +1,110 @@
+﻿#ifndef VIDEOEXPORTER_H
+#define VIDEOEXPORTER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMediaPlayer>
+#include <QMediaRecorder>
+#include <QThread>
+#include <QVector>
+#include <QVideoFrame>
+#include <atomic>
+#include <optional>
+#include "boundedqueue.h"
+#include "imageprocessor.h"
+
+class QMediaCaptureSession;
+class QVideoFrameInput;
+class QVideoSink;
+
+// 把操作链应用到视频的每一帧并流式写出, 整个过程中只有少量帧同时在内存中
+//   解码: QMediaPlayer 播放到 QVideoSink, 帧在发出线程上放入有界队列
+//   处理: 工作线程转换为 QImage 并执行操作链
+//   编码: 图像序列由写文件线程输出; 视频文件通过 QVideoFrameInput 交给 QMediaRecorder
+// 三个阶段之间为有界队列, 解码队列积压时暂停播放, 消化后继续
+// QMediaPlayer 只能按实时播放解码, 没有逐帧拉取的接口; 播放管线自身跟不上(如高码率视频)时仍会跳帧,
+// 导出只能尽力而为, 按时间戳间隔估计跳过的帧数并在结束时报告
+class VideoExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class OutputKind {
+        VideoFile,      // 编码为视频文件(格式由扩展名决定)
+        ImageSequence   // 每帧一个图像文件: <目录>/<名称>_000001.<扩展名>
+    };
+
+    struct Options
+    {
+        QString source;
+        QString output;
+        OutputKind kind = OutputKind::VideoFile;
+        QVector<ImageOperation> operations;
+        int quality = -1;               // 图像序列的编码质量, -1 为默认
+    };
+
+    explicit VideoExporter(QObject *parent = nullptr);
+    ~VideoExporter();
+
+    // 开始导出, 已在导出时返回 false
+    bool start(const Options &options);
+    // 取消导出, 已写出的文件保留
+    void cancel();
+    bool isRunning() const { return running; }
+
+signals:
+    // 已写出的帧数, 当前帧在源视频中的位置, 源视频总时长, 预计剩余时间(未知时为 -1)
+    void progress(int framesWritten, qint64 positionMs, qint64 durationMs, qint64 remainingMs);
+    // 成功时 message 为空, 或说明估计跳过的帧数
+    void finished(bool success, const QString &message);
+
+private:
+    struct ProcessedFrame
+    {
+        QImage image;
+        qint64 startTime = -1;      // 微秒
+        qint64 endTime = -1;
+    };
+
+    void onFrameDecoded(const QVideoFrame &frame);
+    void onMediaStatusChanged(QMediaPlayer::MediaStatus status);
+    void processFrames();
+    void writeImageSequence();
+    void sendVideoFrames();
+    void onFrameWritten(qint64 startTime);
+    void finish(bool success, const QString &message);
+    void stopThreads();
+
+    // 解码队列容量与流控水位
+    static constexpr int DecodeCapacity = 8;
+    static constexpr int PauseAbove = 4;
+    static constexpr int ResumeBelow = 1;
+    static constexpr int EncodeCapacity = 4;
+
+    Options options;
+    bool running = false;
+    std::atomic<bool> paused{false};
+
+    QMediaPlayer *player = nullptr;
+    QVideoSink *sink = nullptr;
+    QMediaCaptureSession *session = nullptr;
+    QVideoFrameInput *frameInput = nullptr;
+    QMediaRecorder *recorder = nullptr;
+    std::optional<ProcessedFrame> pendingFrame;   // QVideoFrameInput 暂时不接收的帧
+    bool recordingStarted = false;
+    bool recordingStopping = false;
+
+    std::optional<BoundedQueue<QVideoFrame>> decoded;
+    std::optional<BoundedQueue<ProcessedFrame>> processed;
+    QThread *processThread = nullptr;
+    QThread *writeThread = nullptr;
+
+    qint64 lastStartTime = -1;      // 只在 QVideoSink 的发出线程上访问
+    qint64 lastEndTime = -1;        // 同上
+    std::atomic<int> framesSkipped{0};
+    int framesWritten = 0;
+    QElapsedTimer wallClock;
+};
+
+#endif // VIDEOEXPORTER_H
@@ -0,0 +1,236 @@
+﻿#include "videopipeline.h"
+#include "tracer.h"
+#include <QMutexLocker>
+
+VideoPipeline::VideoPipeline(QObject *parent)
+    : QObject(parent)
+    , queue(QueueCapacity, DropPolicy::DropOldest)
+{
+}
+
+VideoPipeline::~VideoPipeline()
+{
+    stop();
+}
+
+void VideoPipeline::start()
+{
+    if (running.load(std::memory_order_acquire)) return;
+
+    stopping.store(false, std::memory_order_relaxed);
+    worker = QThread::create([this]() { processFrames(); });
+    worker->setObjectName("视频处理");
+    worker->start();
+    running.store(true, std::memory_order_release);
+}
+
+void VideoPipeline::stop()
+{
+    if (!running.load(std::memory_order_acquire)) return;
+
+    // 先停止接收新帧, 再唤醒并等待工作线程退出
+    running.store(false, std::memory_order_release);
+    stopping.store(true, std::memory_order_relaxed);
+    available.release();
+    worker->wait();
+    delete worker;
+    worker = nullptr;
+
+    while (queue.pop()) {
+    }
+    available.tryAcquire(available.available());
+
+    QMutexLocker locker(&resultMutex);
+    latest = QImage();
+    notified.store(false, std::memory_order_relaxed);
+}
+
+void VideoPipeline::submit(const QVideoFrame &frame)
+{
+    if (!running.load(std::memory_order_acquire) || !frame.isValid()) return;
+
+    received.fetch_add(1, std::memory_order_relaxed);
+    if (queue.push(frame)) {
+        available.release();
+    }
+}
+
+void VideoPipeline::setOperation(const ImageOperation &newOperation)
+{
+    QMutexLocker locker(&settingsMutex);
+    operation = newOperation;
+}
+
+ImageOperation VideoPipeline::currentOperation() const
+{
+    QMutexLocker locker(&settingsMutex);
+    return operation;
+}
+
+void VideoPipeline::setTargetSize(const QSize &size)
+{
+    QMutexLocker locker(&settingsMutex);
+    targetSize = size;
+}
+
+void VideoPipeline::setDropPolicy(DropPolicy policy)
+{
+    queue.setPolicy(policy);
+}
+
+VideoPipeline::DropPolicy VideoPipeline::dropPolicy() const
+{
+    return queue.policy();
+}
+
+VideoPipeline::Statistics VideoPipeline::statistics() const
+{
+    Statistics stats;
+    stats.received = received.load(std::memory_order_relaxed);
+    stats.processed = processed.load(std::memory_order_relaxed);
+    stats.droppedQueued = queue.droppedCount() - droppedQueuedBase.load(std::memory_order_relaxed);
+    stats.droppedDisplay = droppedDisplay.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void VideoPipeline::resetStatistics()
+{
+    received.store(0, std::memory_order_relaxed);
+    processed.store(0, std::memory_order_relaxed);
+    droppedDisplay.store(0, std::memory_order_relaxed);
+    droppedQueuedBase.store(queue.droppedCount(), std::memory_order_relaxed);
+}
+
+QImage VideoPipeline::takeLatestFrame()
+{
+    QMutexLocker locker(&resultMutex);
+    QImage image = latest;
+    latest = QImage();
+    notified.store(false, std::memory_order_relaxed);
+    return image;
+}
+
+void VideoPipeline::processFrames()
+{
+    Tracer::setThreadName("视频处理");
+
+    for (;;) {
+        available.acquire();
+        if (stopping.load(std::memory_order_relaxed)) break;
+
+        // 帧可能已被生产者按丢弃最旧策略取走, 此时只是多余的唤醒
+        std::optional<QVideoFrame> frame = queue.pop();
+        if (!frame) continue;
+
+        const QImage image = processFrame(*frame);
+        frame.reset();
+        if (image.isNull()) continue;
+        processed.fetch_add(1, std::memory_order_relaxed);
+
+        {
+            QMutexLocker locker(&resultMutex);
+            if (!latest.isNull()) {
+                droppedDisplay.fetch_add(1, std::memory_order_relaxed);
+            }
+            latest = image;
+        }
+        if (!notified.exchange(true, std::memory_order_relaxed)) {
+            emit frameReady();
+        }
+    }
+}
+
+QImage VideoPipeline::processFrame(const QVideoFrame &frame)
+{
+    TRACE_SCOPE("video", "video.process");
+
+    ImageOperation frameOperation;
+    QSize size;
+    {
+        QMutexLocker locker(&settingsMutex);
+        frameOperation = operation;
+        size = targetSize;
+    }
+
+    // 亮度效果在原始分辨率的 Y 平面上直接完成, 只需缩放结果
+    // 其余效果先转换为 RGBA, 缩小后再执行, 效果只处理显示所需的像素
+    const bool lumaOnly = ImageProcessor::isLumaOperation(frameOperation);
+    QImage image = applyToFrame(frame, lumaOnly ? frameOperation : ImageOperation());
+    if (image.isNull()) return QImage();
+
+    // 只缩小不放大
+    if (!size.isEmpty() && (image.width() > size.width() || image.height() > size.height())) {
+        TRACE_SCOPE("video", "scaleFrame");
+        image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    return lumaOnly ? image : ImageProcessor::apply(image, frameOperation);
+}
+
+bool VideoPipeline::mapYuvPlanes(QVideoFrame &frame, YuvPlanes &planes)
+{
+    const QVideoFrameFormat::PixelFormat format = frame.pixelFormat();
+    if (format != QVideoFrameFormat::Format_NV12 && format != QVideoFrameFormat::Format_NV21
+        && format != QVideoFrameFormat::Format_YUV420P && format != QVideoFrameFormat::Format_YV12) {
+        return false;
+    }
+    if (!frame.map(QtVideo::MapMode::ReadOnly)) return false;
+
+    planes = YuvPlanes();
+    planes.width = frame.width();
+    planes.height = frame.height();
+    planes.y = frame.bits(0);
+    planes.yStride = frame.bytesPerLine(0);
+
+    switch (format) {
+    case QVideoFrameFormat::Format_NV12:
+    case QVideoFrameFormat::Format_NV21: {
+        const uchar *uv = frame.bits(1);
+        const bool vFirst = format == QVideoFrameFormat::Format_NV21;
+        planes.u = vFirst ? uv + 1 : uv;
+        planes.v = vFirst ? uv : uv + 1;
+        planes.uvStride = frame.bytesPerLine(1);
+        planes.uvStep = 2;
+        break;
+    }
+    default: {
+        // YV12 的 V 平面在前
+        const bool vFirst = format == QVideoFrameFormat::Format_YV12;
+        planes.u = frame.bits(vFirst ? 2 : 1);
+        planes.v = frame.bits(vFirst ? 1 : 2);
+        planes.uvStride = frame.bytesPerLine(1);
+        planes.uvStep = 1;
+        break;
+    }
+    }
+
+    const QVideoFrameFormat surface = frame.surfaceFormat();
+    planes.bt709 = surface.colorSpace() == QVideoFrameFormat::ColorSpace_BT709;
+    planes.fullRange = surface.colorRange() == QVideoFrameFormat::ColorRange_Full;
+
+    if (!planes.isValid()) {
+        frame.unmap();
+        return false;
+    }
+    return true;
+}
+
+QImage VideoPipeline::applyToFrame(const QVideoFrame &frame, const ImageOperation &operation)
+{
+    QVideoFrame mapped = frame;
+    YuvPlanes planes;
+    if (mapYuvPlanes(mapped, planes)) {
+        TRACE_SCOPE("video", "applyToYuv");
+        const QImage image = ImageProcessor::applyToYuv(planes, operation);
+        mapped.unmap();
+        return image;
+    }
+
+    QImage image;
+    {
+        TRACE_SCOPE("video", "QVideoFrame::toImage");
+        image = frame.toImage();
+    }
+    if (image.isNull() || !operation.isValid()) return image;
+    return ImageProcessor::apply(image, operation);
+}
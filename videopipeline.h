@@ -0,0 +1,94 @@
+﻿#ifndef VIDEOPIPELINE_H
+#define VIDEOPIPELINE_H
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+#include <QSemaphore>
+#include <QSize>
+#include <QThread>
+#include <QVideoFrame>
+#include <atomic>
+#include "framequeue.h"
+#include "imageprocessor.h"
+
+// 视频帧处理流水线: 播放线程只把帧放入有界无锁队列, 转换、缩放和效果都在工作线程完成
+// 只依赖亮度的效果直接作用于 Y 平面, 其余效果先经 SIMD 内核把 YUV 转为 RGBA
+// 处理跟不上时按丢帧策略丢弃队列中的帧, 播放本身始终保持源帧率
+// 处理结果只保留最新一帧, 界面取走之前的新结果会替换旧结果
+class VideoPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    using DropPolicy = FrameQueue<QVideoFrame>::DropPolicy;
+
+    struct Statistics
+    {
+        quint64 received = 0;       // 收到的帧
+        quint64 processed = 0;      // 处理完成的帧
+        quint64 droppedQueued = 0;  // 队列满被丢弃的帧
+        quint64 droppedDisplay = 0; // 处理完但界面来不及显示的帧
+    };
+
+    explicit VideoPipeline(QObject *parent = nullptr);
+    ~VideoPipeline();
+
+    void start();
+    void stop();
+    bool isRunning() const { return running.load(std::memory_order_acquire); }
+
+    // 生产者接口, 在 QVideoSink 发出帧的线程上直接调用, 不阻塞
+    void submit(const QVideoFrame &frame);
+
+    // 以下设置可在任意线程调用, 从下一帧开始生效
+    void setOperation(const ImageOperation &operation);
+    ImageOperation currentOperation() const;
+    // 帧缩放到该尺寸以内(保持比例), 空尺寸表示不缩放
+    void setTargetSize(const QSize &size);
+    void setDropPolicy(DropPolicy policy);
+    DropPolicy dropPolicy() const;
+
+    Statistics statistics() const;
+    void resetStatistics();
+
+    // 取走最新的处理结果, 没有新结果时返回空图像
+    QImage takeLatestFrame();
+
+    // 以只读方式映射 4:2:0 帧(NV12、NV21、I420、YV12)并填写平面信息, 成功后由调用方 unmap
+    static bool mapYuvPlanes(QVideoFrame &frame, YuvPlanes &planes);
+    // 对一帧执行操作(可为空操作), 4:2:0 帧直接处理映射的平面, 其余格式退回 QVideoFrame::toImage
+    static QImage applyToFrame(const QVideoFrame &frame, const ImageOperation &operation);
+
+signals:
+    // 有新结果可取; 上一次通知的结果被取走之前不会再次发出
+    void frameReady();
+
+private:
+    void processFrames();
+    QImage processFrame(const QVideoFrame &frame);
+
+    // 队列容量: 较小的值让显示延迟保持在几帧以内
+    static constexpr int QueueCapacity = 3;
+
+    FrameQueue<QVideoFrame> queue;
+    QSemaphore available;           // 只用于唤醒工作线程, 帧数据不经过锁
+    QThread *worker = nullptr;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+
+    mutable QMutex settingsMutex;
+    ImageOperation operation;
+    QSize targetSize;
+
+    QMutex resultMutex;
+    QImage latest;
+    std::atomic<bool> notified{false};
+
+    std::atomic<quint64> received{0};
+    std::atomic<quint64> processed{0};
+    std::atomic<quint64> droppedDisplay{0};
+    std::atomic<quint64> droppedQueuedBase{0}; // resetStatistics 时队列的累计丢帧数
+};
+
+#endif // VIDEOPIPELINE_H
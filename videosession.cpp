@@ -0,0 +1,251 @@
+﻿#include "videosession.h"
+#include "videoexporter.h"
+#include "videopipeline.h"
+#include <QComboBox>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QMainWindow>
+#include <QMediaPlayer>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QPushButton>
+#include <QStatusBar>
+#include <QTimer>
+#include <QUrl>
+#include <QVBoxLayout>
+#include <QVideoFrame>
+#include <QVideoSink>
+
+VideoSession::VideoSession(QMainWindow *window)
+    : QObject(window)
+    , window(window)
+{
+    // 视频帧在工作线程处理, 界面只显示最新结果
+    pipeline = new VideoPipeline(this);
+    connect(pipeline, &VideoPipeline::frameReady, this, &VideoSession::onFrameReady);
+    statusLabel = new QLabel(window);
+    statusLabel->setVisible(false);
+    window->statusBar()->addPermanentWidget(statusLabel);
+    statusTimer = new QTimer(this);
+    statusTimer->setInterval(500);
+    connect(statusTimer, &QTimer::timeout, this, &VideoSession::updateStatus);
+    exporter = new VideoExporter(this);
+}
+
+VideoSession::~VideoSession()
+{
+    close();
+}
+
+void VideoSession::open(const QString &path, const QSize &targetSize)
+{
+    close();
+    currentPath = path;
+
+    // 先创建媒体播放器，但暂不播放
+    if (!player) {
+        player = new QMediaPlayer(this);
+    }
+
+    // 创建视频接收器 (Qt 6特有)
+    if (!sink) {
+        sink = new QVideoSink(this);
+        // 帧在发出线程上直接入队, 不经过界面线程的事件循环
+        connect(sink, &QVideoSink::videoFrameChanged, this, &VideoSession::onFrameChanged,
+                Qt::DirectConnection);
+    }
+
+    // 设置视频输出
+    player->setVideoSink(sink);
+
+    // 设置视频源
+    player->setSource(QUrl::fromLocalFile(path));
+
+    // 添加到布局
+    controlPanel = createControlPanel();
+    QVBoxLayout *layout = qobject_cast<QVBoxLayout*>(window->centralWidget()->layout());
+    if (layout) {
+        layout->addWidget(controlPanel);
+    }
+
+    // 启动处理线程, 帧缩放到画布显示尺寸
+    active = true;
+    pipeline->setOperation(ImageOperation());
+    pipeline->setTargetSize(targetSize);
+    pipeline->resetStatistics();
+    pipeline->start();
+    statusLabel->setVisible(true);
+    statusTimer->start();
+    statusElapsed.start();
+    lastProcessedFrames = 0;
+    updateStatus();
+
+    // 开始播放
+    player->play();
+}
+
+void VideoSession::close()
+{
+    if (!active) return;
+    active = false;
+
+    // 停止播放器与处理线程
+    if (player) {
+        player->stop();
+    }
+    pipeline->stop();
+    statusTimer->stop();
+    statusLabel->setVisible(false);
+
+    // 移除控制面板
+    if (controlPanel) {
+        controlPanel->deleteLater();
+        controlPanel = nullptr;
+    }
+}
+
+void VideoSession::setOperation(const ImageOperation &operation)
+{
+    pipeline->setOperation(operation);
+}
+
+void VideoSession::setTargetSize(const QSize &size)
+{
+    pipeline->setTargetSize(size);
+}
+
+QWidget *VideoSession::createControlPanel()
+{
+    QWidget *panel = new QWidget(window);
+    QHBoxLayout *controlLayout = new QHBoxLayout(panel);
+
+    QPushButton *playButton = new QPushButton(tr("播放"), panel);
+    QPushButton *pauseButton = new QPushButton(tr("暂停"), panel);
+    QPushButton *stopButton = new QPushButton(tr("停止"), panel);
+
+    controlLayout->addWidget(playButton);
+    controlLayout->addWidget(pauseButton);
+    controlLayout->addWidget(stopButton);
+
+    // 处理跟不上播放时的丢帧策略
+    QComboBox *dropPolicyBox = new QComboBox(panel);
+    dropPolicyBox->addItem(tr("丢弃最旧帧"), int(VideoPipeline::DropPolicy::DropOldest));
+    dropPolicyBox->addItem(tr("丢弃最新帧"), int(VideoPipeline::DropPolicy::DropNewest));
+    dropPolicyBox->setCurrentIndex(pipeline->dropPolicy() == VideoPipeline::DropPolicy::DropOldest ? 0 : 1);
+    controlLayout->addWidget(dropPolicyBox);
+    connect(dropPolicyBox, &QComboBox::currentIndexChanged, this, [this, dropPolicyBox](int index) {
+        pipeline->setDropPolicy(VideoPipeline::DropPolicy(dropPolicyBox->itemData(index).toInt()));
+    });
+
+    // 把当前效果应用到整段视频并导出
+    QPushButton *exportButton = new QPushButton(tr("导出..."), panel);
+    controlLayout->addWidget(exportButton);
+    connect(exportButton, &QPushButton::clicked, this, &VideoSession::exportVideo);
+
+    // 添加返回按钮
+    QPushButton *returnButton = new QPushButton(tr("返回图像编辑"), panel);
+    controlLayout->addWidget(returnButton);
+
+    panel->setLayout(controlLayout);
+
+    // 连接按钮信号
+    connect(playButton, &QPushButton::clicked, player, &QMediaPlayer::play);
+    connect(pauseButton, &QPushButton::clicked, player, &QMediaPlayer::pause);
+    connect(stopButton, &QPushButton::clicked, player, &QMediaPlayer::stop);
+    connect(returnButton, &QPushButton::clicked, this, &VideoSession::closeRequested);
+    return panel;
+}
+
+// 在 QVideoSink 发出帧的线程上调用, 只把帧放入处理队列
+void VideoSession::onFrameChanged(const QVideoFrame &frame)
+{
+    pipeline->submit(frame);
+}
+
+// 工作线程处理完一帧
+void VideoSession::onFrameReady()
+{
+    const QImage image = pipeline->takeLatestFrame();
+    if (!active || image.isNull()) return;
+    emit frameReady(image);
+}
+
+// 状态栏显示视频处理帧率与丢帧数
+void VideoSession::updateStatus()
+{
+    const VideoPipeline::Statistics stats = pipeline->statistics();
+    const qint64 elapsed = statusElapsed.restart();
+    const double fps = elapsed > 0 ? (stats.processed - lastProcessedFrames) * 1000.0 / elapsed : 0.0;
+    lastProcessedFrames = stats.processed;
+
+    statusLabel->setText(tr("视频 %1 fps, 收到 %2 帧, 已处理 %3 帧, 丢弃 %4 帧(队列 %5, 显示 %6)")
+                             .arg(fps, 0, 'f', 1)
+                             .arg(stats.received)
+                             .arg(stats.processed)
+                             .arg(stats.droppedQueued + stats.droppedDisplay)
+                             .arg(stats.droppedQueued)
+                             .arg(stats.droppedDisplay));
+}
+
+// 把当前效果应用到整段视频, 解码、处理、编码流水线进行, 内存占用与视频长度无关
+void VideoSession::exportVideo()
+{
+    if (currentPath.isEmpty() || exporter->isRunning()) return;
+    
+    const QString videoFilter = tr("MP4 视频 (*.mp4)");
+    const QString pngFilter = tr("PNG 图像序列 (*.png)");
+    const QString jpegFilter = tr("JPEG 图像序列 (*.jpg)");
+    QString selectedFilter;
+    QString fileName = QFileDialog::getSaveFileName(
+        window, tr("导出视频"),
+        QFileInfo(currentPath).dir().filePath(QFileInfo(currentPath).completeBaseName() + "_processed.mp4"),
+        videoFilter + ";;" + pngFilter + ";;" + jpegFilter, &selectedFilter);
+    if (fileName.isEmpty()) return;
+    
+    VideoExporter::Options options;
+    options.source = currentPath;
+    options.output = fileName;
+    options.kind = selectedFilter == videoFilter ? VideoExporter::OutputKind::VideoFile
+                                                 : VideoExporter::OutputKind::ImageSequence;
+    const ImageOperation operation = pipeline->currentOperation();
+    if (operation.isValid()) {
+        options.operations.append(operation);
+    }
+    
+    // 进度以源视频时长的千分比表示
+    QProgressDialog *progressDialog = new QProgressDialog(tr("正在导出..."), tr("取消"), 0, 1000, window);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+    progressDialog->setWindowModality(Qt::WindowModal);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(0);
+    connect(progressDialog, &QProgressDialog::canceled, exporter, &VideoExporter::cancel);
+    connect(exporter, &VideoExporter::progress, progressDialog,
+            [progressDialog](int frames, qint64 position, qint64 duration, qint64 remaining) {
+        if (duration > 0) {
+            progressDialog->setValue(int(qBound<qint64>(0, 1000 * position / duration, 1000)));
+        }
+        const QString eta = remaining >= 0 ? tr("剩余约 %1 秒").arg((remaining + 999) / 1000)
+                                           : tr("剩余时间未知");
+        progressDialog->setLabelText(tr("已导出 %1 帧 (%2 / %3 秒), %4")
+                                         .arg(frames).arg(position / 1000).arg(duration / 1000).arg(eta));
+    });
+    connect(exporter, &VideoExporter::finished, progressDialog,
+            [this, progressDialog](bool success, const QString &message) {
+        const bool canceled = progressDialog->wasCanceled();
+        progressDialog->close();
+        if (success) {
+            window->statusBar()->showMessage(message.isEmpty() ? tr("视频导出完成")
+                                                               : tr("视频导出完成, %1").arg(message), 5000);
+        } else if (!canceled) {
+            QMessageBox::warning(window, tr("导出视频"), message);
+        }
+    });
+    
+    if (!exporter->start(options)) {
+        progressDialog->close();
+    }
+}
@@ -0,0 +1,72 @@
+﻿#ifndef VIDEOSESSION_H
+#define VIDEOSESSION_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include "imageprocessor.h"
+
+class QLabel;
+class QMainWindow;
+class QMediaPlayer;
+class QTimer;
+class QVideoFrame;
+class QVideoSink;
+class QWidget;
+class VideoExporter;
+class VideoPipeline;
+
+// 视频模式: 播放视频文件, 在工作线程对每帧应用当前效果, 并可把效果导出到整段视频
+// 依赖 Qt Multimedia 的部分都在这里; 以 CONFIG+=no_multimedia 构建时没有这个类
+// 第一次打开视频时才创建, 不影响只编辑图像时的启动
+class VideoSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 控制面板加入 window 中央部件的布局, 处理统计显示在 window 的状态栏
+    explicit VideoSession(QMainWindow *window);
+    ~VideoSession();
+
+    bool isActive() const { return active; }
+    // 开始播放 path, 帧缩放到 targetSize
+    void open(const QString &path, const QSize &targetSize);
+    // 停止播放与处理, 移除控制面板
+    void close();
+
+    void setOperation(const ImageOperation &operation);
+    void setTargetSize(const QSize &size);
+
+signals:
+    // 处理后的最新一帧
+    void frameReady(const QImage &image);
+    // 点击了"返回图像编辑"
+    void closeRequested();
+
+private slots:
+    void onFrameReady();
+    void updateStatus();
+    void exportVideo();
+
+private:
+    // 在 QVideoSink 发出帧的线程上调用
+    void onFrameChanged(const QVideoFrame &frame);
+    QWidget *createControlPanel();
+
+    QMainWindow *window;
+    QMediaPlayer *player = nullptr;
+    QVideoSink *sink = nullptr;
+    VideoPipeline *pipeline;        // 视频帧处理线程
+    VideoExporter *exporter;        // 把当前效果流式应用到整段视频
+    QWidget *controlPanel = nullptr;
+    QLabel *statusLabel;            // 状态栏中的视频处理统计
+    QTimer *statusTimer;
+    QElapsedTimer statusElapsed;
+    quint64 lastProcessedFrames = 0;
+    QString currentPath;
+    bool active = false;
+};
+
+#endif // VIDEOSESSION_H
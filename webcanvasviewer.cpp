@@ -0,0 +1,276 @@
+﻿#include "webcanvasviewer.h"
+#include "frameschemehandler.h"
+#include "tracer.h"
+#include <QJsonArray>
+#include <QStringList>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QWebEngineProfile>
+#include <QWebEngineView>
+#include <cstring>
+
+WebCanvasViewer::WebCanvasViewer(QWidget *parent)
+    : ImageViewer(parent)
+{
+    // 页面创建前以页面的背景色填充
+    QPalette background = palette();
+    background.setColor(QPalette::Window, QColor(0xf0, 0xf0, 0xf0));
+    setPalette(background);
+    setAutoFillBackground(true);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    frameHandler = new FrameSchemeHandler(this);
+    connect(frameHandler, &FrameSchemeHandler::messageReceived, this, &WebCanvasViewer::onMessage);
+}
+
+void WebCanvasViewer::showEvent(QShowEvent *event)
+{
+    ImageViewer::showEvent(event);
+    // 等主窗口先绘制出来再启动 WebEngine
+    if (!view) {
+        QTimer::singleShot(0, this, &WebCanvasViewer::createView);
+    }
+}
+
+void WebCanvasViewer::createView()
+{
+    if (view) return;
+    TRACE_SCOPE("startup", "createWebView");
+
+    // 远程调试只在需要时开启: 启动前设置 QTWEBENGINE_REMOTE_DEBUGGING=<端口>,
+    // 或在命令行加 --remote-debugging-port=<端口>
+    view = new QWebEngineView(this);
+    layout()->addWidget(view);
+
+    // 安装二进制帧通道, 画布页面也通过该协议加载
+    view->page()->profile()->installUrlSchemeHandler(FrameSchemeHandler::SchemeName, frameHandler);
+    connect(view, &QWebEngineView::loadFinished, this, &WebCanvasViewer::onLoadFinished);
+    view->load(FrameSchemeHandler::viewerUrl());
+}
+
+void WebCanvasViewer::onLoadFinished(bool ok)
+{
+    pageReady = ok;
+    if (!ok) return;
+    if (!pendingFrame.isEmpty()) {
+        view->page()->runJavaScript(pendingFrame);
+    }
+    if (!pendingTileSource.isEmpty()) {
+        view->page()->runJavaScript(pendingTileSource);
+    }
+    pendingFrame.clear();
+    pendingTileSource.clear();
+}
+
+void WebCanvasViewer::registerUrlScheme()
+{
+    FrameSchemeHandler::registerUrlScheme();
+}
+
+void WebCanvasViewer::showImage(const QImage &image)
+{
+    // 以原始 RGBA 数据发布帧, 页面按序号读取, 不经过编码
+    QImage frame;
+    {
+        TRACE_SCOPE("canvas", "toWorkingFormat");
+        frame = ImageProcessor::toWorkingFormat(image);
+    }
+    currentFrame = frame;
+    quint64 frameId = frameHandler->publishFrame(frame);
+
+    // 跟踪开启时页面在绘制完成后回报各阶段耗时
+    const bool tracing = Tracer::isEnabled();
+    if (tracing) {
+        framePublishTimes.insert(frameId, Tracer::now());
+        while (framePublishTimes.size() > MaxTracedFrames) {
+            framePublishTimes.erase(framePublishTimes.begin());
+        }
+    } else {
+        framePublishTimes.clear();
+    }
+
+    QString script = QString("showFrame(%1, %2, %3, %4)").arg(frameId).arg(frame.width()).arg(frame.height())
+                         .arg(QLatin1String(tracing ? "true" : "false"));
+    if (!pageReady) {
+        pendingFrame = script;
+        return;
+    }
+    TRACE_SCOPE("canvas", "runJavaScript");
+    view->page()->runJavaScript(script);
+}
+
+void WebCanvasViewer::showPatches(const QVector<ImagePatch> &patches)
+{
+    if (currentFrame.isNull() || patches.isEmpty()) return;
+    TRACE_SCOPE("canvas", "showPatches");
+    ImageProcessor::applyPatches(currentFrame, patches);
+
+    // 从更新后的帧上取各区域, 区域已与帧求交
+    QVector<QRect> rects;
+    for (const ImagePatch &patch : patches) {
+        rects.append(patch.rect);
+    }
+    const QVector<ImagePatch> regions = ImageProcessor::extractPatches(currentFrame, rects);
+    if (regions.isEmpty()) return;
+
+    int atlasWidth = 0;
+    int atlasHeight = 0;
+    qint64 changedPixels = 0;
+    for (const ImagePatch &region : regions) {
+        atlasWidth = qMax(atlasWidth, region.rect.width());
+        atlasHeight += region.rect.height();
+        changedPixels += qint64(region.rect.width()) * region.rect.height();
+    }
+    // 页面加载完成前只保留整帧; 变化超过半帧时整帧发布也不会更慢
+    if (!pageReady || changedPixels * 2 > qint64(currentFrame.width()) * currentFrame.height()) {
+        showImage(currentFrame);
+        return;
+    }
+
+    // 各区域自上而下拼成一幅图发布, 页面一次读取
+    QImage atlas(atlasWidth, atlasHeight, ImageProcessor::WorkingFormat);
+    QStringList descriptions;
+    int top = 0;
+    for (const ImagePatch &region : regions) {
+        const qsizetype bytes = qsizetype(region.rect.width()) * 4;
+        for (int y = 0; y < region.rect.height(); ++y) {
+            memcpy(atlas.scanLine(top + y), region.pixels.constScanLine(y), bytes);
+        }
+        top += region.rect.height();
+        descriptions.append(QString("{x: %1, y: %2, width: %3, height: %4}")
+                                .arg(region.rect.x()).arg(region.rect.y())
+                                .arg(region.rect.width()).arg(region.rect.height()));
+    }
+    const quint64 frameId = frameHandler->publishFrame(atlas);
+    view->page()->runJavaScript(QString("showPatches(%1, %2, %3, [%4])").arg(frameId).arg(atlasWidth)
+                                    .arg(atlasHeight).arg(descriptions.join(", ")));
+}
+
+void WebCanvasViewer::showWelcome()
+{
+    currentFrame = QImage();
+    if (!pageReady) {
+        // 页面加载完成后自行显示欢迎文字
+        pendingFrame.clear();
+        return;
+    }
+    view->page()->runJavaScript("drawWelcomeText();");
+}
+
+void WebCanvasViewer::reset()
+{
+    pageReady = false;
+    currentFrame = QImage();
+    pendingFrame.clear();
+    pendingTileSource.clear();
+    // 通过 qtframe:// 协议加载页面, 使页面与帧数据同源
+    if (view) {
+        view->load(FrameSchemeHandler::viewerUrl());
+    }
+}
+
+void WebCanvasViewer::setTileSource(const TileSource &source)
+{
+    QString script = "setTileSource(null)";
+    if (source.isValid()) {
+        script = QString("setTileSource({revision: %1, width: %2, height: %3, levels: %4, tileSize: %5})")
+                     .arg(source.revision).arg(source.imageSize.width()).arg(source.imageSize.height())
+                     .arg(source.levels).arg(source.tileSize);
+    }
+    if (!pageReady) {
+        pendingTileSource = script;
+        return;
+    }
+    view->page()->runJavaScript(script);
+}
+
+void WebCanvasViewer::setTileProvider(const TileProvider &provider)
+{
+    frameHandler->setTileProvider(provider);
+}
+
+void WebCanvasViewer::setMosaicMode(bool enabled)
+{
+    if (!pageReady) {
+        if (enabled) emit mosaicModeChanged(false);
+        return;
+    }
+    if (!enabled) {
+        // 页面退出后通过 mosaicMode 消息通知
+        view->page()->runJavaScript("stopMosaicMode()");
+        return;
+    }
+    view->page()->runJavaScript("startMosaicMode()", [this](const QVariant &result) {
+        emit mosaicModeChanged(result.toBool());
+    });
+}
+
+// 画布页面发来的消息
+void WebCanvasViewer::onMessage(const QString &name, const QJsonObject &message)
+{
+    if (name == "trace") {
+        if (Tracer::isEnabled()) recordTrace(message);
+        return;
+    }
+    if (name == "shown") {
+        // 页面每次重新加载后都会回报, 只转发第一次
+        if (!firstFrameReported) {
+            firstFrameReported = true;
+            emit firstFrameShown();
+        }
+        return;
+    }
+    if (name == "resync") {
+        // 局部更新的数据在页面读取前已被释放, 重新发送整帧
+        if (!currentFrame.isNull()) showImage(currentFrame);
+        return;
+    }
+    if (name == "mosaicMode") {
+        emit mosaicModeChanged(message.value("active").toBool());
+        return;
+    }
+    if (name != "mosaic") return;
+
+    // 马赛克落笔以图像宽度为单位, 可在任意分辨率上重放
+    QVector<MosaicDab> dabs;
+    const QJsonArray dabArray = message.value("dabs").toArray();
+    for (const QJsonValue &value : dabArray) {
+        const QJsonObject dabObject = value.toObject();
+        MosaicDab dab;
+        dab.center = QPointF(dabObject.value("x").toDouble(), dabObject.value("y").toDouble());
+        dab.radius = dabObject.value("radius").toDouble();
+        dab.blockSize = dabObject.value("block").toDouble();
+        dabs.append(dab);
+    }
+    if (!dabs.isEmpty()) {
+        emit mosaicApplied(dabs);
+    }
+}
+
+// 页面回报的一帧各阶段耗时(毫秒)
+// 页面时钟与本进程不同, 以消息到达时刻为终点倒推各阶段的位置
+void WebCanvasViewer::recordTrace(const QJsonObject &message)
+{
+    const qint64 arrived = Tracer::now();
+    const quint64 frameId = quint64(message.value("frame").toDouble());
+    const qint64 fetchNs = qint64(message.value("fetch").toDouble() * 1e6);
+    const qint64 decodeNs = qint64(message.value("decode").toDouble() * 1e6);
+    const qint64 drawNs = qint64(message.value("draw").toDouble() * 1e6);
+
+    const int track = Tracer::virtualTrack(tr("画布页面"));
+    qint64 start = arrived - (fetchNs + decodeNs + drawNs);
+
+    // 发布到回报的完整时间, 与页面内各阶段之差即为 runJavaScript 调度和消息传递的开销
+    const auto published = framePublishTimes.constFind(frameId);
+    if (published != framePublishTimes.constEnd()) {
+        start = qMax(start, published.value());
+        Tracer::addComplete("canvas", "canvas.frame", published.value(), arrived - published.value(), track);
+        framePublishTimes.erase(published);
+    }
+
+    Tracer::addComplete("canvas", "canvas.fetch", start, fetchNs, track);
+    Tracer::addComplete("canvas", "canvas.decode", start + fetchNs, decodeNs, track);
+    Tracer::addComplete("canvas", "canvas.draw", start + fetchNs + decodeNs, drawNs, track);
+}
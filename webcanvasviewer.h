@@ -0,0 +1,59 @@
+﻿#ifndef WEBCANVASVIEWER_H
+#define WEBCANVASVIEWER_H
+
+#include <QJsonObject>
+#include <QMap>
+#include "imageviewer.h"
+
+class FrameSchemeHandler;
+class QWebEngineView;
+
+// QWebEngineView 中的 canvas 页面(html/canvas_viewer.html)
+// 帧以原始 RGBA 数据经 qtframe:// 协议发布, 页面按序号读取后绘制; 马赛克画笔在页面中实现
+// 局部更新只发布变化的区域, 页面写入保留的帧后只重绘这些区域
+// QWebEngineView 在控件第一次显示之后才创建并加载页面, 主窗口不必等待 Chromium 启动;
+// 页面加载完成前只保留最新的一帧和分块来源, 加载完成后补发
+class WebCanvasViewer : public ImageViewer
+{
+    Q_OBJECT
+
+public:
+    explicit WebCanvasViewer(QWidget *parent = nullptr);
+
+    // 自定义协议必须在创建 QApplication 之前注册
+    static void registerUrlScheme();
+
+    void showImage(const QImage &image) override;
+    void showPatches(const QVector<ImagePatch> &patches) override;
+    void showWelcome() override;
+    void reset() override;
+    void setTileSource(const TileSource &source) override;
+    void setTileProvider(const TileProvider &provider) override;
+    void setMosaicMode(bool enabled) override;
+
+protected:
+    void showEvent(QShowEvent *event) override;
+
+private:
+    void createView();
+    void onLoadFinished(bool ok);
+    void onMessage(const QString &name, const QJsonObject &message);
+    void recordTrace(const QJsonObject &message);
+
+    QWebEngineView *view = nullptr;
+    // 与画布页面之间的二进制帧通道
+    FrameSchemeHandler *frameHandler;
+    // 最近显示的帧(工作格式), 局部更新原地写入; 页面读取后处理器即释放这一帧,
+    // 只在与调用方的图像或尚未读取的帧共享数据时复制一次
+    QImage currentFrame;
+    bool pageReady = false;
+    bool firstFrameReported = false;
+    QString pendingFrame;           // 页面就绪前最新一帧的 showFrame 调用
+    QString pendingTileSource;
+
+    // 性能跟踪: 帧发布时刻, 页面回报耗时时用于计算整帧延迟
+    static constexpr int MaxTracedFrames = 16;
+    QMap<quint64, qint64> framePublishTimes;
+};
+
+#endif // WEBCANVASVIEWER_H